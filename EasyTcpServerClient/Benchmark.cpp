@@ -0,0 +1,591 @@
+// TicTacBenchmark - load generator and latency benchmark for TicTacServer
+//
+// Scripted players register, pair up (player 2k invites player 2k+1), play '--rounds' [Step] round trips
+// and close the game. Reported per message type: p50/p99/p999 latency, plus messages per second
+// and server CPU time per message (when the server is started by the benchmark in a child process).
+//
+// Usage:
+//   TicTacBenchmark [--players N] [--rounds R] [--ramp players_per_second]
+//                   [--client-threads T] [--server-threads S] [--port P] [--host H] [--timeout seconds]
+//                   [--lobby-churn players_per_second] [--socket-options profile|all]
+//   TicTacBenchmark --idle N [--server-threads S] [--port P]
+//
+//   --host - use already running server (server CPU is not reported)
+//   --lobby-churn - short-lived players (register, disconnect) during the games: every player
+//            receives [PlayerJoined]/[PlayerLeft] between its [OnStep] messages
+//   --idle - N registered players (without lobby updates) stay idle: reports the server memory per session
+//            (resident memory growth of the server process; N is limited by the open files limit)
+//   --socket-options - SocketOptions profile of the started server (see SOCKET_OPTIONS_PROFILES);
+//            "all" -> the benchmark is run with each of them
+//            (e.g. "--players 20 --rounds 200 --lobby-churn 50 --socket-options all": with Nagle an [OnStep]
+//            written right after a lobby update waits for the client's delayed ack)
+//
+
+#include "TicTacTcpServer.h"
+#include "TicTacClient.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <fcntl.h>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct BenchmarkConfig
+{
+    size_t      m_playerNumber        = 200;
+    size_t      m_roundNumber         = 100;
+    size_t      m_rampPlayersPerSec   = 0;      // 0 -> all players at once
+    size_t      m_clientThreadNumber  = 1;
+    size_t      m_serverThreadNumber  = 0;      // 0 -> one per core
+    std::string m_host;                         // empty -> start own server
+    std::string m_port                = "15101";
+    size_t      m_timeoutSec          = 120;
+    size_t      m_idleSessionNumber   = 0;      // > 0 -> idle footprint benchmark
+    size_t      m_lobbyChurnPerSec    = 0;
+    std::string m_socketProfile       = "nodelay";
+};
+
+enum LatencyType { lt_register, lt_invite, lt_step, lt_number };
+
+const char* LATENCY_TYPE_NAMES[lt_number] = { "[PlayerName] -> [Ok]", "[Invite] -> [InvitationAccepted]", "[Step] -> [OnStep] (round trip)" };
+
+std::atomic<size_t> gSentMessageNumber{0};
+std::atomic<size_t> gFinishedGameNumber{0};
+
+class BenchPlayer: public tic_tac::TicTacClient
+{
+    const size_t                m_index;
+    const size_t                m_roundNumber;
+    const std::string           m_partnerName;
+
+    bool                        m_isInvited = false;
+    size_t                      m_round = 0;
+    Clock::time_point           m_sendTime[lt_number];
+
+public:
+    std::vector<uint32_t>       m_latencyUs[lt_number];
+
+    BenchPlayer( boost::asio::io_context& context, size_t index, size_t roundNumber )
+      : TicTacClient( context, playerName(index) ),
+        m_index(index),
+        m_roundNumber(roundNumber),
+        m_partnerName( playerName( index ^ 1 ) )
+    {
+    }
+
+    static std::string playerName( size_t index ) { return "bench" + std::to_string(index); }
+
+    bool isInviter() const { return ( m_index % 2 ) == 0; }
+
+protected:
+    void onMessageReceived( std::string_view message ) override
+    {
+        if ( message == tic_tac::SMT_HI )
+        {
+            // TicTacClient answers by [PlayerName]
+            send( lt_register );
+        }
+        TicTacClient::onMessageReceived( message );
+    }
+
+    void onRegistered() override
+    {
+        received( lt_register );
+    }
+
+    void onPlayerListChanged() override
+    {
+        if ( ! isInviter() || m_isInvited )
+        {
+            return;
+        }
+
+        if ( auto it = m_availablePlayerList.find( m_partnerName ); it != m_availablePlayerList.end() && it->second )
+        {
+            m_isInvited = true;
+            send( lt_invite );
+            sendInvitaion( m_partnerName );
+        }
+    }
+
+    void onInvitation( std::string partnerName ) override
+    {
+        gSentMessageNumber++;
+        sendInvitaionResponse( partnerName, partnerName == m_partnerName );
+    }
+
+    void onAcceptedInvitation( std::string partnerName, bool isAccepted ) override
+    {
+        if ( ! isAccepted )
+        {
+            return;
+        }
+        received( lt_invite );
+        sendNextStep();
+    }
+
+    void onPlayerOfflined( std::string partnerName ) override
+    {
+    }
+
+    void onPartnerStep( std::string partnerName, bool isX, int x, int y ) override
+    {
+        if ( ! isInviter() )
+        {
+            gSentMessageNumber++;
+            sendStep( m_partnerName, "0", std::to_string(x), std::to_string(y) );
+            return;
+        }
+
+        received( lt_step );
+        sendNextStep();
+    }
+
+private:
+    void sendNextStep()
+    {
+        if ( m_round++ == m_roundNumber )
+        {
+            gSentMessageNumber++;
+            sendCloseGame( m_partnerName );
+            gFinishedGameNumber++;
+            return;
+        }
+
+        send( lt_step );
+        sendStep( m_partnerName, "X", std::to_string( m_round%3 ), std::to_string( m_round/3%3 ) );
+    }
+
+    void send( LatencyType type )
+    {
+        gSentMessageNumber++;
+        m_sendTime[type] = Clock::now();
+    }
+
+    void received( LatencyType type )
+    {
+        auto latency = std::chrono::duration_cast<std::chrono::microseconds>( Clock::now() - m_sendTime[type] );
+        m_latencyUs[type].push_back( uint32_t( latency.count() ) );
+    }
+};
+
+// short-lived player: registers (without lobby updates) and disconnects after [Ok]]
+class ChurnSession: public std::enable_shared_from_this<ChurnSession>
+{
+    boost::asio::ip::tcp::socket    m_socket;
+    std::string                     m_request;
+    std::string                     m_response;
+    std::array<char,256>            m_buffer;
+
+public:
+    ChurnSession( boost::asio::io_context& context, size_t index )
+      : m_socket( context ),
+        m_request( tic_tac::makeMessage( tic_tac::CMT_PLAYER_NAME, "churn" + std::to_string(index), "0" ) )
+    {
+    }
+
+    void start( const boost::asio::ip::tcp::resolver::results_type& endpoints )
+    {
+        boost::asio::async_connect( m_socket, endpoints, [self=shared_from_this()] ( auto error, auto )
+        {
+            if ( error )
+            {
+                return;
+            }
+            boost::asio::async_write( self->m_socket, boost::asio::buffer( self->m_request ), [self] ( auto error, auto )
+            {
+                if ( ! error )
+                {
+                    self->read();
+                }
+            });
+        });
+    }
+
+private:
+    void read()
+    {
+        m_socket.async_read_some( boost::asio::buffer( m_buffer ), [self=shared_from_this()] ( auto error, size_t size )
+        {
+            if ( error )
+            {
+                return;
+            }
+            self->m_response.append( self->m_buffer.data(), size );
+            if ( self->m_response.find( tic_tac::SMT_OK ) != std::string::npos && self->m_response.back() == ';' )
+            {
+                boost::system::error_code ec;
+                self->m_socket.close( ec );
+                return;
+            }
+            self->read();
+        });
+    }
+};
+
+// starts 'churnPerSec' short-lived players per second (in batches every 10 ms)
+class LobbyChurn
+{
+    boost::asio::io_context&                        m_context;
+    boost::asio::ip::tcp::resolver::results_type    m_endpoints;
+    boost::asio::steady_timer                       m_timer;
+    size_t                                          m_batchSize;
+    size_t                                          m_sessionNumber = 0;
+
+public:
+    LobbyChurn( boost::asio::io_context& context, const std::string& host, const std::string& port, size_t churnPerSec )
+      : m_context( context ),
+        m_endpoints( boost::asio::ip::tcp::resolver( context ).resolve( host, port ) ),
+        m_timer( context ),
+        m_batchSize( std::max( 1ul, churnPerSec / 100 ) )
+    {
+    }
+
+    void start()
+    {
+        for( size_t i=0; i<m_batchSize; i++ )
+        {
+            std::make_shared<ChurnSession>( m_context, m_sessionNumber++ )->start( m_endpoints );
+        }
+
+        m_timer.expires_after( std::chrono::milliseconds(10) );
+        m_timer.async_wait( [this] ( auto error )
+        {
+            if ( ! error )
+            {
+                start();
+            }
+        });
+    }
+};
+
+// utime+stime of the process (seconds)
+double processCpuTime( pid_t pid )
+{
+    std::ifstream stat( "/proc/" + std::to_string(pid) + "/stat" );
+    std::string statLine;
+    std::getline( stat, statLine );
+
+    // skip "pid (comm)": comm can contain spaces
+    auto pos = statLine.rfind( ')' );
+    if ( pos == std::string::npos )
+    {
+        return 0;
+    }
+
+    std::istringstream fields( statLine.substr( pos+2 ) );
+    std::string field;
+    unsigned long utime = 0, stime = 0;
+    for( int i=3; i<=15 && fields >> field; i++ )
+    {
+        if ( i == 14 ) utime = std::stoul( field );
+        if ( i == 15 ) stime = std::stoul( field );
+    }
+    return double( utime + stime ) / sysconf( _SC_CLK_TCK );
+}
+
+// resident memory of the process (bytes)
+size_t processResidentSize( pid_t pid )
+{
+    std::ifstream status( "/proc/" + std::to_string(pid) + "/status" );
+    std::string line;
+    while ( std::getline( status, line ) )
+    {
+        if ( line.rfind( "VmRSS:", 0 ) == 0 )
+        {
+            return std::stoul( line.substr( 6 ) ) * 1024;
+        }
+    }
+    return 0;
+}
+
+bool waitForServer( const std::string& host, const std::string& port )
+{
+    for( int i=0; i<200; i++ )
+    {
+        boost::asio::io_context context;
+        boost::asio::ip::tcp::socket socket( context );
+        boost::system::error_code ec;
+        boost::asio::ip::tcp::resolver resolver( context );
+        boost::asio::connect( socket, resolver.resolve( host, port ), ec );
+        if ( ! ec )
+        {
+            return true;
+        }
+        usleep( 10000 );
+    }
+    return false;
+}
+
+uint32_t percentile( const std::vector<uint32_t>& sorted, double p )
+{
+    if ( sorted.empty() )
+    {
+        return 0;
+    }
+    return sorted[ std::min( sorted.size()-1, size_t( p * sorted.size() ) ) ];
+}
+
+BenchmarkConfig parseArguments( int argc, char* argv[] )
+{
+    BenchmarkConfig config;
+    for( int i=1; i+1<argc; i+=2 )
+    {
+        std::string name = argv[i];
+        std::string value = argv[i+1];
+
+        if ( name == "--players" )              config.m_playerNumber = std::stoul( value ) & ~size_t(1);
+        else if ( name == "--rounds" )          config.m_roundNumber = std::stoul( value );
+        else if ( name == "--ramp" )            config.m_rampPlayersPerSec = std::stoul( value );
+        else if ( name == "--client-threads" )  config.m_clientThreadNumber = std::max( 1ul, std::stoul( value ) );
+        else if ( name == "--server-threads" )  config.m_serverThreadNumber = std::stoul( value );
+        else if ( name == "--port" )            config.m_port = value;
+        else if ( name == "--host" )            config.m_host = value;
+        else if ( name == "--timeout" )         config.m_timeoutSec = std::stoul( value );
+        else if ( name == "--idle" )            config.m_idleSessionNumber = std::stoul( value );
+        else if ( name == "--lobby-churn" )     config.m_lobbyChurnPerSec = std::stoul( value );
+        else if ( name == "--socket-options" )  config.m_socketProfile = value;
+        else
+        {
+            std::cerr << "unknown argument: " << name << std::endl;
+            exit(1);
+        }
+    }
+    return config;
+}
+
+// registers 'config.m_idleSessionNumber' players one by one, then measures the server
+int runIdleBenchmark( const BenchmarkConfig& config, FILE* report, const std::string& host, pid_t serverPid )
+{
+    boost::asio::io_context context;
+    boost::asio::ip::tcp::resolver resolver( context );
+    auto endpoints = resolver.resolve( host, config.m_port );
+
+    // (the server has allocated its startup memory)
+    usleep( 100000 );
+    auto residentSizeStart = processResidentSize( serverPid );
+
+    std::vector<boost::asio::ip::tcp::socket> sockets;
+    sockets.reserve( config.m_idleSessionNumber );
+    std::array<char,256> buffer;
+    for( size_t i=0; i<config.m_idleSessionNumber; i++ )
+    {
+        boost::system::error_code ec;
+        auto& socket = sockets.emplace_back( context );
+        boost::asio::connect( socket, endpoints, ec );
+        if ( !ec )
+        {
+            boost::asio::write( socket, boost::asio::buffer( tic_tac::makeMessage( tic_tac::CMT_PLAYER_NAME, "idle" + std::to_string(i), "0" ) ), ec );
+        }
+
+        // "Hi;" and "[Ok]][,<token>];"
+        std::string response;
+        while ( !ec && ( response.find( tic_tac::SMT_OK ) == std::string::npos || response.back() != ';' ) )
+        {
+            response.append( buffer.data(), socket.read_some( boost::asio::buffer(buffer), ec ) );
+        }
+        if ( ec )
+        {
+            fprintf( report, "idle session %zu: %s\n", i, ec.message().c_str() );
+            sockets.pop_back();
+            break;
+        }
+    }
+
+    usleep( 100000 );
+    auto residentSize = processResidentSize( serverPid );
+
+    fprintf( report, "idle sessions: %zu\n", sockets.size() );
+    fprintf( report, "server resident memory: %.1f MB -> %.1f MB\n", residentSizeStart / 1e6, residentSize / 1e6 );
+    if ( ! sockets.empty() )
+    {
+        fprintf( report, "bytes per idle session: %.0f\n", double( residentSize - residentSizeStart ) / sockets.size() );
+    }
+    return sockets.size() == config.m_idleSessionNumber ? 0 : 2;
+}
+
+} // namespace
+
+int main( int argc, char* argv[] )
+{
+    auto config = parseArguments( argc, argv );
+
+    // each profile is run by a child process (with its own server)
+    if ( config.m_socketProfile == "all" )
+    {
+        int result = 0;
+        for( auto profile : SOCKET_OPTIONS_PROFILES )
+        {
+            printf( "--- socket options: %s\n", profile.data() );
+            fflush( stdout );
+
+            pid_t pid = fork();
+            if ( pid == 0 )
+            {
+                config.m_socketProfile = std::string( profile );
+                break;
+            }
+
+            int status = 0;
+            waitpid( pid, &status, 0 );
+            result = std::max( result, WIFEXITED(status) ? WEXITSTATUS(status) : 1 );
+        }
+        if ( config.m_socketProfile == "all" )
+        {
+            return result;
+        }
+    }
+
+    SocketOptions socketOptions;
+    if ( ! socketOptionsProfile( config.m_socketProfile, socketOptions ) )
+    {
+        std::cerr << "unknown socket options: " << config.m_socketProfile << std::endl;
+        return 1;
+    }
+
+    // logs of server and clients go to /dev/null, report goes to original stdout
+    FILE* report = fdopen( dup( STDOUT_FILENO ), "w" );
+    int devNull = open( "/dev/null", O_WRONLY );
+    dup2( devNull, STDOUT_FILENO );
+    dup2( devNull, STDERR_FILENO );
+
+    pid_t serverPid = 0;
+    std::string host = config.m_host;
+    if ( host.empty() )
+    {
+        host = "127.0.0.1";
+        serverPid = fork();
+        if ( serverPid == 0 )
+        {
+            tic_tac::TicTacServer server( host, config.m_port, config.m_serverThreadNumber, -1, socketOptions );
+            server.run();
+            _exit(0);
+        }
+    }
+
+    if ( ! waitForServer( host, config.m_port ) )
+    {
+        fprintf( report, "server is not available: %s:%s\n", host.c_str(), config.m_port.c_str() );
+        return 1;
+    }
+
+    if ( config.m_idleSessionNumber > 0 )
+    {
+        if ( serverPid == 0 )
+        {
+            fprintf( report, "--idle needs own server (no --host)\n" );
+            return 1;
+        }
+
+        int result = runIdleBenchmark( config, report, host, serverPid );
+        kill( serverPid, SIGKILL );
+        waitpid( serverPid, nullptr, 0 );
+        fclose( report );
+        return result;
+    }
+
+    boost::asio::io_context context;
+    auto workGuard = boost::asio::make_work_guard( context );
+
+    std::vector<std::unique_ptr<BenchPlayer>> players;
+    for( size_t i=0; i<config.m_playerNumber; i++ )
+    {
+        players.push_back( std::make_unique<BenchPlayer>( context, i, config.m_roundNumber ) );
+    }
+
+    double serverCpuStart = serverPid ? processCpuTime( serverPid ) : 0;
+    auto startTime = Clock::now();
+
+    // ramp up: start players in batches every 10 ms
+    boost::asio::steady_timer rampTimer( context );
+    size_t startedPlayerNumber = 0;
+    size_t batchSize = config.m_rampPlayersPerSec == 0 ? players.size() : std::max( 2ul, config.m_rampPlayersPerSec / 100 ) & ~size_t(1);
+    std::function<void()> startBatch = [&]
+    {
+        for( size_t i=0; i<batchSize && startedPlayerNumber < players.size(); i++ )
+        {
+            players[startedPlayerNumber++]->start( host, config.m_port );
+        }
+        if ( startedPlayerNumber < players.size() )
+        {
+            rampTimer.expires_after( std::chrono::milliseconds(10) );
+            rampTimer.async_wait( [&] ( auto ) { startBatch(); } );
+        }
+    };
+    boost::asio::post( context, startBatch );
+
+    std::optional<LobbyChurn> lobbyChurn;
+    if ( config.m_lobbyChurnPerSec > 0 )
+    {
+        lobbyChurn.emplace( context, host, config.m_port, config.m_lobbyChurnPerSec );
+        boost::asio::post( context, [&lobbyChurn] { lobbyChurn->start(); } );
+    }
+
+    std::vector<std::thread> clientThreads;
+    for( size_t i=0; i<config.m_clientThreadNumber; i++ )
+    {
+        clientThreads.emplace_back( [&context] { context.run(); } );
+    }
+
+    auto deadline = startTime + std::chrono::seconds( config.m_timeoutSec );
+    while ( gFinishedGameNumber < players.size()/2 && Clock::now() < deadline )
+    {
+        usleep( 1000 );
+    }
+
+    auto duration = std::chrono::duration<double>( Clock::now() - startTime ).count();
+    double serverCpu = serverPid ? processCpuTime( serverPid ) - serverCpuStart : 0;
+
+    // let the last [CloseGame] reach the server before stop
+    usleep( 10000 );
+    context.stop();
+    for( auto& thread : clientThreads )
+    {
+        thread.join();
+    }
+
+    if ( serverPid )
+    {
+        kill( serverPid, SIGKILL );
+        waitpid( serverPid, nullptr, 0 );
+    }
+
+    fprintf( report, "players: %zu, rounds: %zu, client threads: %zu, lobby churn: %zu/s, finished games: %zu/%zu\n",
+             players.size(), config.m_roundNumber, config.m_clientThreadNumber, config.m_lobbyChurnPerSec,
+             gFinishedGameNumber.load(), players.size()/2 );
+    fprintf( report, "%-36s %10s %10s %10s %10s\n", "latency (us)", "count", "p50", "p99", "p999" );
+
+    for( int type=0; type<lt_number; type++ )
+    {
+        std::vector<uint32_t> samples;
+        for( const auto& player : players )
+        {
+            samples.insert( samples.end(), player->m_latencyUs[type].begin(), player->m_latencyUs[type].end() );
+        }
+        std::sort( samples.begin(), samples.end() );
+
+        fprintf( report, "%-36s %10zu %10u %10u %10u\n", LATENCY_TYPE_NAMES[type], samples.size(),
+                 percentile( samples, 0.5 ), percentile( samples, 0.99 ), percentile( samples, 0.999 ) );
+    }
+
+    auto messageNumber = gSentMessageNumber.load();
+    fprintf( report, "client messages: %zu in %.3f s -> %.0f msg/s\n", messageNumber, duration, messageNumber / duration );
+    if ( serverPid )
+    {
+        fprintf( report, "server cpu: %.3f s -> %.2f us/msg\n", serverCpu, messageNumber ? serverCpu * 1e6 / messageNumber : 0.0 );
+    }
+    fclose( report );
+
+    return gFinishedGameNumber == players.size()/2 ? 0 : 2;
+}
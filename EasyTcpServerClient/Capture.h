@@ -0,0 +1,175 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Logs.h"
+
+// Traffic capture of inbound frames (see TcpServer::startCapture() and Replay.cpp)
+//
+// File: CAPTURE_MAGIC, then records (little endian):
+//   uint64 time (ns since capture start, monotonic)
+//   uint32 session id
+//   uint8  record type (CaptureRecordType)
+//   uint8  reserved
+//   uint16 payload size
+//   payload (frame without ';')
+//
+namespace capture {
+
+constexpr char   CAPTURE_MAGIC[8]        = { 'T','T','C','A','P','0','0','1' };
+constexpr size_t CAPTURE_HEADER_SIZE     = 16;
+constexpr size_t CAPTURE_FLUSH_SIZE      = 256*1024;
+
+enum CaptureRecordType : uint8_t
+{
+    crt_open,       // connection accepted
+    crt_frame,      // inbound frame
+    crt_close,      // connection lost
+};
+
+struct CaptureRecord
+{
+    uint64_t            m_timeNs;
+    uint32_t            m_sessionId;
+    CaptureRecordType   m_type;
+    std::string         m_payload;
+};
+
+// CaptureWriter - appends records of all io threads into one file
+// (records are copied into a buffer under a short lock, the buffer is written by 'fwrite' when it is full;
+// records of different threads can be slightly out of time order - readers sort them by time)
+//
+class CaptureWriter
+{
+    using Clock = std::chrono::steady_clock;
+
+    const Clock::time_point m_startTime = Clock::now();
+
+    std::mutex              m_mutex;
+    FILE*                   m_file = nullptr;
+    std::vector<char>       m_buffer;
+
+public:
+    CaptureWriter( const std::string& path )
+    {
+        m_file = fopen( path.c_str(), "wb" );
+        if ( m_file == nullptr )
+        {
+            LOG_ERR( "CaptureWriter: cannot open: " << path );
+            return;
+        }
+        fwrite( CAPTURE_MAGIC, 1, sizeof(CAPTURE_MAGIC), m_file );
+        m_buffer.reserve( CAPTURE_FLUSH_SIZE + CAPTURE_HEADER_SIZE + UINT16_MAX );
+    }
+
+    ~CaptureWriter()
+    {
+        if ( m_file != nullptr )
+        {
+            flush();
+            fclose( m_file );
+        }
+    }
+
+    bool isOpen() const { return m_file != nullptr; }
+
+    void write( uint32_t sessionId, CaptureRecordType type, std::string_view payload = {} )
+    {
+        if ( m_file == nullptr )
+        {
+            return;
+        }
+
+        auto timeNs = uint64_t( std::chrono::duration_cast<std::chrono::nanoseconds>( Clock::now() - m_startTime ).count() );
+        auto size = uint16_t( std::min( payload.size(), size_t(UINT16_MAX) ) );
+
+        uint8_t header[CAPTURE_HEADER_SIZE] = {};
+        putLittleEndian( header, timeNs, 8 );
+        putLittleEndian( header+8, sessionId, 4 );
+        header[12] = type;
+        putLittleEndian( header+14, size, 2 );
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_buffer.insert( m_buffer.end(), header, header+CAPTURE_HEADER_SIZE );
+        m_buffer.insert( m_buffer.end(), payload.data(), payload.data()+size );
+        if ( m_buffer.size() >= CAPTURE_FLUSH_SIZE )
+        {
+            flushLocked();
+        }
+    }
+
+    void flush()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        flushLocked();
+    }
+
+private:
+    void flushLocked()
+    {
+        fwrite( m_buffer.data(), 1, m_buffer.size(), m_file );
+        fflush( m_file );
+        m_buffer.clear();
+    }
+
+    static void putLittleEndian( uint8_t* out, uint64_t value, size_t size )
+    {
+        for( size_t i=0; i<size; i++ )
+        {
+            out[i] = uint8_t( value >> (8*i) );
+        }
+    }
+};
+
+// reads all records of the capture file; returns false on bad format
+inline bool readCapture( const std::string& path, std::vector<CaptureRecord>& outRecords )
+{
+    FILE* file = fopen( path.c_str(), "rb" );
+    if ( file == nullptr )
+    {
+        return false;
+    }
+
+    auto getLittleEndian = [] ( const uint8_t* in, size_t size )
+    {
+        uint64_t value = 0;
+        for( size_t i=0; i<size; i++ )
+        {
+            value |= uint64_t(in[i]) << (8*i);
+        }
+        return value;
+    };
+
+    char magic[sizeof(CAPTURE_MAGIC)];
+    bool isOk = fread( magic, 1, sizeof(magic), file ) == sizeof(magic) && std::memcmp( magic, CAPTURE_MAGIC, sizeof(magic) ) == 0;
+
+    uint8_t header[CAPTURE_HEADER_SIZE];
+    while ( isOk && fread( header, 1, CAPTURE_HEADER_SIZE, file ) == CAPTURE_HEADER_SIZE )
+    {
+        CaptureRecord record;
+        record.m_timeNs    = getLittleEndian( header, 8 );
+        record.m_sessionId = uint32_t( getLittleEndian( header+8, 4 ) );
+        record.m_type      = CaptureRecordType( header[12] );
+        record.m_payload.resize( getLittleEndian( header+14, 2 ) );
+
+        if ( fread( record.m_payload.data(), 1, record.m_payload.size(), file ) != record.m_payload.size() )
+        {
+            // the last record of not closed capture can be truncated
+            break;
+        }
+        outRecords.push_back( std::move(record) );
+    }
+
+    fclose( file );
+    return isOk;
+}
+
+} // namespace capture
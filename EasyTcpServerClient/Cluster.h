@@ -0,0 +1,418 @@
+#pragma once
+
+#include <boost/asio.hpp>
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "ReceiveBuffer.h"
+#include "Logs.h"
+
+// Cluster - several server processes (nodes) share one lobby (see TicTacServer::startCluster())
+//
+// Every node connects to every peer by a persistent TCP link ('NodeLink', reconnected after a loss)
+// and accepts the links of its peers ('ClusterEndpoint'). A link carries messages one way only,
+// from the connecting node to the accepting one, so two nodes are joined by two connections.
+//
+// Frames are ';'-terminated as client messages; the first frame of a link is "[NodeHello],<node id>".
+// Messages sent while a link is down are dropped: the state of the node is sent again
+// on every connection (see INodeHandler::onNodeLinkConnected()).
+//
+// The links and the endpoint run on one thread (of the given io_context), so do the handlers.
+//
+// Links are not authenticated: a hello is accepted only for a configured peer connecting from the address
+// of its host, but the cluster port must still be reachable only by the nodes (loopback or a private network).
+//
+namespace cluster {
+
+constexpr std::string_view NMT_NODE_HELLO = "[NodeHello]";
+
+constexpr std::chrono::seconds RECONNECT_DELAY{1};
+
+struct NodeAddress
+{
+    uint32_t        m_nodeId = 0;
+    std::string     m_host;
+    std::string     m_port;
+};
+
+class NodeLink;
+
+class INodeHandler
+{
+public:
+    // the link is (re)connected: the state of this node is to be sent by 'link.send()'
+    virtual void onNodeLinkConnected( NodeLink& link ) = 0;
+
+    // frame received from the node (without ';')
+    virtual void onNodeMessage( uint32_t nodeId, std::string_view frame ) = 0;
+
+    // the node is disconnected (or connected again): the state received from it is to be dropped
+    virtual void onNodeLost( uint32_t nodeId ) = 0;
+};
+
+// NodeLink - outbound link to a peer
+//
+class NodeLink
+{
+    boost::asio::io_context&                        m_context;
+    const uint32_t                                  m_ownNodeId;
+    const NodeAddress                               m_peer;
+    INodeHandler&                                   m_handler;
+
+    boost::asio::ip::tcp::socket                    m_socket;
+    boost::asio::steady_timer                       m_reconnectTimer;
+    std::array<char,64>                             m_readBuffer;   // the peer sends nothing: the read detects a loss
+
+    std::string                                     m_pendingData;
+    std::string                                     m_sendingData;
+    bool                                            m_isConnected = false;
+    bool                                            m_isWriting = false;
+
+public:
+    NodeLink( boost::asio::io_context& context, uint32_t ownNodeId, const NodeAddress& peer, INodeHandler& handler )
+      : m_context( context ),
+        m_ownNodeId( ownNodeId ),
+        m_peer( peer ),
+        m_handler( handler ),
+        m_socket( context ),
+        m_reconnectTimer( context )
+    {
+    }
+
+    uint32_t nodeId() const { return m_peer.m_nodeId; }
+
+    void start() { connect(); }
+
+    // 'message' must be ';'-terminated; can be called from any thread
+    // (messages sent by one thread, or under one mutex, keep their order)
+    void send( std::string message )
+    {
+        boost::asio::post( m_context, [this,message=std::move(message)]
+        {
+            if ( ! m_isConnected )
+            {
+                return;
+            }
+
+            m_pendingData += message;
+            if ( ! m_isWriting )
+            {
+                writePendingData();
+            }
+        });
+    }
+
+private:
+    void connect()
+    {
+        boost::system::error_code ec;
+        boost::asio::ip::tcp::resolver resolver( m_context );
+        auto endpoints = resolver.resolve( m_peer.m_host, m_peer.m_port, ec );
+        if ( ec )
+        {
+            LOG_ERR( "NodeLink resolve error: " << m_peer.m_host << ":" << m_peer.m_port << " " << ec.message() );
+            reconnectLater();
+            return;
+        }
+
+        boost::asio::async_connect( m_socket, endpoints, [this] ( auto error, auto )
+        {
+            if ( error )
+            {
+                LOG_DBG( "NodeLink connect error: node " << m_peer.m_nodeId << " " << error.message() );
+                reconnectLater();
+                return;
+            }
+
+            LOG( "NodeLink connected: node " << m_peer.m_nodeId );
+
+            boost::system::error_code ec;
+            m_socket.set_option( boost::asio::ip::tcp::no_delay(true), ec );
+
+            m_isConnected = true;
+            m_pendingData = std::string( NMT_NODE_HELLO ) + "," + std::to_string( m_ownNodeId ) + ";";
+            writePendingData();
+            read();
+
+            m_handler.onNodeLinkConnected( *this );
+        });
+    }
+
+    void reconnectLater()
+    {
+        boost::system::error_code ec;
+        m_socket.close( ec );
+
+        m_reconnectTimer.expires_after( RECONNECT_DELAY );
+        m_reconnectTimer.async_wait( [this] ( auto error )
+        {
+            if ( ! error )
+            {
+                connect();
+            }
+        });
+    }
+
+    void read()
+    {
+        m_socket.async_read_some( boost::asio::buffer( m_readBuffer ), [this] ( auto error, size_t )
+        {
+            if ( ! error )
+            {
+                read();
+                return;
+            }
+
+            LOG( "NodeLink lost: node " << m_peer.m_nodeId << " " << error.message() );
+            m_isConnected = false;
+            m_pendingData.clear();
+            reconnectLater();
+        });
+    }
+
+    void writePendingData()
+    {
+        std::swap( m_pendingData, m_sendingData );
+        m_isWriting = true;
+
+        boost::asio::async_write( m_socket, boost::asio::buffer( m_sendingData ), [this] ( auto error, size_t )
+        {
+            m_isWriting = false;
+            m_sendingData.clear();
+
+            if ( error )
+            {
+                // (the read fails too and reconnects)
+                boost::system::error_code ec;
+                m_socket.shutdown( boost::asio::ip::tcp::socket::shutdown_both, ec );
+                return;
+            }
+
+            if ( ! m_pendingData.empty() && m_isConnected )
+            {
+                writePendingData();
+            }
+        });
+    }
+};
+
+// ClusterEndpoint - accepts the links of the peers
+//
+// A node has at most one inbound link: the previous one is dropped when the node connects again.
+// Only the 'peers' are accepted, each from an address of its host.
+// Binding is retried until it succeeds (e.g. the port is held by the previous process during a hot restart).
+//
+class ClusterEndpoint
+{
+    struct Connection: public std::enable_shared_from_this<Connection>
+    {
+        ClusterEndpoint&                m_endpoint;
+        boost::asio::ip::tcp::socket    m_socket;
+        ReceiveBuffer                   m_receiveBuffer;
+        uint32_t                        m_nodeId = 0;   // 0 -> no [NodeHello] yet
+
+        Connection( ClusterEndpoint& endpoint, boost::asio::ip::tcp::socket&& socket ) : m_endpoint( endpoint ), m_socket( std::move(socket) ) {}
+
+        void read()
+        {
+            auto buffer = m_receiveBuffer.prepare();
+            if ( buffer.size() == 0 )
+            {
+                LOG_ERR( "ClusterEndpoint frame is too long: node " << m_nodeId );
+                close();
+                m_endpoint.onConnectionLost( *this );
+                return;
+            }
+
+            m_socket.async_read_some( buffer, [self=shared_from_this()] ( auto error, size_t dataSize )
+            {
+                if ( error )
+                {
+                    self->m_endpoint.onConnectionLost( *self );
+                    return;
+                }
+
+                self->m_receiveBuffer.commit( dataSize );
+                std::string_view frame;
+                while ( self->m_socket.is_open() && self->m_receiveBuffer.nextFrame( frame ) )
+                {
+                    self->m_endpoint.onFrame( *self, frame );
+                }
+                if ( self->m_socket.is_open() )
+                {
+                    self->read();
+                }
+            });
+        }
+
+        void close()
+        {
+            boost::system::error_code ec;
+            m_socket.close( ec );
+        }
+    };
+
+    boost::asio::io_context&                        m_context;
+    INodeHandler&                                   m_handler;
+    boost::asio::ip::tcp::endpoint                  m_endpoint;
+    boost::asio::ip::tcp::acceptor                  m_acceptor;
+    boost::asio::steady_timer                       m_bindTimer;
+
+    // addresses of the peer hosts (by node id)
+    std::map<uint32_t,std::vector<boost::asio::ip::address>>   m_peerAddresses;
+
+    // current inbound link of a node
+    std::map<uint32_t,std::shared_ptr<Connection>>  m_connections;
+
+public:
+    ClusterEndpoint( boost::asio::io_context& context, const std::string& addr, const std::string& port,
+                     const std::vector<NodeAddress>& peers, INodeHandler& handler )
+      : m_context( context ),
+        m_handler( handler ),
+        m_acceptor( context ),
+        m_bindTimer( context )
+    {
+        boost::asio::ip::tcp::resolver resolver( context );
+        m_endpoint = *resolver.resolve( addr, port ).begin();
+
+        for( const auto& peer : peers )
+        {
+            boost::system::error_code ec;
+            auto& addresses = m_peerAddresses[peer.m_nodeId];
+            for( const auto& entry : resolver.resolve( peer.m_host, peer.m_port, ec ) )
+            {
+                addresses.push_back( entry.endpoint().address() );
+            }
+            if ( ec )
+            {
+                LOG_ERR( "ClusterEndpoint cannot resolve peer " << peer.m_nodeId << ": " << peer.m_host << " " << ec.message() );
+            }
+        }
+        listen();
+    }
+
+private:
+    void listen()
+    {
+        boost::system::error_code ec;
+        m_acceptor.open( m_endpoint.protocol(), ec );
+        m_acceptor.set_option( boost::asio::ip::tcp::acceptor::reuse_address(true), ec );
+        m_acceptor.bind( m_endpoint, ec );
+        if ( ! ec )
+        {
+            m_acceptor.listen( boost::asio::socket_base::max_listen_connections, ec );
+        }
+        if ( ec )
+        {
+            LOG_ERR( "ClusterEndpoint cannot listen on " << m_endpoint << ": " << ec.message() << " (retrying)" );
+            m_acceptor.close( ec );
+
+            m_bindTimer.expires_after( RECONNECT_DELAY );
+            m_bindTimer.async_wait( [this] ( auto error )
+            {
+                if ( ! error )
+                {
+                    listen();
+                }
+            });
+            return;
+        }
+
+        asyncAccept();
+    }
+
+    void asyncAccept()
+    {
+        m_acceptor.async_accept( [this] ( auto error, boost::asio::ip::tcp::socket socket )
+        {
+            if ( error == boost::asio::error::operation_aborted )
+            {
+                return;
+            }
+
+            if ( error )
+            {
+                LOG_ERR( "ClusterEndpoint accept error: " << error.message() );
+            }
+            else
+            {
+                std::make_shared<Connection>( *this, std::move(socket) )->read();
+            }
+            asyncAccept();
+        });
+    }
+
+    void onFrame( Connection& connection, std::string_view frame )
+    {
+        if ( connection.m_nodeId != 0 )
+        {
+            m_handler.onNodeMessage( connection.m_nodeId, frame );
+            return;
+        }
+
+        uint32_t nodeId = 0;
+        if ( frame.substr( 0, NMT_NODE_HELLO.size() ) == NMT_NODE_HELLO && frame.size() > NMT_NODE_HELLO.size() )
+        {
+            auto id = frame.substr( NMT_NODE_HELLO.size() + 1 );
+            std::from_chars( id.data(), id.data()+id.size(), nodeId );
+        }
+        if ( nodeId == 0 || ! isPeerAddress( nodeId, connection ) )
+        {
+            LOG_ERR( "ClusterEndpoint bad hello: " << frame );
+            connection.close();
+            return;
+        }
+
+        // (the node has reconnected before its previous link was detected as lost)
+        if ( auto it = m_connections.find( nodeId ); it != m_connections.end() )
+        {
+            it->second->close();
+            m_handler.onNodeLost( nodeId );
+        }
+
+        LOG( "ClusterEndpoint node connected: " << nodeId );
+        connection.m_nodeId = nodeId;
+        m_connections[nodeId] = connection.shared_from_this();
+    }
+
+    bool isPeerAddress( uint32_t nodeId, const Connection& connection ) const
+    {
+        auto it = m_peerAddresses.find( nodeId );
+        if ( it == m_peerAddresses.end() )
+        {
+            return false;
+        }
+
+        boost::system::error_code ec;
+        auto address = connection.m_socket.remote_endpoint( ec ).address();
+        if ( address.is_v6() && address.to_v6().is_v4_mapped() )
+        {
+            address = boost::asio::ip::make_address_v4( boost::asio::ip::v4_mapped, address.to_v6() );
+        }
+        return ! ec && std::find( it->second.begin(), it->second.end(), address ) != it->second.end();
+    }
+
+    void onConnectionLost( Connection& connection )
+    {
+        auto it = m_connections.find( connection.m_nodeId );
+        if ( it == m_connections.end() || it->second.get() != &connection )
+        {
+            return;
+        }
+
+        LOG( "ClusterEndpoint node lost: " << connection.m_nodeId );
+        m_connections.erase( it );
+        m_handler.onNodeLost( connection.m_nodeId );
+    }
+};
+
+} // namespace cluster
@@ -7,8 +7,12 @@ namespace tic_tac {
 
 class DbgTicTacClient : public tic_tac::TicTacClient
 {
+    // delays are done by timer (not by sleep), so many clients can share one io thread
+    boost::asio::steady_timer m_stepTimer;
+
 public:
-    DbgTicTacClient( std::string palyerName ) : TicTacClient(palyerName) {}
+    DbgTicTacClient( std::string palyerName ) : TicTacClient(palyerName), m_stepTimer( executor() ) {}
+    DbgTicTacClient( boost::asio::io_context& context, std::string palyerName ) : TicTacClient(context,palyerName), m_stepTimer( executor() ) {}
     
 protected:
     void onPlayerListChanged() override
@@ -17,7 +21,7 @@ protected:
         {
             if ( playerName != m_playerName && isAvailable )
             {
-                std::thread([playerName=playerName,this] { sendInvitaion(playerName); } ).detach();
+                boost::asio::post( executor(), [playerName=playerName,this] { sendInvitaion(playerName); } );
                 return;
             }
         }
@@ -25,10 +29,8 @@ protected:
     
     void onInvitation( std::string partnerName ) override
     {
-        //sleep(1);
         sendInvitaionResponse( partnerName, true );
-        usleep(1000);
-        sendStep(partnerName, "X","1","1" );
+        sendStepAfter( std::chrono::milliseconds(1), partnerName, "X","1","1" );
     }
     
     void onAcceptedInvitation( std::string playName, bool isAccepted ) override
@@ -41,13 +43,25 @@ protected:
     
     void onPartnerStep( std::string partnerName, bool isX, int x, int y ) override
     {
-        sleep(2);
-        sendStep(partnerName, "X","0","0" );
+        sendStepAfter( std::chrono::seconds(2), partnerName, "X","0","0" );
     }
 
     void onRegistered() override
     {
     }
+
+private:
+    void sendStepAfter( std::chrono::steady_clock::duration delay, std::string partnerName, std::string x_0, std::string x, std::string y )
+    {
+        m_stepTimer.expires_after( delay );
+        m_stepTimer.async_wait( [this,partnerName,x_0,x,y] ( auto ec )
+        {
+            if ( ! ec )
+            {
+                sendStep( partnerName, x_0, x, y );
+            }
+        });
+    }
 };
 
 } // namespace tic_tac {
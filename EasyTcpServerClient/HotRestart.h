@@ -0,0 +1,309 @@
+#pragma once
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "Logs.h"
+
+// Hot restart - a new process takes over the listening socket and the live sessions of the running one
+// (see TcpServer::listenHotRestart(), TcpServer::restoreSessions())
+//
+//   1. the new process connects to the Unix socket of the running process ('Inheritance::receive()')
+//   2. the running process stops accepting, pauses all sessions (reading stopped, writes in flight completed
+//      or canceled), then sends records, each by one 'sendmsg' (SOCK_SEQPACKET), sockets by SCM_RIGHTS:
+//        hr_server   - listening socket + server state (TcpServer::saveServerState())
+//        hr_session  - connected socket (none for a detached session) + session state (SessionState)
+//        hr_end
+//   3. the new process answers hr_end, the running process exits
+//
+// Connections arriving meanwhile wait in the listen backlog, data - in the socket buffers:
+// clients see a short pause instead of a disconnection.
+//
+namespace hot_restart {
+
+enum RecordType : uint8_t
+{
+    hr_server,
+    hr_session,
+    hr_end,
+};
+
+constexpr size_t MAX_RECORD_SIZE = 1024*1024;
+
+// state of a handed over session
+struct SessionState
+{
+    int             m_socket = -1;      // -1 -> detached session (see TcpClientSession::detach())
+    std::string     m_inbound;          // received, not yet handled data
+    std::string     m_outbound;         // queued, not yet sent data
+    std::string     m_appState;         // see TcpClientSession::saveState()
+};
+
+// little endian fields
+class StateWriter
+{
+    std::string m_data;
+
+public:
+    void put( uint64_t value )
+    {
+        for( size_t i=0; i<8; i++ )
+        {
+            m_data += char( uint8_t( value >> (8*i) ) );
+        }
+    }
+
+    void put( std::string_view value )
+    {
+        put( uint64_t( value.size() ) );
+        m_data += value;
+    }
+
+    std::string& data() { return m_data; }
+};
+
+// missing fields are read as 0 or empty ('isOk()' is false then)
+class StateReader
+{
+    std::string_view m_data;
+    bool             m_isOk = true;
+
+public:
+    StateReader( std::string_view data ) : m_data( data ) {}
+
+    uint64_t getNumber()
+    {
+        if ( m_data.size() < 8 )
+        {
+            m_isOk = false;
+            return 0;
+        }
+
+        uint64_t value = 0;
+        for( size_t i=0; i<8; i++ )
+        {
+            value |= uint64_t( uint8_t( m_data[i] ) ) << (8*i);
+        }
+        m_data.remove_prefix( 8 );
+        return value;
+    }
+
+    std::string_view getString()
+    {
+        auto size = getNumber();
+        if ( size > m_data.size() )
+        {
+            m_isOk = false;
+            return {};
+        }
+
+        auto value = m_data.substr( 0, size );
+        m_data.remove_prefix( size );
+        return value;
+    }
+
+    bool isOk() const { return m_isOk; }
+};
+
+// one record by one 'sendmsg' (blocking socket); 'socket' >= 0 is passed by SCM_RIGHTS
+inline bool sendRecord( int channel, RecordType type, std::string_view payload, int socket = -1 )
+{
+    std::string data;
+    data.reserve( 1 + payload.size() );
+    data += char(type);
+    data += payload;
+
+    iovec iov{ data.data(), data.size() };
+    msghdr message{};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    if ( socket >= 0 )
+    {
+        message.msg_control = control;
+        message.msg_controllen = sizeof(control);
+        auto* header = CMSG_FIRSTHDR( &message );
+        header->cmsg_level = SOL_SOCKET;
+        header->cmsg_type = SCM_RIGHTS;
+        header->cmsg_len = CMSG_LEN(sizeof(int));
+        std::memcpy( CMSG_DATA(header), &socket, sizeof(int) );
+    }
+
+    while ( sendmsg( channel, &message, MSG_NOSIGNAL ) < 0 )
+    {
+        if ( errno != EINTR )
+        {
+            LOG_ERR( "hot restart: sendmsg error: " << strerror(errno) );
+            return false;
+        }
+    }
+    return true;
+}
+
+// 'outSocket' -1 -> the record has no socket
+inline bool receiveRecord( int channel, RecordType& outType, std::string& outPayload, int& outSocket )
+{
+    std::string data( MAX_RECORD_SIZE, '\0' );
+    iovec iov{ data.data(), data.size() };
+    msghdr message{};
+    message.msg_iov = &iov;
+    message.msg_iovlen = 1;
+
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    ssize_t size;
+    while ( ( size = recvmsg( channel, &message, MSG_CMSG_CLOEXEC ) ) < 0 )
+    {
+        if ( errno != EINTR )
+        {
+            LOG_ERR( "hot restart: recvmsg error: " << strerror(errno) );
+            return false;
+        }
+    }
+    if ( size == 0 || ( message.msg_flags & MSG_TRUNC ) )
+    {
+        LOG_ERR( "hot restart: connection lost or too long record" );
+        return false;
+    }
+
+    outSocket = -1;
+    if ( auto* header = CMSG_FIRSTHDR( &message ); header != nullptr && header->cmsg_type == SCM_RIGHTS )
+    {
+        std::memcpy( &outSocket, CMSG_DATA(header), sizeof(int) );
+    }
+
+    outType = RecordType( data[0] );
+    outPayload.assign( data.data()+1, size_t(size)-1 );
+    return true;
+}
+
+inline std::string serialize( const SessionState& state )
+{
+    StateWriter writer;
+    writer.put( state.m_inbound );
+    writer.put( state.m_outbound );
+    writer.put( state.m_appState );
+    return std::move( writer.data() );
+}
+
+inline bool deserialize( std::string_view data, SessionState& outState )
+{
+    StateReader reader( data );
+    outState.m_inbound  = reader.getString();
+    outState.m_outbound = reader.getString();
+    outState.m_appState = reader.getString();
+    return reader.isOk();
+}
+
+// Inheritance - everything received from the previous process
+//
+class Inheritance
+{
+    int                         m_listenSocket = -1;
+    std::string                 m_serverState;
+    std::vector<SessionState>   m_sessions;
+
+public:
+    Inheritance() = default;
+    Inheritance( const Inheritance& ) = delete;
+    Inheritance& operator=( const Inheritance& ) = delete;
+
+    // not restored sockets are closed
+    ~Inheritance()
+    {
+        if ( m_listenSocket >= 0 )
+        {
+            ::close( m_listenSocket );
+        }
+        for( auto& session : m_sessions )
+        {
+            if ( session.m_socket >= 0 )
+            {
+                ::close( session.m_socket );
+            }
+        }
+    }
+
+    // takes over from the process listening on 'path'; false -> no running process (or the handover failed)
+    bool receive( const std::string& path )
+    {
+        int channel = socket( AF_UNIX, SOCK_SEQPACKET|SOCK_CLOEXEC, 0 );
+        if ( channel < 0 )
+        {
+            return false;
+        }
+
+        sockaddr_un address{};
+        address.sun_family = AF_UNIX;
+        std::strncpy( address.sun_path, path.c_str(), sizeof(address.sun_path)-1 );
+        if ( connect( channel, reinterpret_cast<sockaddr*>(&address), sizeof(address) ) < 0 )
+        {
+            ::close( channel );
+            return false;
+        }
+
+        LOG( "hot restart: taking over from " << path );
+
+        bool isOk = false;
+        RecordType type;
+        std::string payload;
+        int socket;
+        while ( receiveRecord( channel, type, payload, socket ) )
+        {
+            if ( type == hr_end )
+            {
+                isOk = m_listenSocket >= 0;
+                sendRecord( channel, hr_end, {} );
+                break;
+            }
+
+            if ( type == hr_server )
+            {
+                m_listenSocket = socket;
+                m_serverState = std::move(payload);
+                continue;
+            }
+
+            SessionState state;
+            state.m_socket = socket;
+            if ( type != hr_session || ! deserialize( payload, state ) )
+            {
+                LOG_ERR( "hot restart: bad record" );
+                if ( socket >= 0 )
+                {
+                    ::close( socket );
+                }
+                continue;
+            }
+            m_sessions.push_back( std::move(state) );
+        }
+        ::close( channel );
+
+        LOG( "hot restart: received sessions: " << m_sessions.size() );
+        return isOk;
+    }
+
+    // -1 -> no listening socket (the server binds its own)
+    int takeListenSocket() { return std::exchange( m_listenSocket, -1 ); }
+
+    const std::string& serverState() const { return m_serverState; }
+
+    size_t sessionNumber() const { return m_sessions.size(); }
+
+    // sockets are owned by the caller after the call
+    std::vector<SessionState> takeSessions() { return std::move( m_sessions ); }
+};
+
+} // namespace hot_restart
@@ -0,0 +1,420 @@
+#pragma once
+
+#include <boost/asio.hpp>
+#include <boost/asio/posix/stream_descriptor.hpp>
+
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <system_error>
+
+#include "Logs.h"
+
+// IoUring - io_uring instance of one io thread (TcpServer backend, see TCP_SERVER_IO_URING)
+//
+// The ring lives inside the thread's asio io_context:
+//   - submission entries prepared by handlers are submitted by one 'io_uring_enter' per loop iteration
+//     (the first prepared entry posts 'submit()' to the context)
+//   - completions are signalled by eventfd, which is waited for by asio; all ready completions are reaped at once
+//
+// Receives use a ring of provided buffers: idle connections do not hold receive buffers,
+// a buffer is taken by the kernel only when data arrives and is returned right after it is copied.
+//
+// Raw system calls are used (no liburing); requires Linux 6.0+ (multishot receive, buffer rings).
+// Not thread safe: all calls must be done on the thread of the io_context.
+//
+
+class IoUringOperation
+{
+    friend class IoUring;
+
+    // in-flight operations are linked into the ring's list (see IoUring::~IoUring())
+    IoUringOperation*   m_prev = nullptr;
+    IoUringOperation*   m_next = nullptr;
+    unsigned            m_pendingCompletionNumber = 0;
+
+public:
+    // 'flags' - IORING_CQE_F_* (IORING_CQE_F_MORE: multishot operation continues)
+    virtual void onCompletion( int result, uint32_t flags ) = 0;
+
+    // the ring is destroyed while the operation is in flight
+    virtual void onAbandoned() {}
+
+    bool isInFlight() const { return m_pendingCompletionNumber > 0; }
+
+protected:
+    ~IoUringOperation() = default;
+};
+
+class IoUring
+{
+    boost::asio::io_context&                m_context;
+    int                                     m_ringFd = -1;
+
+    void*                                   m_ringPtr = MAP_FAILED;
+    size_t                                  m_ringSize = 0;
+    io_uring_sqe*                           m_sqes = static_cast<io_uring_sqe*>(MAP_FAILED);
+    size_t                                  m_sqesSize = 0;
+
+    unsigned*                               m_sqHead;
+    unsigned*                               m_sqTail;
+    unsigned*                               m_sqArray;
+    unsigned*                               m_sqFlags;
+    unsigned                                m_sqMask;
+    unsigned                                m_sqEntries;
+    unsigned                                m_sqLocalTail = 0;  // prepared, not yet published entries
+
+    unsigned*                               m_cqHead;
+    unsigned*                               m_cqTail;
+    unsigned                                m_cqMask;
+    io_uring_cqe*                           m_cqes;
+
+    boost::asio::posix::stream_descriptor   m_eventFd;
+    uint64_t                                m_eventValue = 0;
+    bool                                    m_isSubmitPosted = false;
+
+    // provided buffers (buffer group 0)
+    io_uring_buf_ring*                      m_bufferRing = static_cast<io_uring_buf_ring*>(MAP_FAILED);
+    size_t                                  m_bufferRingSize = 0;
+    char*                                   m_bufferMemory = static_cast<char*>(MAP_FAILED);
+    unsigned                                m_bufferNumber;
+    unsigned                                m_bufferSize;
+    uint16_t                                m_bufferTail = 0;
+
+    IoUringOperation*                       m_inFlightOperations = nullptr;
+
+    // completion target of cancel requests
+    struct CancelOperation : IoUringOperation
+    {
+        void onCompletion( int result, uint32_t flags ) override {}
+    };
+    CancelOperation                         m_cancelOperation;
+
+public:
+    static constexpr uint16_t BUFFER_GROUP = 0;
+    static constexpr size_t   MAX_LINKED_SEND_NUMBER = 64;
+
+    // 'bufferNumber' must be a power of 2 (0 -> no provided buffers)
+    IoUring( boost::asio::io_context& context, unsigned entries = 1024, unsigned bufferNumber = 1024, unsigned bufferSize = 2048 )
+      : m_context( context ),
+        m_eventFd( context ),
+        m_bufferNumber( bufferNumber ),
+        m_bufferSize( bufferSize )
+    {
+        io_uring_params params{};
+        m_ringFd = int( syscall( __NR_io_uring_setup, entries, &params ) );
+        if ( m_ringFd < 0 )
+        {
+            throwError( "io_uring_setup" );
+        }
+        if ( ! ( params.features & IORING_FEAT_SINGLE_MMAP ) )
+        {
+            throw std::runtime_error( "io_uring: IORING_FEAT_SINGLE_MMAP is not supported" );
+        }
+
+        m_ringSize = std::max( params.sq_off.array + params.sq_entries * sizeof(unsigned),
+                               params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe) );
+        m_ringPtr = mmap( nullptr, m_ringSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, m_ringFd, IORING_OFF_SQ_RING );
+        m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        m_sqes = static_cast<io_uring_sqe*>( mmap( nullptr, m_sqesSize, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_POPULATE, m_ringFd, IORING_OFF_SQES ) );
+        if ( m_ringPtr == MAP_FAILED || m_sqes == MAP_FAILED )
+        {
+            throwError( "io_uring mmap" );
+        }
+
+        auto* ring = static_cast<char*>( m_ringPtr );
+        m_sqHead    = reinterpret_cast<unsigned*>( ring + params.sq_off.head );
+        m_sqTail    = reinterpret_cast<unsigned*>( ring + params.sq_off.tail );
+        m_sqArray   = reinterpret_cast<unsigned*>( ring + params.sq_off.array );
+        m_sqFlags   = reinterpret_cast<unsigned*>( ring + params.sq_off.flags );
+        m_sqMask    = *reinterpret_cast<unsigned*>( ring + params.sq_off.ring_mask );
+        m_sqEntries = params.sq_entries;
+        m_sqLocalTail = *m_sqTail;
+
+        m_cqHead    = reinterpret_cast<unsigned*>( ring + params.cq_off.head );
+        m_cqTail    = reinterpret_cast<unsigned*>( ring + params.cq_off.tail );
+        m_cqMask    = *reinterpret_cast<unsigned*>( ring + params.cq_off.ring_mask );
+        m_cqes      = reinterpret_cast<io_uring_cqe*>( ring + params.cq_off.cqes );
+
+        // completion notification
+        int eventFd = eventfd( 0, EFD_NONBLOCK|EFD_CLOEXEC );
+        if ( eventFd < 0 || syscall( __NR_io_uring_register, m_ringFd, IORING_REGISTER_EVENTFD, &eventFd, 1 ) < 0 )
+        {
+            throwError( "io_uring eventfd" );
+        }
+        m_eventFd.assign( eventFd );
+
+        if ( m_bufferNumber > 0 )
+        {
+            registerBuffers();
+        }
+        waitCompletions();
+    }
+
+    IoUring( const IoUring& ) = delete;
+    IoUring& operator=( const IoUring& ) = delete;
+
+    ~IoUring()
+    {
+        // closing the ring cancels all requests: owners of in-flight operations are released
+        while ( m_inFlightOperations != nullptr )
+        {
+            auto* operation = m_inFlightOperations;
+            unlink( operation );
+            operation->onAbandoned();
+        }
+
+        if ( m_ringFd >= 0 )
+        {
+            close( m_ringFd );
+        }
+        if ( m_bufferMemory != MAP_FAILED ) munmap( m_bufferMemory, size_t(m_bufferNumber) * m_bufferSize );
+        if ( m_bufferRing != MAP_FAILED )   munmap( m_bufferRing, m_bufferRingSize );
+        if ( m_sqes != MAP_FAILED )         munmap( m_sqes, m_sqesSize );
+        if ( m_ringPtr != MAP_FAILED )      munmap( m_ringPtr, m_ringSize );
+    }
+
+    // multishot accept: 'operation' completes with a new socket for every connection
+    void acceptMultishot( int listenSocket, IoUringOperation& operation )
+    {
+        auto* sqe = prepare( IORING_OP_ACCEPT, listenSocket, operation );
+        sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+        sqe->accept_flags = SOCK_CLOEXEC;
+    }
+
+    // multishot receive into provided buffers: data of the completion is 'bufferData(flags)',
+    // the buffer must be returned by 'releaseBuffer(flags)'
+    void receiveMultishot( int socket, IoUringOperation& operation )
+    {
+        auto* sqe = prepare( IORING_OP_RECV, socket, operation );
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = BUFFER_GROUP;
+    }
+
+    // sends 'buffers' by a chain of linked sends (executed in order, one completion per buffer;
+    // after a failed or short send the rest of the chain completes with -ECANCELED)
+    template<class ConstBufferIteratorT>
+    void sendLinked( int socket, ConstBufferIteratorT begin, ConstBufferIteratorT end, IoUringOperation& operation )
+    {
+        // the chain must not be split by 'submit()'
+        if ( m_sqEntries - ( m_sqLocalTail - __atomic_load_n( m_sqHead, __ATOMIC_ACQUIRE ) ) < unsigned( end - begin ) )
+        {
+            submit();
+        }
+
+        for( auto it = begin; it != end; ++it )
+        {
+            auto* sqe = prepare( IORING_OP_SEND, socket, operation );
+            sqe->addr = reinterpret_cast<uint64_t>( it->data() );
+            sqe->len = unsigned( it->size() );
+            sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+            if ( std::next(it) != end )
+            {
+                // MSG_MORE: the chain leaves as one segment stream (no Nagle delay between its small sends)
+                sqe->flags = IOSQE_IO_LINK;
+                sqe->msg_flags |= MSG_MORE;
+            }
+        }
+    }
+
+    // cancels the requests of 'operation' (they complete with -ECANCELED)
+    void cancel( IoUringOperation& operation )
+    {
+        auto* sqe = prepare( IORING_OP_ASYNC_CANCEL, -1, m_cancelOperation );
+        sqe->addr = reinterpret_cast<uint64_t>( &operation );
+        sqe->cancel_flags = IORING_ASYNC_CANCEL_ALL;
+    }
+
+    const char* bufferData( uint32_t flags ) const
+    {
+        return m_bufferMemory + size_t( flags >> IORING_CQE_BUFFER_SHIFT ) * m_bufferSize;
+    }
+
+    void releaseBuffer( uint32_t flags )
+    {
+        provideBuffer( uint16_t( flags >> IORING_CQE_BUFFER_SHIFT ) );
+        __atomic_store_n( &m_bufferRing->tail, m_bufferTail, __ATOMIC_RELEASE );
+    }
+
+    // publishes prepared entries and enters the kernel once
+    void submit()
+    {
+        unsigned tail = *m_sqTail;
+        unsigned toSubmit = m_sqLocalTail - tail;
+        if ( toSubmit == 0 )
+        {
+            return;
+        }
+        __atomic_store_n( m_sqTail, m_sqLocalTail, __ATOMIC_RELEASE );
+
+        while ( toSubmit > 0 )
+        {
+            int submitted = int( syscall( __NR_io_uring_enter, m_ringFd, toSubmit, 0, 0, nullptr, 0 ) );
+            if ( submitted < 0 )
+            {
+                if ( errno == EINTR )
+                {
+                    continue;
+                }
+                if ( errno == EAGAIN || errno == EBUSY )
+                {
+                    // completion queue is full: make room and retry
+                    reapCompletions();
+                    continue;
+                }
+                LOG_ERR( "io_uring_enter error: " << strerror(errno) );
+                return;
+            }
+            toSubmit -= unsigned(submitted);
+        }
+    }
+
+private:
+    [[noreturn]] static void throwError( const char* what )
+    {
+        throw std::system_error( errno, std::generic_category(), what );
+    }
+
+    io_uring_sqe* prepare( uint8_t opcode, int fd, IoUringOperation& operation )
+    {
+        if ( m_sqLocalTail - __atomic_load_n( m_sqHead, __ATOMIC_ACQUIRE ) == m_sqEntries )
+        {
+            submit();
+        }
+
+        auto index = m_sqLocalTail & m_sqMask;
+        auto* sqe = &m_sqes[index];
+        std::memset( sqe, 0, sizeof(*sqe) );
+        sqe->opcode = opcode;
+        sqe->fd = fd;
+        sqe->user_data = reinterpret_cast<uint64_t>( &operation );
+        m_sqArray[index] = index;
+        m_sqLocalTail++;
+
+        if ( operation.m_pendingCompletionNumber++ == 0 )
+        {
+            link( &operation );
+        }
+
+        if ( ! m_isSubmitPosted )
+        {
+            m_isSubmitPosted = true;
+            boost::asio::post( m_context, [this]
+            {
+                m_isSubmitPosted = false;
+                submit();
+            });
+        }
+        return sqe;
+    }
+
+    void waitCompletions()
+    {
+        // 'async_read_some' (not 'async_wait'): the read is tried before waiting,
+        // so a signal between 'reapCompletions()' and this call is not lost
+        m_eventFd.async_read_some( boost::asio::buffer( &m_eventValue, sizeof(m_eventValue) ), [this] ( auto error, size_t )
+        {
+            if ( error )
+            {
+                return;
+            }
+
+            reapCompletions();
+            waitCompletions();
+        });
+    }
+
+    void reapCompletions()
+    {
+        unsigned head = *m_cqHead;
+        for(;;)
+        {
+            unsigned tail = __atomic_load_n( m_cqTail, __ATOMIC_ACQUIRE );
+            if ( head == tail )
+            {
+                // completions that did not fit into the full completion queue are kept by the kernel
+                // until the next 'io_uring_enter'
+                if ( ! ( __atomic_load_n( m_sqFlags, __ATOMIC_ACQUIRE ) & IORING_SQ_CQ_OVERFLOW ) )
+                {
+                    break;
+                }
+                syscall( __NR_io_uring_enter, m_ringFd, 0, 0, IORING_ENTER_GETEVENTS, nullptr, 0 );
+                continue;
+            }
+
+            auto cqe = m_cqes[ head & m_cqMask ];
+            __atomic_store_n( m_cqHead, ++head, __ATOMIC_RELEASE );
+
+            auto* operation = reinterpret_cast<IoUringOperation*>( cqe.user_data );
+            if ( ! ( cqe.flags & IORING_CQE_F_MORE ) && --operation->m_pendingCompletionNumber == 0 )
+            {
+                unlink( operation );
+            }
+            operation->onCompletion( cqe.res, cqe.flags );
+        }
+    }
+
+    void registerBuffers()
+    {
+        m_bufferRingSize = m_bufferNumber * sizeof(io_uring_buf);
+        m_bufferRing = static_cast<io_uring_buf_ring*>( mmap( nullptr, m_bufferRingSize, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0 ) );
+        m_bufferMemory = static_cast<char*>( mmap( nullptr, size_t(m_bufferNumber) * m_bufferSize, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0 ) );
+        if ( m_bufferRing == MAP_FAILED || m_bufferMemory == MAP_FAILED )
+        {
+            throwError( "io_uring buffers mmap" );
+        }
+
+        io_uring_buf_reg reg{};
+        reg.ring_addr = reinterpret_cast<uint64_t>( m_bufferRing );
+        reg.ring_entries = m_bufferNumber;
+        reg.bgid = BUFFER_GROUP;
+        if ( syscall( __NR_io_uring_register, m_ringFd, IORING_REGISTER_PBUF_RING, &reg, 1 ) < 0 )
+        {
+            throwError( "io_uring IORING_REGISTER_PBUF_RING (Linux 5.19+)" );
+        }
+
+        for( unsigned i=0; i<m_bufferNumber; i++ )
+        {
+            provideBuffer( uint16_t(i) );
+        }
+        __atomic_store_n( &m_bufferRing->tail, m_bufferTail, __ATOMIC_RELEASE );
+    }
+
+    void provideBuffer( uint16_t bufferId )
+    {
+        // not 'm_bufferRing->bufs': in C++ '__DECLARE_FLEX_ARRAY' shifts it by an empty struct
+        auto* buffers = reinterpret_cast<io_uring_buf*>( m_bufferRing );
+        auto& buffer = buffers[ m_bufferTail & (m_bufferNumber-1) ];
+        buffer.addr = reinterpret_cast<uint64_t>( m_bufferMemory + size_t(bufferId) * m_bufferSize );
+        buffer.len = m_bufferSize;
+        buffer.bid = bufferId;
+        m_bufferTail++;
+    }
+
+    void link( IoUringOperation* operation )
+    {
+        operation->m_prev = nullptr;
+        operation->m_next = m_inFlightOperations;
+        if ( m_inFlightOperations != nullptr )
+        {
+            m_inFlightOperations->m_prev = operation;
+        }
+        m_inFlightOperations = operation;
+    }
+
+    void unlink( IoUringOperation* operation )
+    {
+        if ( operation->m_prev != nullptr ) operation->m_prev->m_next = operation->m_next;
+        else                                 m_inFlightOperations = operation->m_next;
+        if ( operation->m_next != nullptr ) operation->m_next->m_prev = operation->m_prev;
+        operation->m_prev = operation->m_next = nullptr;
+        operation->m_pendingCompletionNumber = 0;
+    }
+};
@@ -0,0 +1,423 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "Logs.h"
+
+// Leaderboard - wins, losses, draws and Elo rating per player name, kept in a memory-mapped file
+//
+// File: LeaderboardHeader (LEADERBOARD_HEADER_SIZE bytes), then 'capacity' fixed records (64 bytes).
+// The records are an open-addressing hash table (linear probing by name hash; no deletions),
+// so lookups and updates are plain memory accesses (no syscalls, no serialization).
+//
+// Crash safety: a game result changes 2 records; their new images are written into the header journal
+// first, the journal is marked valid, then the records are overwritten and the journal is cleared.
+// A journal that is still valid on open is applied again (the images are complete, so it is idempotent).
+// Written pages are flushed by the kernel (or by 'flush()'); a killed process loses nothing.
+//
+// Top-K: a min-heap of the K best records is maintained on every update, the other records are
+// ordered by rating, so a top record that loses rating is replaced by the best other one (no scan).
+//
+namespace tic_tac {
+
+constexpr char     LEADERBOARD_MAGIC[8]        = { 'T','T','L','B','0','0','0','1' };
+constexpr size_t   LEADERBOARD_HEADER_SIZE     = 256;
+constexpr size_t   LEADERBOARD_NAME_SIZE       = 32;    // with terminating 0
+constexpr int32_t  LEADERBOARD_INITIAL_RATING  = 1500;
+constexpr int32_t  LEADERBOARD_K_FACTOR        = 32;
+
+struct LeaderboardRecord
+{
+    char        m_name[LEADERBOARD_NAME_SIZE];  // "" -> free slot
+    int32_t     m_rating;
+    uint32_t    m_wins;
+    uint32_t    m_losses;
+    uint32_t    m_draws;
+    uint8_t     m_reserved[16];
+};
+
+static_assert( sizeof(LeaderboardRecord) == 64 );
+
+struct LeaderboardJournal
+{
+    uint32_t            m_isValid;
+    uint32_t            m_recordNumber;
+    uint32_t            m_indices[2];
+    LeaderboardRecord   m_records[2];
+};
+
+struct LeaderboardHeader
+{
+    char                m_magic[8];
+    uint32_t            m_recordSize;
+    uint32_t            m_capacity;     // power of 2
+    uint32_t            m_size;         // used records
+    uint32_t            m_reserved;
+    LeaderboardJournal  m_journal;
+};
+
+static_assert( sizeof(LeaderboardHeader) <= LEADERBOARD_HEADER_SIZE );
+
+class Leaderboard
+{
+public:
+    struct Entry
+    {
+        std::string m_name;
+        int32_t     m_rating;
+        uint32_t    m_wins;
+        uint32_t    m_losses;
+        uint32_t    m_draws;
+    };
+
+private:
+    static constexpr uint32_t NO_INDEX = UINT32_MAX;
+
+    mutable std::mutex      m_mutex;
+
+    int                     m_fd = -1;
+    void*                   m_data = MAP_FAILED;
+    size_t                  m_fileSize = 0;
+    LeaderboardHeader*      m_header = nullptr;
+    LeaderboardRecord*      m_records = nullptr;
+
+    const size_t            m_topNumber;
+    std::vector<uint32_t>   m_top;      // min-heap of record indices by rating
+    std::set<std::pair<int32_t,uint32_t>>   m_others;   // (rating, index) of the records outside of 'm_top'
+
+public:
+    // 'capacity' (power of 2) is used only for a new file
+    Leaderboard( const std::string& path, uint32_t capacity = 64*1024, size_t topNumber = 10 ) : m_topNumber( topNumber )
+    {
+        m_fd = open( path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644 );
+        struct stat fileStat;
+        if ( m_fd < 0 || fstat( m_fd, &fileStat ) != 0 )
+        {
+            LOG_ERR( "Leaderboard: cannot open: " << path << ": " << strerror(errno) );
+            return;
+        }
+
+        bool isNew = ( fileStat.st_size == 0 );
+        if ( isNew )
+        {
+            m_fileSize = LEADERBOARD_HEADER_SIZE + size_t(capacity) * sizeof(LeaderboardRecord);
+            if ( ftruncate( m_fd, off_t(m_fileSize) ) != 0 )
+            {
+                LOG_ERR( "Leaderboard: cannot resize: " << path << ": " << strerror(errno) );
+                return;
+            }
+        }
+        else
+        {
+            m_fileSize = size_t(fileStat.st_size);
+        }
+
+        m_data = mmap( nullptr, m_fileSize, PROT_READ|PROT_WRITE, MAP_SHARED, m_fd, 0 );
+        if ( m_data == MAP_FAILED )
+        {
+            LOG_ERR( "Leaderboard: cannot map: " << path << ": " << strerror(errno) );
+            return;
+        }
+        m_header = static_cast<LeaderboardHeader*>( m_data );
+        m_records = reinterpret_cast<LeaderboardRecord*>( static_cast<char*>(m_data) + LEADERBOARD_HEADER_SIZE );
+
+        if ( isNew )
+        {
+            std::memcpy( m_header->m_magic, LEADERBOARD_MAGIC, sizeof(LEADERBOARD_MAGIC) );
+            m_header->m_recordSize = sizeof(LeaderboardRecord);
+            m_header->m_capacity = capacity;
+        }
+        else if ( std::memcmp( m_header->m_magic, LEADERBOARD_MAGIC, sizeof(LEADERBOARD_MAGIC) ) != 0
+                  || m_header->m_recordSize != sizeof(LeaderboardRecord)
+                  || m_header->m_capacity == 0 || ( m_header->m_capacity & (m_header->m_capacity-1) ) != 0
+                  || m_fileSize != LEADERBOARD_HEADER_SIZE + size_t(m_header->m_capacity) * sizeof(LeaderboardRecord) )
+        {
+            LOG_ERR( "Leaderboard: bad file format: " << path );
+            munmap( m_data, m_fileSize );
+            m_data = MAP_FAILED;
+            return;
+        }
+
+        if ( m_header->m_journal.m_isValid )
+        {
+            LOG( "Leaderboard: interrupted update is recovered" );
+            applyJournal();
+        }
+
+        // (also recounts 'm_size': a crash between a record and the counter leaves it behind)
+        rebuildTop();
+    }
+
+    Leaderboard( const Leaderboard& ) = delete;
+    Leaderboard& operator=( const Leaderboard& ) = delete;
+
+    ~Leaderboard()
+    {
+        if ( m_data != MAP_FAILED )
+        {
+            flush();
+            munmap( m_data, m_fileSize );
+        }
+        if ( m_fd >= 0 )
+        {
+            close( m_fd );
+        }
+    }
+
+    bool isOpen() const { return m_data != MAP_FAILED; }
+
+    // 'winnerIndex': 0 or 1; -1 -> draw
+    void addGameResult( std::string_view playerName0, std::string_view playerName1, int winnerIndex )
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        uint32_t indices[2];
+        indices[0] = findSlot( playerName0, NO_INDEX );
+        indices[1] = findSlot( playerName1, indices[0] );
+        if ( indices[0] == NO_INDEX || indices[1] == NO_INDEX || indices[0] == indices[1] )
+        {
+            LOG_ERR( "Leaderboard: result is not recorded (name too long or table full): " << playerName0 << " " << playerName1 );
+            return;
+        }
+
+        auto& journal = m_header->m_journal;
+        std::string_view names[2] = { playerName0, playerName1 };
+        for( int i=0; i<2; i++ )
+        {
+            auto& record = journal.m_records[i];
+            record = m_records[indices[i]];
+            if ( record.m_name[0] == 0 )
+            {
+                record = LeaderboardRecord{};
+                std::memcpy( record.m_name, names[i].data(), names[i].size() );
+                record.m_rating = LEADERBOARD_INITIAL_RATING;
+            }
+            journal.m_indices[i] = indices[i];
+        }
+        journal.m_recordNumber = 2;
+
+        // Elo
+        auto& record0 = journal.m_records[0];
+        auto& record1 = journal.m_records[1];
+        double score0 = ( winnerIndex == 0 ) ? 1.0 : ( winnerIndex == 1 ) ? 0.0 : 0.5;
+        double expected0 = 1.0 / ( 1.0 + std::pow( 10.0, ( record1.m_rating - record0.m_rating ) / 400.0 ) );
+        auto delta = int32_t( std::lround( LEADERBOARD_K_FACTOR * ( score0 - expected0 ) ) );
+        record0.m_rating += delta;
+        record1.m_rating -= delta;
+
+        switch ( winnerIndex )
+        {
+            case 0:  record0.m_wins++;   record1.m_losses++; break;
+            case 1:  record0.m_losses++; record1.m_wins++;   break;
+            default: record0.m_draws++;  record1.m_draws++;  break;
+        }
+
+        int32_t oldRatings[2] = { m_records[indices[0]].m_rating, m_records[indices[1]].m_rating };
+
+        __atomic_store_n( &journal.m_isValid, 1u, __ATOMIC_RELEASE );
+        applyJournal();
+
+        // (both are taken out first: the other one is ordered by its old rating meanwhile)
+        for( int i=0; i<2; i++ )
+        {
+            removeFromTop( indices[i], oldRatings[i] );
+        }
+        for( int i=0; i<2; i++ )
+        {
+            insertIntoTop( indices[i] );
+        }
+    }
+
+    bool find( std::string_view playerName, Entry& outEntry ) const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto index = findSlot( playerName, NO_INDEX );
+        if ( index == NO_INDEX || m_records[index].m_name[0] == 0 )
+        {
+            return false;
+        }
+        outEntry = entry( index );
+        return true;
+    }
+
+    // K best players (the best first)
+    std::vector<Entry> top() const
+    {
+        std::vector<Entry> entries;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            for( auto index : m_top )
+            {
+                entries.push_back( entry( index ) );
+            }
+        }
+        std::sort( entries.begin(), entries.end(), [] ( const auto& a, const auto& b ) { return a.m_rating > b.m_rating; } );
+        return entries;
+    }
+
+    size_t size() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return isOpen() ? m_header->m_size : 0;
+    }
+
+    // writes the dirty pages to the disk (survives a power loss)
+    void flush()
+    {
+        if ( m_data != MAP_FAILED )
+        {
+            msync( m_data, m_fileSize, MS_SYNC );
+        }
+    }
+
+private:
+    static uint32_t nameHash( std::string_view name )
+    {
+        // FNV-1a
+        uint32_t hash = 2166136261u;
+        for( char c : name )
+        {
+            hash = (hash ^ uint8_t(c)) * 16777619u;
+        }
+        return hash;
+    }
+
+    // index of the player's record or of the free slot for it ('reservedIndex' is treated as used);
+    // NO_INDEX if the name is too long or the table is full (load factor above 3/4)
+    uint32_t findSlot( std::string_view name, uint32_t reservedIndex ) const
+    {
+        if ( ! isOpen() || name.empty() || name.size() >= LEADERBOARD_NAME_SIZE )
+        {
+            return NO_INDEX;
+        }
+
+        // (a reserved free slot is counted as used)
+        auto size = m_header->m_size;
+        if ( reservedIndex != NO_INDEX && m_records[reservedIndex].m_name[0] == 0 )
+        {
+            size++;
+        }
+
+        auto mask = m_header->m_capacity - 1;
+        auto index = nameHash( name ) & mask;
+        for( uint32_t probe = 0; probe < m_header->m_capacity; probe++, index = (index+1) & mask )
+        {
+            const auto& record = m_records[index];
+            if ( record.m_name[0] == 0 && index != reservedIndex )
+            {
+                return ( size < m_header->m_capacity / 4 * 3 ) ? index : NO_INDEX;
+            }
+            if ( name == record.m_name )
+            {
+                return index;
+            }
+        }
+        return NO_INDEX;
+    }
+
+    void applyJournal()
+    {
+        auto& journal = m_header->m_journal;
+        for( uint32_t i=0; i<journal.m_recordNumber && i<2; i++ )
+        {
+            // (the record first: a replay after a crash in between does not count it twice)
+            auto& record = m_records[ journal.m_indices[i] ];
+            bool isNew = ( record.m_name[0] == 0 );
+            record = journal.m_records[i];
+            if ( isNew )
+            {
+                m_header->m_size++;
+            }
+        }
+        __atomic_store_n( &journal.m_isValid, 0u, __ATOMIC_RELEASE );
+    }
+
+    Entry entry( uint32_t index ) const
+    {
+        const auto& record = m_records[index];
+        return Entry{ record.m_name, record.m_rating, record.m_wins, record.m_losses, record.m_draws };
+    }
+
+    bool isRatingGreater( uint32_t index0, uint32_t index1 ) const
+    {
+        return m_records[index0].m_rating > m_records[index1].m_rating;
+    }
+
+    // the record goes into the heap if it is better than the worst one there (which is moved to 'm_others')
+    void insertIntoTop( uint32_t index )
+    {
+        auto greater = [this] ( uint32_t a, uint32_t b ) { return isRatingGreater( a, b ); };
+        if ( m_top.size() < m_topNumber )
+        {
+            m_top.push_back( index );
+            std::push_heap( m_top.begin(), m_top.end(), greater );
+        }
+        else if ( m_topNumber > 0 && isRatingGreater( index, m_top.front() ) )
+        {
+            std::pop_heap( m_top.begin(), m_top.end(), greater );
+            m_others.emplace( m_records[m_top.back()].m_rating, m_top.back() );
+            m_top.back() = index;
+            std::push_heap( m_top.begin(), m_top.end(), greater );
+        }
+        else
+        {
+            m_others.emplace( m_records[index].m_rating, index );
+        }
+    }
+
+    // 'oldRating' - rating of the record when it was inserted; a heap record is replaced by the best other one
+    void removeFromTop( uint32_t index, int32_t oldRating )
+    {
+        auto it = std::find( m_top.begin(), m_top.end(), index );
+        if ( it == m_top.end() )
+        {
+            m_others.erase( { oldRating, index } );
+            return;
+        }
+
+        auto greater = [this] ( uint32_t a, uint32_t b ) { return isRatingGreater( a, b ); };
+        *it = m_top.back();
+        m_top.pop_back();
+        std::make_heap( m_top.begin(), m_top.end(), greater );
+
+        if ( ! m_others.empty() )
+        {
+            auto best = std::prev( m_others.end() );
+            m_top.push_back( best->second );
+            std::push_heap( m_top.begin(), m_top.end(), greater );
+            m_others.erase( best );
+        }
+    }
+
+    void rebuildTop()
+    {
+        m_top.clear();
+        m_others.clear();
+        uint32_t size = 0;
+        for( uint32_t i=0; i<m_header->m_capacity; i++ )
+        {
+            if ( m_records[i].m_name[0] != 0 )
+            {
+                insertIntoTop( i );
+                size++;
+            }
+        }
+        m_header->m_size = size;
+    }
+};
+
+} // namespace tic_tac
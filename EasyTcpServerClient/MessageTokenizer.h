@@ -0,0 +1,65 @@
+#pragma once
+
+#include <array>
+#include <string_view>
+
+// nextToken - cuts the first token from 'text'
+// returns false when 'text' is exhausted
+//
+inline bool nextToken( std::string_view& text, std::string_view& outToken, char delimiter = ',' )
+{
+    if ( text.data() == nullptr )
+    {
+        return false;
+    }
+
+    auto pos = text.find( delimiter );
+    if ( pos == std::string_view::npos )
+    {
+        outToken = text;
+        text = std::string_view{};
+    }
+    else
+    {
+        outToken = text.substr( 0, pos );
+        text = text.substr( pos+1 );
+    }
+    return true;
+}
+
+// MessageTokens - splits message into fixed-capacity array of views (no heap allocations)
+//
+// size() is the number of all tokens in the message,
+// only the first 'MaxTokenNumber' of them are accessible by operator[];
+// the rest of the message can be taken by 'tail()'
+//
+template<size_t MaxTokenNumber>
+class MessageTokens
+{
+    std::array<std::string_view,MaxTokenNumber> m_tokens;
+    size_t                                      m_size = 0;
+    std::string_view                            m_tail;
+
+public:
+    MessageTokens( std::string_view message, char delimiter = ',' )
+    {
+        std::string_view token;
+        while ( m_size < MaxTokenNumber && nextToken( message, token, delimiter ) )
+        {
+            m_tokens[m_size++] = token;
+        }
+
+        m_tail = message;
+        while ( nextToken( message, token, delimiter ) )
+        {
+            m_size++;
+        }
+    }
+
+    size_t size() const { return m_size; }
+
+    std::string_view operator[]( size_t index ) const { return index < m_size && index < MaxTokenNumber ? m_tokens[index] : std::string_view{}; }
+
+    // not split rest of the message (after the last accessible token)
+    std::string_view tail() const { return m_tail; }
+};
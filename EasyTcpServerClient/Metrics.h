@@ -0,0 +1,399 @@
+#pragma once
+
+#include <boost/asio.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "Logs.h"
+
+// Metrics - lock-free per-thread counters and histograms
+//
+//   metrics::count( c_read_errors ), metrics::messageIn( type, size ), ...
+//       - update metrics of the calling thread: relaxed load+store of its own cells
+//         (single writer: no atomic read-modify-write, no locks, no shared cache lines)
+//   metrics::render( stream, typeName )
+//       - sums metrics of all threads (can be called from any thread) into plain text
+//   MetricsEndpoint
+//       - serves 'render()' output on a separate (local) port,
+//         e.g. 'curl http://127.0.0.1:15002/' or 'nc 127.0.0.1 15002'
+//
+
+namespace metrics {
+
+enum Counter : uint8_t
+{
+    c_accepted_connections,
+    c_closed_connections,
+    c_read_errors,
+    c_write_errors,
+    c_messages_in,
+    c_bytes_in,
+    c_messages_out,
+    c_bytes_out,
+    c_queued_bytes,         // gauge: not yet sent bytes of all sessions
+    c_migrated_sessions,    // moved to the io thread of their game partner
+    c_collapsed_lobby_updates, // queued lobby updates superseded by a lobby snapshot
+    c_forwarded_messages,   // to players of other cluster nodes
+    c_counter_number
+};
+
+constexpr const char* COUNTER_NAMES[c_counter_number] =
+{
+    "accepted_connections",
+    "closed_connections",
+    "read_errors",
+    "write_errors",
+    "messages_in",
+    "bytes_in",
+    "messages_out",
+    "bytes_out",
+    "queued_bytes",
+    "migrated_sessions",
+    "collapsed_lobby_updates",
+    "forwarded_messages",
+};
+
+enum HistogramType : uint8_t
+{
+    h_handler_latency_ns,   // 'onMessage' duration
+    h_queue_depth,          // outbound queue length (messages) when a message is queued
+    h_histogram_number
+};
+
+constexpr const char* HISTOGRAM_NAMES[h_histogram_number] =
+{
+    "handler_latency_ns",
+    "queue_depth",
+};
+
+constexpr size_t MESSAGE_TYPE_NUMBER    = 128;  // bigger type indices are counted as 0
+constexpr size_t HISTOGRAM_BUCKET_NUMBER = 32;  // bucket i: values < 2^i (the last one: all the rest)
+
+// single writer cell
+class Cell
+{
+    std::atomic<uint64_t> m_value{0};
+
+public:
+    void add( uint64_t value ) { m_value.store( m_value.load( std::memory_order_relaxed ) + value, std::memory_order_relaxed ); }
+    uint64_t value() const { return m_value.load( std::memory_order_relaxed ); }
+};
+
+struct Histogram
+{
+    std::array<Cell,HISTOGRAM_BUCKET_NUMBER> m_buckets;
+    Cell                                     m_sum;
+
+    static size_t bucketIndex( uint64_t value )
+    {
+        size_t bitWidth = ( value == 0 ) ? 0 : 64 - __builtin_clzll( value );
+        return std::min( bitWidth, HISTOGRAM_BUCKET_NUMBER-1 );
+    }
+
+    void record( uint64_t value )
+    {
+        m_buckets[ bucketIndex(value) ].add( 1 );
+        m_sum.add( value );
+    }
+};
+
+struct ThreadMetrics
+{
+    std::array<Cell,c_counter_number>           m_counters;
+    std::array<Cell,MESSAGE_TYPE_NUMBER>        m_messagesIn;
+    std::array<Cell,MESSAGE_TYPE_NUMBER>        m_bytesIn;
+    std::array<Cell,MESSAGE_TYPE_NUMBER>        m_messagesOut;
+    std::array<Cell,MESSAGE_TYPE_NUMBER>        m_bytesOut;
+    std::array<Histogram,h_histogram_number>    m_histograms;
+};
+
+// metrics of all threads (metrics of finished threads are kept)
+class Registry
+{
+    std::mutex                                  m_mutex;    // only for registration and rendering
+    std::vector<std::shared_ptr<ThreadMetrics>> m_threadMetrics;
+
+public:
+    static Registry& instance()
+    {
+        static Registry registry;
+        return registry;
+    }
+
+    std::shared_ptr<ThreadMetrics> registerThread()
+    {
+        auto threadMetrics = std::make_shared<ThreadMetrics>();
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_threadMetrics.push_back( threadMetrics );
+        return threadMetrics;
+    }
+
+    template<class FuncT>
+    void forEach( FuncT&& func )
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for( const auto& threadMetrics : m_threadMetrics )
+        {
+            func( *threadMetrics );
+        }
+    }
+};
+
+inline ThreadMetrics& local()
+{
+    thread_local std::shared_ptr<ThreadMetrics> threadMetrics = Registry::instance().registerThread();
+    return *threadMetrics;
+}
+
+inline void count( Counter counter, uint64_t value = 1 )
+{
+    local().m_counters[counter].add( value );
+}
+
+inline void record( HistogramType histogram, uint64_t value )
+{
+    local().m_histograms[histogram].record( value );
+}
+
+inline void messageIn( size_t type, size_t size )
+{
+    auto& threadMetrics = local();
+    type = ( type < MESSAGE_TYPE_NUMBER ) ? type : 0;
+    threadMetrics.m_counters[c_messages_in].add( 1 );
+    threadMetrics.m_counters[c_bytes_in].add( size );
+    threadMetrics.m_messagesIn[type].add( 1 );
+    threadMetrics.m_bytesIn[type].add( size );
+}
+
+inline void messageOut( size_t type, size_t size )
+{
+    auto& threadMetrics = local();
+    type = ( type < MESSAGE_TYPE_NUMBER ) ? type : 0;
+    threadMetrics.m_counters[c_messages_out].add( 1 );
+    threadMetrics.m_counters[c_bytes_out].add( size );
+    threadMetrics.m_messagesOut[type].add( 1 );
+    threadMetrics.m_bytesOut[type].add( size );
+}
+
+// gauge update (increment and decrement can be done by different threads)
+inline void changeQueuedBytes( int64_t delta )
+{
+    local().m_counters[c_queued_bytes].add( uint64_t(delta) );
+}
+
+// 'typeName(size_t type)' -> name of message type (empty -> type number is printed)
+template<class TypeNameF>
+void render( std::ostream& out, TypeNameF&& typeName )
+{
+    struct Sum
+    {
+        std::array<uint64_t,c_counter_number>       m_counters{};
+        std::array<uint64_t,MESSAGE_TYPE_NUMBER>    m_messagesIn{}, m_bytesIn{}, m_messagesOut{}, m_bytesOut{};
+        std::array<std::array<uint64_t,HISTOGRAM_BUCKET_NUMBER>,h_histogram_number> m_buckets{};
+        std::array<uint64_t,h_histogram_number>     m_sums{};
+    } sum;
+
+    Registry::instance().forEach( [&sum] ( const ThreadMetrics& threadMetrics )
+    {
+        for( size_t i=0; i<c_counter_number; i++ )
+        {
+            sum.m_counters[i] += threadMetrics.m_counters[i].value();
+        }
+        for( size_t i=0; i<MESSAGE_TYPE_NUMBER; i++ )
+        {
+            sum.m_messagesIn[i]  += threadMetrics.m_messagesIn[i].value();
+            sum.m_bytesIn[i]     += threadMetrics.m_bytesIn[i].value();
+            sum.m_messagesOut[i] += threadMetrics.m_messagesOut[i].value();
+            sum.m_bytesOut[i]    += threadMetrics.m_bytesOut[i].value();
+        }
+        for( size_t h=0; h<h_histogram_number; h++ )
+        {
+            for( size_t i=0; i<HISTOGRAM_BUCKET_NUMBER; i++ )
+            {
+                sum.m_buckets[h][i] += threadMetrics.m_histograms[h].m_buckets[i].value();
+            }
+            sum.m_sums[h] += threadMetrics.m_histograms[h].m_sum.value();
+        }
+    });
+
+    for( size_t i=0; i<c_counter_number; i++ )
+    {
+        if ( i == c_queued_bytes )
+        {
+            out << COUNTER_NAMES[i] << " " << int64_t( sum.m_counters[i] ) << "\n";
+            continue;
+        }
+        out << COUNTER_NAMES[i] << " " << sum.m_counters[i] << "\n";
+    }
+    out << "active_connections " << sum.m_counters[c_accepted_connections] - sum.m_counters[c_closed_connections] << "\n";
+
+    auto writePerType = [&] ( const char* name, const std::array<uint64_t,MESSAGE_TYPE_NUMBER>& values )
+    {
+        for( size_t type=0; type<MESSAGE_TYPE_NUMBER; type++ )
+        {
+            if ( values[type] != 0 )
+            {
+                std::string_view typeNameView = typeName( type );
+                out << name << "{type=\"";
+                if ( typeNameView.empty() ) out << type; else out << typeNameView;
+                out << "\"} " << values[type] << "\n";
+            }
+        }
+    };
+    writePerType( "messages_in",  sum.m_messagesIn );
+    writePerType( "bytes_in",     sum.m_bytesIn );
+    writePerType( "messages_out", sum.m_messagesOut );
+    writePerType( "bytes_out",    sum.m_bytesOut );
+
+    for( size_t h=0; h<h_histogram_number; h++ )
+    {
+        uint64_t total = 0;
+        for( size_t i=0; i<HISTOGRAM_BUCKET_NUMBER; i++ )
+        {
+            total += sum.m_buckets[h][i];
+            if ( sum.m_buckets[h][i] != 0 && i+1 < HISTOGRAM_BUCKET_NUMBER )
+            {
+                out << HISTOGRAM_NAMES[h] << "_bucket{le=\"" << ( (uint64_t(1) << i) - 1 ) << "\"} " << total << "\n";
+            }
+        }
+        out << HISTOGRAM_NAMES[h] << "_bucket{le=\"+Inf\"} " << total << "\n";
+        out << HISTOGRAM_NAMES[h] << "_sum " << sum.m_sums[h] << "\n";
+        out << HISTOGRAM_NAMES[h] << "_count " << total << "\n";
+    }
+}
+
+// scoped handler latency measurement
+class HandlerTimer
+{
+    std::chrono::steady_clock::time_point m_start = std::chrono::steady_clock::now();
+
+public:
+    ~HandlerTimer()
+    {
+        auto duration = std::chrono::duration_cast<std::chrono::nanoseconds>( std::chrono::steady_clock::now() - m_start );
+        record( h_handler_latency_ns, uint64_t( duration.count() ) );
+    }
+};
+
+// time of a metrics connection (the response is written and the peer's close awaited)
+constexpr std::chrono::seconds METRICS_CONNECTION_TIMEOUT{5};
+
+// MetricsEndpoint - answers every connection by the current metrics and closes it
+// (HTTP/1.0 response, so both 'curl' and 'nc' can be used)
+//
+class MetricsEndpoint
+{
+    using RenderFunc = std::function<void(std::ostream&)>;
+
+    boost::asio::ip::tcp::acceptor  m_acceptor;
+    RenderFunc                      m_render;
+
+    struct Connection: public std::enable_shared_from_this<Connection>
+    {
+        boost::asio::ip::tcp::socket    m_socket;
+        boost::asio::steady_timer       m_deadline;
+        std::string                     m_response;
+        std::array<char,256>            m_readBuffer;
+
+        Connection( boost::asio::ip::tcp::socket&& socket, std::string&& response )
+          : m_socket( std::move(socket) ), m_deadline( m_socket.get_executor() ), m_response( std::move(response) ) {}
+
+        void start()
+        {
+            // a client that neither reads the response nor closes the connection is closed
+            m_deadline.expires_after( METRICS_CONNECTION_TIMEOUT );
+            m_deadline.async_wait( [self=shared_from_this()] ( auto error )
+            {
+                if ( ! error )
+                {
+                    boost::system::error_code ec;
+                    self->m_socket.close( ec );
+                }
+            });
+
+            boost::asio::async_write( m_socket, boost::asio::buffer(m_response), [self=shared_from_this()] ( auto error, auto )
+            {
+                boost::system::error_code ec;
+                self->m_socket.shutdown( boost::asio::ip::tcp::socket::shutdown_send, ec );
+                if ( error )
+                {
+                    self->m_deadline.cancel();
+                    return;
+                }
+                self->drain();
+            });
+        }
+
+        // reads the request until the peer closes the connection (or the deadline)
+        // (closing with unread request could reset the connection before the response is read)
+        void drain()
+        {
+            m_socket.async_read_some( boost::asio::buffer(m_readBuffer), [self=shared_from_this()] ( auto error, auto )
+            {
+                if ( ! error )
+                {
+                    self->drain();
+                    return;
+                }
+                self->m_deadline.cancel();
+            });
+        }
+    };
+
+public:
+    MetricsEndpoint( boost::asio::io_context& context, const std::string& addr, const std::string& port, RenderFunc render )
+      : m_acceptor( context ),
+        m_render( std::move(render) )
+    {
+        boost::asio::ip::tcp::resolver resolver( context );
+        auto endpoint = *resolver.resolve( addr, port ).begin();
+
+        m_acceptor.open( endpoint.endpoint().protocol() );
+        m_acceptor.set_option( boost::asio::ip::tcp::acceptor::reuse_address(true) );
+        m_acceptor.bind( endpoint );
+        m_acceptor.listen();
+
+        asyncAccept();
+    }
+
+private:
+    void asyncAccept()
+    {
+        m_acceptor.async_accept( [this] ( auto errorCode, boost::asio::ip::tcp::socket socket )
+        {
+            if ( errorCode == boost::asio::error::operation_aborted )
+            {
+                return;
+            }
+
+            if ( errorCode )
+            {
+                LOG_ERR( "MetricsEndpoint accept error: " << errorCode.message() );
+            }
+            else
+            {
+                std::ostringstream body;
+                m_render( body );
+                auto bodyText = body.str();
+
+                std::string response = "HTTP/1.0 200 OK\r\nContent-Type: text/plain\r\nContent-Length: " + std::to_string( bodyText.size() ) + "\r\n\r\n";
+                response += bodyText;
+
+                std::make_shared<Connection>( std::move(socket), std::move(response) )->start();
+            }
+            asyncAccept();
+        });
+    }
+};
+
+} // namespace metrics
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <boost/asio.hpp>
+
+#include <cstring>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+// ReceiveBuffer - persistent receive buffer for ';'-delimited frames
+//
+// Socket reads are appended after 'm_end', complete frames are taken from 'm_begin'.
+// When the tail of the buffer is exhausted, the unparsed rest (always less than one frame)
+// is moved to the front, so every frame stays contiguous and can be returned
+// as 'std::string_view' without copying.
+//
+// The memory is taken by 'prepare()' and given back by 'trim()' when no data is held,
+// so an idle connection has no buffer (blocks are reused by a pool of the thread).
+//
+class ReceiveBuffer
+{
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 4096;
+
+private:
+    char*                   m_data = nullptr;
+    size_t                  m_capacity;
+
+    size_t                  m_begin = 0;    // start of the first unparsed frame
+    size_t                  m_scan  = 0;    // bytes before it are known to have no delimiter
+    size_t                  m_end   = 0;    // end of received data
+
+    // free blocks of DEFAULT_CAPACITY (of the thread; a block can be freed by another thread than its allocator)
+    struct BlockPool
+    {
+        static constexpr size_t MAX_BLOCK_NUMBER = 256;
+
+        std::vector<char*> m_blocks;
+
+        ~BlockPool()
+        {
+            for( auto* block : m_blocks )
+            {
+                delete[] block;
+            }
+        }
+    };
+
+    static BlockPool& blockPool()
+    {
+        static thread_local BlockPool pool;
+        return pool;
+    }
+
+    void allocate()
+    {
+        auto& blocks = blockPool().m_blocks;
+        if ( m_capacity == DEFAULT_CAPACITY && ! blocks.empty() )
+        {
+            m_data = blocks.back();
+            blocks.pop_back();
+            return;
+        }
+        m_data = new char[m_capacity];
+    }
+
+    void deallocate()
+    {
+        auto& blocks = blockPool().m_blocks;
+        if ( m_capacity == DEFAULT_CAPACITY && blocks.size() < BlockPool::MAX_BLOCK_NUMBER )
+        {
+            blocks.push_back( m_data );
+        }
+        else
+        {
+            delete[] m_data;
+        }
+        m_data = nullptr;
+    }
+
+public:
+    ReceiveBuffer( size_t capacity = DEFAULT_CAPACITY ) : m_capacity(capacity) {}
+
+    ReceiveBuffer( const ReceiveBuffer& ) = delete;
+    ReceiveBuffer& operator=( const ReceiveBuffer& ) = delete;
+
+    ~ReceiveBuffer()
+    {
+        if ( m_data != nullptr )
+        {
+            deallocate();
+        }
+    }
+
+    // free space for the next read;
+    // empty buffer means that the pending frame is longer than the capacity
+    boost::asio::mutable_buffer prepare()
+    {
+        if ( m_data == nullptr )
+        {
+            allocate();
+        }
+
+        if ( m_end == m_capacity && m_begin > 0 )
+        {
+            std::memmove( m_data, m_data+m_begin, m_end-m_begin );
+            m_scan -= m_begin;
+            m_end  -= m_begin;
+            m_begin = 0;
+        }
+        return boost::asio::mutable_buffer( m_data+m_end, m_capacity-m_end );
+    }
+
+    // gives the memory back when no data is held (e.g. all received frames are handled)
+    void trim()
+    {
+        if ( m_data != nullptr && m_begin == m_end )
+        {
+            m_begin = m_scan = m_end = 0;
+            deallocate();
+        }
+    }
+
+    // received data not yet taken by 'nextFrame()'
+    std::string_view data() const
+    {
+        return m_begin == m_end ? std::string_view() : std::string_view( m_data+m_begin, m_end-m_begin );
+    }
+
+    // appends data as if it were received (false -> no room)
+    bool append( std::string_view data )
+    {
+        auto buffer = prepare();
+        if ( buffer.size() < data.size() )
+        {
+            return false;
+        }
+        std::memcpy( buffer.data(), data.data(), data.size() );
+        commit( data.size() );
+        return true;
+    }
+
+    // drops all received data (e.g. a partial frame of a lost connection)
+    void clear()
+    {
+        m_begin = m_scan = m_end;
+        trim();
+    }
+
+    void commit( size_t size )
+    {
+        m_end += size;
+    }
+
+    // returns next complete frame (without delimiter);
+    // the view is valid until the next 'prepare()'
+    bool nextFrame( std::string_view& outFrame, char delimiter = ';' )
+    {
+        // (no buffer while no data is held)
+        auto* begin = m_data+m_begin;
+        auto* found = ( m_scan == m_end ) ? nullptr : static_cast<char*>( std::memchr( m_data+m_scan, delimiter, m_end-m_scan ) );
+        if ( found == nullptr )
+        {
+            m_scan = m_end;
+            if ( m_begin == m_end )
+            {
+                m_begin = m_scan = m_end = 0;
+            }
+            return false;
+        }
+
+        outFrame = std::string_view( begin, found-begin );
+        m_begin = m_scan = found+1-m_data;
+        return true;
+    }
+};
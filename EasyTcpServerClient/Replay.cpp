@@ -0,0 +1,370 @@
+// TicTacReplay - feeds a traffic capture (see Capture.h) back into TicTacServer
+//
+// Every captured session is replayed by its own connection: it is opened, sends its frames
+// and is closed at the recorded times (divided by '--speed'). Server responses are read and discarded.
+//
+// Usage:
+//   TicTacReplay <capture file> [--speed S] [--in-process] [--server-threads N] [--port P] [--host H]
+//
+//   --speed S       - 1: recorded speed (default), 10: 10 times faster, 0: as fast as possible
+//   --in-process    - server is created in the replay process and fed through socket pairs
+//                     (no TCP stack between client and server)
+//   --host H        - replay into already running server (otherwise own server is started in a child process)
+//
+
+#include "TicTacTcpServer.h"
+#include "Capture.h"
+
+#include <algorithm>
+#include <charconv>
+#include <csignal>
+#include <deque>
+#include <fcntl.h>
+#include <map>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct ReplayConfig
+{
+    std::string m_capturePath;
+    double      m_speed              = 1;
+    bool        m_isInProcess        = false;
+    size_t      m_serverThreadNumber = 0;       // 0 -> one per core
+    std::string m_host;                         // empty -> start own server
+    std::string m_port               = "15102";
+};
+
+// one replayed session (only used by the io thread)
+// frames are queued and written one by one: the io thread is never blocked by a server that does not read,
+// so it keeps reading the responses (a blocking write would deadlock with a server blocked on its own writes)
+class ReplayConnection
+{
+    boost::asio::ip::tcp::socket    m_socket;
+    std::array<char,4096>           m_readBuffer;
+    std::deque<std::string_view>    m_sendQueue;        // frames without ';' (payloads of the capture records)
+    bool                            m_isClosing = false; // close once 'm_sendQueue' is sent
+
+public:
+    size_t                          m_receivedSize = 0;
+    size_t                          m_sendErrorNumber = 0;
+    Clock::time_point               m_lastSendTime{};   // of the last sent frame
+
+    ReplayConnection( boost::asio::io_context& context ) : m_socket( context ) {}
+
+    boost::asio::ip::tcp::socket& socket() { return m_socket; }
+
+    void startReading()
+    {
+        m_socket.async_read_some( boost::asio::buffer(m_readBuffer), [this] ( auto error, size_t size )
+        {
+            m_receivedSize += size;
+            if ( ! error )
+            {
+                startReading();
+            }
+        });
+    }
+
+    // 'frame' must live until it is sent
+    void send( std::string_view frame )
+    {
+        m_sendQueue.push_back( frame );
+        if ( m_sendQueue.size() == 1 )
+        {
+            writeFront();
+        }
+    }
+
+    void close()
+    {
+        m_isClosing = true;
+        if ( m_sendQueue.empty() )
+        {
+            closeSocket();
+        }
+    }
+
+private:
+    void writeFront()
+    {
+        static const char delimiter = ';';
+        std::array<boost::asio::const_buffer,2> buffers = { boost::asio::buffer( m_sendQueue.front() ), boost::asio::buffer( &delimiter, 1 ) };
+        boost::asio::async_write( m_socket, buffers, [this] ( auto error, size_t )
+        {
+            if ( error )
+            {
+                // (the rest of the frames is not sent)
+                m_sendErrorNumber += m_sendQueue.size();
+                m_sendQueue.clear();
+            }
+            else
+            {
+                m_lastSendTime = Clock::now();
+                m_sendQueue.pop_front();
+            }
+
+            if ( ! m_sendQueue.empty() )
+            {
+                writeFront();
+            }
+            else if ( m_isClosing )
+            {
+                closeSocket();
+            }
+        });
+    }
+
+    void closeSocket()
+    {
+        boost::system::error_code ec;
+        m_socket.shutdown( boost::asio::ip::tcp::socket::shutdown_both, ec );
+        m_socket.close( ec );
+    }
+};
+
+void printUsage()
+{
+    std::cerr << "usage: TicTacReplay <capture file> [--speed S] [--in-process] [--server-threads N] [--port P] [--host H]" << std::endl;
+}
+
+// true -> 'text' is a number (and nothing else)
+template<class T>
+bool parseNumber( std::string_view text, T& outValue )
+{
+    auto [end,error] = std::from_chars( text.data(), text.data()+text.size(), outValue );
+    return error == std::errc() && end == text.data()+text.size();
+}
+
+ReplayConfig parseArguments( int argc, char* argv[] )
+{
+    ReplayConfig config;
+    if ( argc < 2 )
+    {
+        printUsage();
+        exit(1);
+    }
+    config.m_capturePath = argv[1];
+
+    for( int i=2; i<argc; i++ )
+    {
+        std::string name = argv[i];
+        if ( name == "--in-process" )
+        {
+            config.m_isInProcess = true;
+            continue;
+        }
+
+        if ( i+1 == argc )
+        {
+            std::cerr << "no value of argument: " << name << std::endl;
+            exit(1);
+        }
+        std::string value = argv[++i];
+
+        bool isValid = true;
+        if ( name == "--speed" )                isValid = parseNumber( value, config.m_speed ) && config.m_speed >= 0;
+        else if ( name == "--server-threads" )  isValid = parseNumber( value, config.m_serverThreadNumber );
+        else if ( name == "--port" )            config.m_port = value;
+        else if ( name == "--host" )            config.m_host = value;
+        else
+        {
+            std::cerr << "unknown argument: " << name << std::endl;
+            printUsage();
+            exit(1);
+        }
+
+        if ( ! isValid )
+        {
+            std::cerr << "bad value of argument " << name << ": " << value << std::endl;
+            printUsage();
+            exit(1);
+        }
+    }
+    return config;
+}
+
+} // namespace
+
+int main( int argc, char* argv[] )
+{
+    auto config = parseArguments( argc, argv );
+
+    std::vector<capture::CaptureRecord> records;
+    if ( ! capture::readCapture( config.m_capturePath, records ) )
+    {
+        std::cerr << "cannot read capture: " << config.m_capturePath << std::endl;
+        return 1;
+    }
+    std::stable_sort( records.begin(), records.end(), [] ( const auto& a, const auto& b ) { return a.m_timeNs < b.m_timeNs; } );
+
+    // logs of the server go to /dev/null, report goes to original stdout
+    FILE* report = fdopen( dup( STDOUT_FILENO ), "w" );
+    int devNull = open( "/dev/null", O_WRONLY );
+    dup2( devNull, STDOUT_FILENO );
+    dup2( devNull, STDERR_FILENO );
+
+    std::unique_ptr<tic_tac::TicTacServer> inProcessServer;
+    std::thread inProcessServerThread;
+    pid_t serverPid = 0;
+    std::string host = config.m_host;
+
+    if ( config.m_isInProcess )
+    {
+        inProcessServer = std::make_unique<tic_tac::TicTacServer>( "127.0.0.1", config.m_port, config.m_serverThreadNumber );
+        inProcessServerThread = std::thread( [&server=*inProcessServer] { server.run(); } );
+    }
+    else if ( host.empty() )
+    {
+        host = "127.0.0.1";
+        serverPid = fork();
+        if ( serverPid == 0 )
+        {
+            tic_tac::TicTacServer server( host, config.m_port, config.m_serverThreadNumber );
+            server.run();
+            _exit(0);
+        }
+        usleep( 100000 );
+    }
+
+    boost::asio::io_context context;
+    auto workGuard = boost::asio::make_work_guard( context );
+    std::thread ioThread( [&context] { context.run(); } );
+
+    boost::asio::ip::tcp::endpoint endpoint;
+    if ( ! config.m_isInProcess )
+    {
+        boost::asio::ip::tcp::resolver resolver( context );
+        endpoint = *resolver.resolve( host, config.m_port ).begin();
+    }
+
+    std::map<uint32_t,std::unique_ptr<ReplayConnection>> connections;
+    std::vector<std::unique_ptr<ReplayConnection>> closedConnections;
+    size_t sentFrameNumber = 0;
+    size_t sentSize = 0;
+    size_t errorNumber = 0;
+
+    // connections are opened by this thread; all socket operations are done by 'ioThread'
+    auto firstTimeNs = records.empty() ? 0 : records.front().m_timeNs;
+    auto startTime = Clock::now();
+    for( const auto& record : records )
+    {
+        if ( config.m_speed > 0 )
+        {
+            auto recordTime = startTime + std::chrono::nanoseconds( uint64_t( ( record.m_timeNs - firstTimeNs ) / config.m_speed ) );
+            std::this_thread::sleep_until( recordTime );
+        }
+
+        switch ( record.m_type )
+        {
+            case capture::crt_open:
+            {
+                auto connection = std::make_unique<ReplayConnection>( context );
+                boost::system::error_code ec;
+                if ( config.m_isInProcess )
+                {
+                    int sockets[2];
+                    if ( socketpair( AF_UNIX, SOCK_STREAM, 0, sockets ) != 0 )
+                    {
+                        errorNumber++;
+                        break;
+                    }
+                    inProcessServer->adoptSocket( sockets[0] );
+                    connection->socket().assign( boost::asio::ip::tcp::v4(), sockets[1], ec );
+                }
+                else
+                {
+                    connection->socket().connect( endpoint, ec );
+                }
+
+                if ( ec )
+                {
+                    errorNumber++;
+                    break;
+                }
+
+                boost::asio::post( context, [connection=connection.get()] { connection->startReading(); } );
+                connections[record.m_sessionId] = std::move(connection);
+                break;
+            }
+            case capture::crt_frame:
+            {
+                auto it = connections.find( record.m_sessionId );
+                if ( it == connections.end() )
+                {
+                    errorNumber++;
+                    break;
+                }
+                boost::asio::post( context, [connection=it->second.get(),frame=std::string_view(record.m_payload)]
+                {
+                    connection->send( frame );
+                });
+                sentFrameNumber++;
+                sentSize += record.m_payload.size()+1;
+                break;
+            }
+            case capture::crt_close:
+            {
+                if ( auto it = connections.find( record.m_sessionId ); it != connections.end() )
+                {
+                    boost::asio::post( context, [connection=it->second.get()] { connection->close(); } );
+                    closedConnections.push_back( std::move(it->second) );
+                    connections.erase( it );
+                }
+                break;
+            }
+        }
+    }
+
+    auto endTime = Clock::now();
+
+    // let the server answer the last frames (the frames still queued are sent before a connection is closed)
+    usleep( 100000 );
+    for( auto& [sessionId,connection] : connections )
+    {
+        boost::asio::post( context, [connection=connection.get()] { connection->close(); } );
+    }
+    workGuard.reset();
+    ioThread.join();
+
+    size_t receivedSize = 0;
+    auto addConnection = [&] ( const ReplayConnection& connection )
+    {
+        receivedSize += connection.m_receivedSize;
+        errorNumber += connection.m_sendErrorNumber;
+        endTime = std::max( endTime, connection.m_lastSendTime );
+    };
+    for( const auto& [sessionId,connection] : connections )
+    {
+        addConnection( *connection );
+    }
+    for( const auto& connection : closedConnections )
+    {
+        addConnection( *connection );
+    }
+    auto duration = std::chrono::duration<double>( endTime - startTime ).count();
+
+    if ( inProcessServer )
+    {
+        inProcessServer->shutdown();
+        inProcessServerThread.join();
+    }
+    if ( serverPid )
+    {
+        kill( serverPid, SIGKILL );
+        waitpid( serverPid, nullptr, 0 );
+    }
+
+    auto capturedDuration = records.empty() ? 0.0 : ( records.back().m_timeNs - firstTimeNs ) / 1e9;
+    fprintf( report, "records: %zu, sessions: %zu, captured duration: %.3f s\n",
+             records.size(), connections.size() + closedConnections.size(), capturedDuration );
+    fprintf( report, "replayed in %.3f s: %zu frames (%zu bytes) sent, %zu bytes received, %zu errors\n",
+             duration, sentFrameNumber, sentSize, receivedSize, errorNumber );
+    fclose( report );
+
+    return errorNumber == 0 ? 0 : 2;
+}
@@ -1,93 +1,175 @@
 #pragma once
 
+#include <boost/asio.hpp>
+
+#include <memory>
+#include <string>
+
+#include "ReceiveBuffer.h"
+#include "Logs.h"
+
 class IClient
 {
 protected:
-    virtual void onMessageReceived( const std::string& message ) = 0;
+    virtual void onMessageReceived( std::string_view message ) = 0;
     virtual std::string clientName() const = 0;
 };
 
+// TcpClient - asynchronous client
+//
+// Two modes:
+//   TcpClient()         - own io_context; 'run()' blocks until the connection is closed
+//   TcpClient(context)  - many clients share one io_context (possibly run by several threads);
+//                         'start()' returns immediately, handlers of one client never run concurrently
+//                         (socket is bound to its own strand); client must outlive the io_context run
+//
+// Writes are asynchronous and must be called on the client's executor (from its handlers or posted to 'executor()'):
+// messages are serialized into the pending buffer, which is sent by one write when the previous write completes
+// (the pending and the sending buffers are swapped, so their capacity is reused)
+//
 class TcpClient: protected IClient
 {
-    std::vector<char>               m_sendMessage;
+    std::unique_ptr<boost::asio::io_context>  m_ownContext;
+
+    std::string                     m_pendingData;
+    std::string                     m_sendingData;
+    bool                            m_isWriting = false;
 
-    boost::asio::io_context         m_context;
     boost::asio::ip::tcp::socket    m_socket;
+    boost::asio::ip::tcp::resolver  m_resolver;
+    ReceiveBuffer                   m_receiveBuffer;
 
-protected:
-    std::mutex                      m_mutex;
-    
 public:
-    TcpClient() : m_context(), m_socket(m_context) {}
+    TcpClient()
+      : m_ownContext( std::make_unique<boost::asio::io_context>() ),
+        m_socket( boost::asio::make_strand( *m_ownContext ) ),
+        m_resolver( *m_ownContext )
+    {}
+
+    TcpClient( boost::asio::io_context& context )
+      : m_socket( boost::asio::make_strand( context ) ),
+        m_resolver( context )
+    {}
+
     virtual ~ TcpClient() = default;
-    
-    void write( const std::string& message )
+
+    // 'message' must be ';'-terminated (see tic_tac::makeMessage)
+    void write( std::string_view message )
+    {
+        writeMessage( [message] ( std::string& out ) { out += message; } );
+    }
+
+    // 'serialize( std::string& out )' appends one ';'-terminated message (see tic_tac::appendMessage)
+    template<class SerializeFunc>
+    void writeMessage( SerializeFunc&& serialize )
     {
-        LOG( ">>> sendMessage: (" << clientName().c_str() << "): " << message.c_str() );
-        m_sendMessage.resize( message.size()+1 );
-        std::memcpy( &m_sendMessage[0], message.c_str(), message.size() );
-        m_sendMessage.back() = ';';
-
-        boost::system::error_code ec;
-        boost::asio::write( m_socket, boost::asio::buffer(m_sendMessage), ec);
-        if (ec)
+        auto offset = m_pendingData.size();
+        serialize( m_pendingData );
+        LOG_DBG( ">>> sendMessage: (" << clientName().c_str() << "): " << std::string_view( m_pendingData ).substr( offset ) );
+
+        if ( ! m_isWriting && m_socket.is_open() )
         {
-            LOG_ERR( "write error: " << ec.message().c_str() );
+            writePendingData();
         }
     }
 
-    void closeSocket() { m_socket.close(); }
-    
-    void run( std::string address, std::string port )
+    void closeSocket()
     {
-        try
+        boost::asio::post( m_socket.get_executor(), [this]
         {
-            boost::asio::ip::tcp::resolver  resolver(m_context);
-            auto endpoints = resolver.resolve( address, port );
-            
-            boost::asio::connect( m_socket, endpoints );
+            boost::system::error_code ec;
+            m_socket.close( ec );
+        });
+    }
+
+    // executor of the client handlers (for timers, posts etc.)
+    boost::asio::any_io_executor executor() { return m_socket.get_executor(); }
+
+    // standalone mode
+    void run( std::string address, std::string port )
+    {
+        start( address, port );
+        m_ownContext->run();
+    }
 
-            for(;;)
+    void start( const std::string& address, const std::string& port )
+    {
+        m_resolver.async_resolve( address, port, [this] ( auto ec, auto endpoints )
+        {
+            if ( ec )
             {
-                std::string response;
-                boost::system::error_code ec;
-                boost::asio::read_until( m_socket, boost::asio::dynamic_buffer(response), ";", ec );
+                LOG_ERR( "Client error: resolve error: " << ec.message().c_str() );
+                return;
+            }
 
+            boost::asio::async_connect( m_socket, endpoints, [this] ( auto ec, auto endpoint )
+            {
                 if ( ec )
                 {
-                    LOG_ERR( "Client error: read_until error: " << this << " " << ec.message().c_str() );
-                    if ( ec == boost::asio::error::eof || ec == boost::asio::error::bad_descriptor )
-                    {
-                        return;
-                    }
+                    LOG_ERR( "Client error: connect error: " << ec.message().c_str() );
+                    return;
                 }
 
-                LOG( "response: (" << clientName().c_str() << ") \'" << response.c_str() << '\'');
+                // (a partial frame of the previous connection; messages written while not connected)
+                m_receiveBuffer.clear();
+                m_pendingData.clear();
+                read();
+            });
+        });
+    }
 
-                char* ptr = const_cast<char*>( response.c_str() );
-                auto* responseEnd  = response.c_str()+response.size();
-                for( char* end = ptr ; end < responseEnd; end++ )
-                {
-                    if ( *end == ';' )
-                    {
-                        *end = 0;
-                        LOG( "message: (" << clientName().c_str() << ")" << ptr );
-                        {
-                            onMessageReceived( std::string(ptr) );
-                        }
-                        ptr = end+1;
-                    }
-                }
+private:
+    void writePendingData()
+    {
+        std::swap( m_pendingData, m_sendingData );
+        m_isWriting = true;
+
+        boost::asio::async_write( m_socket, boost::asio::buffer(m_sendingData), [this] ( auto ec, size_t )
+        {
+            m_isWriting = false;
+            m_sendingData.clear();
+
+            if ( ec )
+            {
+                // (the read fails too)
+                LOG_ERR( "write error: " << ec.message().c_str() );
+                return;
             }
-        }
-        catch( std::runtime_error& exception )
+
+            if ( ! m_pendingData.empty() && m_socket.is_open() )
+            {
+                writePendingData();
+            }
+        });
+    }
+
+    void read()
+    {
+        auto buffer = m_receiveBuffer.prepare();
+        if ( buffer.size() == 0 )
         {
-            LOG_ERR( "Client exception: " << exception.what() );
+            LOG_ERR( "Client error: response is too long" );
+            return;
         }
-        catch( ... )
+
+        m_socket.async_read_some( buffer, [this] ( auto ec, size_t dataSize )
         {
-            LOG_ERR( "Client exception: ..." );
-        }
+            if ( ec )
+            {
+                LOG_ERR( "Client error: read error: " << this << " " << ec.message().c_str() );
+                return;
+            }
+
+            m_receiveBuffer.commit( dataSize );
+
+            std::string_view message;
+            while ( m_receiveBuffer.nextFrame( message ) )
+            {
+                LOG_DBG( "message: (" << clientName().c_str() << ")" << message );
+                onMessageReceived( message );
+            }
+
+            read();
+        });
     }
-    
 };
@@ -1,91 +1,1401 @@
 #include <boost/asio.hpp>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <iterator>
 #include <iostream>
 #include <ostream>
 #include <strstream>
+#include <string>
+#include <string_view>
 #include <optional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 #include <boost/algorithm/string.hpp>
 
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
 #include "Logs.h"
+#include "ReceiveBuffer.h"
+#include "Metrics.h"
+#include "TimerWheel.h"
+#include "Capture.h"
+#include "HotRestart.h"
+
+#ifdef TCP_SERVER_IO_URING
+#include "IoUring.h"
+#endif
+
+// OutboundMessage - item of the session outbound queue:
+// part shared between several sessions (broadcasts, cached prefixes) followed by own part;
+// both are optional
+//
+// Two priority classes: game messages (and replies) are sent ahead of the queued lobby updates
+// (see TcpClientSession::writeQueuedMessages())
+//
+struct OutboundMessage
+{
+    std::shared_ptr<const std::string>  m_sharedData;
+    std::string                         m_data;
+    bool                                m_isLobbyUpdate = false;    // lower priority, can be dropped on overflow
+    bool                                m_isSnapshot = false;       // lobby snapshot: supersedes lobby updates up to its sequence
+    uint64_t                            m_lobbySequence = 0;
+
+    size_t size() const { return ( m_sharedData ? m_sharedData->size() : 0 ) + m_data.size(); }
+
+    // appends the bytes from 'offset'
+    void appendTo( std::string& out, size_t offset = 0 ) const
+    {
+        if ( m_sharedData )
+        {
+            out.append( *m_sharedData, std::min( offset, m_sharedData->size() ) );
+            offset -= std::min( offset, m_sharedData->size() );
+        }
+        out.append( m_data, std::min( offset, m_data.size() ) );
+    }
+};
+
+// Back-pressure: limits of queued (not yet sent) bytes of one session
+//
+// When the queue grows above 'm_highWatermark' (peer does not read):
+//   op_drop_lobby_updates - queued and new lobby updates are dropped until the queue drains
+//                           below 'm_lowWatermark', then the session resynchronizes
+//                           (see TcpClientSession::onLobbyUpdatesDropped());
+//                           if the queue is still above the high watermark without lobby updates,
+//                           the session is disconnected
+//   op_disconnect         - the session is disconnected
+//
+enum OverflowPolicy
+{
+    op_drop_lobby_updates,
+    op_disconnect,
+};
+
+struct OutboundLimits
+{
+    size_t          m_highWatermark  = 256*1024;
+    size_t          m_lowWatermark   = 64*1024;
+    OverflowPolicy  m_overflowPolicy = op_drop_lobby_updates;
+
+    // lobby update bytes per write: a game message queued meanwhile waits for at most this much
+    size_t          m_maxLobbyBatchSize = 16*1024;
+};
+
+// SocketOptions - kernel options of the listening socket and of the accepted connections
+// (see the TcpServer constructor); 0 -> the system default is kept
+//
+//   m_isNoDelay           TCP_NODELAY: a small message is sent at once; without it (Nagle) a message written
+//                         while the previous one is not acknowledged waits for the ack (up to the peer's
+//                         delayed ack timeout, 40 ms on Linux)
+//   m_isQuickAck          TCP_QUICKACK: received data is acknowledged at once, the peer's Nagle does not wait;
+//                         Linux clears it, so it is set again on every read: costs one 'setsockopt' syscall
+//                         per read (off by default)
+//   m_isReusePort         SO_REUSEPORT: several servers (e.g. cluster nodes of one host) listen on one port,
+//                         the kernel spreads the connections between them
+//   m_receiveBufferSize   SO_RCVBUF, SO_SNDBUF: set on the listener (inherited by the connections;
+//   m_sendBufferSize      the window scale is negotiated from it)
+//   m_deferAcceptSeconds  TCP_DEFER_ACCEPT: a connection is accepted when its first data arrives;
+//                         clients of a server that greets first ("Hi;") wait for the timeout
+//   m_userTimeoutMs       TCP_USER_TIMEOUT: a connection with data unacknowledged longer is dropped
+//                         (a dead peer is detected without waiting for the retransmission limit)
+//
+struct SocketOptions
+{
+    bool            m_isNoDelay = true;
+    bool            m_isKeepAlive = true;
+    bool            m_isQuickAck = false;
+    bool            m_isReusePort = false;
+    int             m_receiveBufferSize = 0;
+    int             m_sendBufferSize = 0;
+    int             m_deferAcceptSeconds = 0;
+    int             m_userTimeoutMs = 0;
+};
+
+// named profiles (server command line, TicTacBenchmark --socket-options)
+constexpr std::string_view SOCKET_OPTIONS_PROFILES[] = { "nagle", "nodelay", "quickack", "small-buffers", "user-timeout", "defer-accept" };
+
+// false -> unknown profile ("nodelay" -> the defaults)
+inline bool socketOptionsProfile( std::string_view profile, SocketOptions& outOptions )
+{
+    outOptions = SocketOptions{};
+    if ( profile == "nagle" )
+    {
+        outOptions.m_isNoDelay = false;
+    }
+    else if ( profile == "quickack" )
+    {
+        outOptions.m_isQuickAck = true;
+    }
+    else if ( profile == "small-buffers" )
+    {
+        outOptions.m_receiveBufferSize = 4096;
+        outOptions.m_sendBufferSize = 4096;
+    }
+    else if ( profile == "user-timeout" )
+    {
+        outOptions.m_userTimeoutMs = 10000;
+    }
+    else if ( profile == "defer-accept" )
+    {
+        outOptions.m_deferAcceptSeconds = 1;
+    }
+    else if ( profile != "nodelay" )
+    {
+        return false;
+    }
+    return true;
+}
 
-class TcpClientSession: public std::enable_shared_from_this<TcpClientSession>
+struct BackPressureCounters
+{
+    std::atomic<uint64_t> m_overflowNumber{0};          // high watermark reached
+    std::atomic<uint64_t> m_droppedMessageNumber{0};
+    std::atomic<uint64_t> m_droppedByteNumber{0};
+    std::atomic<uint64_t> m_evictedSessionNumber{0};
+};
+
+inline BackPressureCounters gBackPressureCounters;
+
+// io thread of a session (see TcpClientSession::migrate())
+struct SessionHome
+{
+    boost::asio::io_context&    m_context;
+    TimerWheel&                 m_timerWheel;
+#ifdef TCP_SERVER_IO_URING
+    IoUring&                    m_ring;
+#endif
+};
+
+class TcpClientSession: public std::enable_shared_from_this<TcpClientSession>, public ITimerOwner
 {
 protected:
+    // timer kinds of derived sessions start from 'tk_session_timer_number'
+    enum TimerKind : uint8_t
+    {
+        tk_idle,
+        tk_session_timer_number
+    };
+
     boost::asio::ip::tcp::socket m_socket;
-    std::string                  m_request;
+    ReceiveBuffer                m_receiveBuffer;
+
+    // io_context of the session's io thread (changed by 'migrate()', handlers posted to the previous one are forwarded)
+    std::atomic<boost::asio::io_context*>   m_homeContext{ nullptr };
+
+    // messages of other threads not yet queued (in the order of 'enqueue()' calls; drained on the session's own thread);
+    // the session's own thread queues directly only when there are none
+    std::mutex                              m_postedMessageMutex;
+    std::vector<OutboundMessage>            m_postedMessages;
+    bool                                    m_isDrainingPostedMessages = false;    // (own thread only)
+
+    const uint32_t               m_sessionId = nextSessionId();
+    capture::CaptureWriter*      m_captureWriter = nullptr;
+
+    // wheel of the session's io thread
+    TimerWheel*                  m_timerWheel = nullptr;
+    TimerWheel::Timer            m_idleTimer;
+    std::chrono::milliseconds    m_idleTimeout{0};     // 0 -> no idle timeout
+
+    // outbound queues (accessed only on the session's io thread): game messages, lobby updates
+    std::vector<OutboundMessage>            m_writeQueue;
+    std::vector<OutboundMessage>            m_lobbyQueue;
+    std::optional<uint64_t>                 m_lobbySnapshotSequence;    // of the last queued snapshot
+    std::vector<OutboundMessage>            m_writeBatch;
+    std::vector<boost::asio::const_buffer>  m_writeBuffers;
+    bool                                    m_isWriting = false;
+
+    // back-pressure (accessed only on the session's io thread)
+    OutboundLimits                          m_outboundLimits;
+    size_t                                  m_queuedSize = 0;       // queued + in flight bytes
+    bool                                    m_isOverflowed = false; // lobby updates are dropped
+
+    // session resumption: a detached session (its connection is lost) keeps its state
+    // and queues outbound messages until 'attachSocket()'
+    bool                                    m_isDetached = false;
+    bool                                    m_isSocketReleased = false; // the socket continues another session
+
+    bool                                    m_isQuickAck = false;       // see SocketOptions
+
+    // hot restart: reading and writing are stopped, 'm_onPaused' is called when no io is in flight
+    bool                                    m_isPaused = false;
+    std::function<void()>                   m_onPaused;
+#ifndef TCP_SERVER_IO_URING
+    bool                                    m_isReading = false;
+#endif
+
+#ifdef TCP_SERVER_IO_URING
+    // io_uring backend (ring of the session's io thread);
+    // an in-flight operation keeps the session alive by 'm_self'
+    struct UringOperation : IoUringOperation
+    {
+        TcpClientSession&                   m_session;
+        void (TcpClientSession::*           m_handler)( int, uint32_t );
+        std::shared_ptr<TcpClientSession>   m_self;
+
+        UringOperation( TcpClientSession& session, void (TcpClientSession::*handler)( int, uint32_t ) )
+          : m_session( session ), m_handler( handler ) {}
+
+        void onCompletion( int result, uint32_t flags ) override { (m_session.*m_handler)( result, flags ); }
+        void onAbandoned() override { m_self.reset(); }
+    };
+
+    IoUring*                                m_ring = nullptr;
+    UringOperation                          m_receiveOperation{ *this, &TcpClientSession::onUringReceive };
+    UringOperation                          m_sendOperation{ *this, &TcpClientSession::onUringSend };
+    size_t                                  m_sendBufferIndex = 0;  // first not (fully) sent buffer of 'm_writeBuffers'
+    size_t                                  m_sentSize = 0;         // of the current batch
+    size_t                                  m_chainSentSize = 0;
+    int                                     m_chainError = 0;
+#endif
     
 public:
     TcpClientSession( boost::asio::ip::tcp::socket&& socket ) : m_socket( std::move(socket) )
     {
     }
+
+    virtual ~TcpClientSession()
+    {
+        metrics::count( metrics::c_closed_connections );
+        metrics::changeQueuedBytes( -int64_t(m_queuedSize) );
+    }
     
-    virtual void onMessage( const std::string& message ) // = 0; for debugging
+    virtual void onMessage( std::string_view message ) // = 0; for debugging
     {
-        LOG( "TcpClientSession::onMessage: " << message );
+        LOG_DBG( "TcpClientSession::onMessage: " << message );
     }
     
     void start()
     {
+        if ( m_captureWriter != nullptr )
+        {
+            m_captureWriter->write( m_sessionId, capture::crt_open );
+        }
+
         write( "Hi;" );
+        touchIdleTimer();
         read();
     }
-    
-    virtual void connectionLost( boost::system::error_code error ) {}
-    
-    void read()
+
+    // must be called before 'start()'
+    void setCaptureWriter( capture::CaptureWriter* captureWriter ) { m_captureWriter = captureWriter; }
+
+    uint32_t sessionId() const { return m_sessionId; }
+
+    // must be called before 'start()'
+    void setTimerWheel( TimerWheel& timerWheel, std::chrono::milliseconds idleTimeout )
+    {
+        m_timerWheel = &timerWheel;
+        m_idleTimeout = idleTimeout;
+    }
+
+#ifdef TCP_SERVER_IO_URING
+    // must be called before 'start()'
+    void setRing( IoUring& ring ) { m_ring = &ring; }
+#endif
+
+    // must be called before 'start()'
+    void setHomeContext( boost::asio::io_context& context ) { m_homeContext.store( &context, std::memory_order_release ); }
+
+    boost::asio::io_context* homeContext() const { return m_homeContext.load( std::memory_order_acquire ); }
+
+    // number of timer kinds (see 'timer()'), their timers move with the session
+    virtual uint8_t timerNumber() const { return tk_session_timer_number; }
+
+    TimerWheel::Timer& timer( uint8_t kind ) override { return m_idleTimer; }
+
+    void onTimer( uint8_t kind ) override
+    {
+        if ( kind == tk_idle && ! m_isPaused )
+        {
+            // the pending read fails and calls 'connectionLost()'
+            LOG( "TcpClientSession idle timeout: " << this );
+            closeSocket();
+        }
+    }
+    
+    virtual void connectionLost( boost::system::error_code error ) {}
+
+    // the session outlives its lost connection: outbound messages are queued until 'attachSocket()';
+    // must be called on the session's io thread
+    void detach()
+    {
+        closeSocket();
+        m_isDetached = true;
+    }
+
+    // connected socket taken from a session by 'releaseSocket()'
+    struct ReleasedSocket
+    {
+        boost::asio::ip::tcp    m_protocol;
+        int                     m_nativeSocket;
+        std::string             m_inbound;      // received, not yet handled data (e.g. frames pipelined after [Resume])
+    };
+
+    // takes the connected socket and the not yet handled received data from the session
+    // (the session ends without the connection); must be called on the session's io thread
+    ReleasedSocket releaseSocket()
+    {
+        boost::system::error_code ec;
+        auto protocol = m_socket.local_endpoint( ec ).protocol();
+
+        std::string inbound( m_receiveBuffer.data() );
+        m_receiveBuffer.clear();
+
+#ifdef TCP_SERVER_IO_URING
+        // the multishot receive must not take data of the next owner
+        if ( m_receiveOperation.isInFlight() )
+        {
+            m_ring->cancel( m_receiveOperation );
+            m_ring->submit();
+        }
+#endif
+        m_isSocketReleased = true;
+        int nativeSocket = m_socket.release( ec );
+        if ( ec )
+        {
+            LOG_ERR( "TcpClientSession release error: " << ec.message() );
+            return ReleasedSocket{ protocol, -1, {} };
+        }
+        return ReleasedSocket{ protocol, nativeSocket, std::move(inbound) };
+    }
+
+    // 'releaseSocket()' once no receive is in flight: the session is paused first, so the data of receives
+    // that complete meanwhile (io_uring: a canceled multishot receive can still deliver) goes with the socket
+    // and the frames after the current one are not handled here; 'onReleased' is called on the session's io thread
+    void releaseSocketWhenIdle( std::function<void( ReleasedSocket )> onReleased )
+    {
+        pause( [this,onReleased=std::move(onReleased)]
+        {
+            auto socket = releaseSocket();
+            captureClose();
+            onReleased( std::move(socket) );
+        });
+    }
+
+    // continues the detached session on the socket of 'releaseSocket()':
+    // 'greeting' is sent before the messages queued while the session was detached,
+    // then the data received with the socket is handled; must be called on the session's io thread
+    // (false -> the session stays detached)
+    bool attachSocket( ReleasedSocket socket, std::string greeting )
+    {
+        if ( socket.m_nativeSocket < 0 )
+        {
+            return false;
+        }
+
+        boost::system::error_code ec;
+        m_socket.assign( socket.m_protocol, socket.m_nativeSocket, ec );
+        if ( ec )
+        {
+            LOG_ERR( "TcpClientSession attach error: " << ec.message() );
+            ::close( socket.m_nativeSocket );
+            return false;
+        }
+
+        m_isDetached = false;
+        m_receiveBuffer.clear();
+        if ( ! m_receiveBuffer.append( socket.m_inbound ) )
+        {
+            LOG_ERR( "TcpClientSession attached request is too long" );
+        }
+
+        metrics::messageOut( messageTypeIndex( greeting ), greeting.size() );
+        addQueuedSize( greeting.size() );
+        m_writeQueue.insert( m_writeQueue.begin(), OutboundMessage{ {}, std::move(greeting) } );
+
+        onDataReceived();
+        if ( ! m_socket.is_open() )
+        {
+            return true;
+        }
+        read();
+        if ( ! m_isWriting )
+        {
+            writeQueuedMessages();
+        }
+        return true;
+    }
+
+    // hot restart: state of the derived session (see TcpServer::restoreSessions())
+    virtual std::string saveState() const { return {}; }
+
+    bool isPaused() const { return m_isPaused; }
+
+    // hot restart: stops reading and writing (reads and writes in flight are canceled);
+    // 'onPaused' is called on the session's io thread when no io is in flight
+    void pause( std::function<void()> onPaused )
+    {
+        m_isPaused = true;
+        m_onPaused = std::move(onPaused);
+
+#ifdef TCP_SERVER_IO_URING
+        if ( m_receiveOperation.isInFlight() )
+        {
+            m_ring->cancel( m_receiveOperation );
+        }
+        if ( m_sendOperation.isInFlight() )
+        {
+            m_ring->cancel( m_sendOperation );
+        }
+#else
+        boost::system::error_code ec;
+        m_socket.cancel( ec );
+#endif
+        checkPaused();
+    }
+
+    // hot restart: takes the state and the socket of the paused session (false -> nothing to hand over);
+    // must be called on the session's io thread
+    bool handOver( hot_restart::SessionState& outState )
+    {
+        if ( m_isSocketReleased || m_onPaused || ( ! m_socket.is_open() && ! m_isDetached ) )
+        {
+            return false;
+        }
+
+        outState.m_inbound = m_receiveBuffer.data();
+        for( const auto& message : m_writeQueue )
+        {
+            message.appendTo( outState.m_outbound );
+        }
+        for( const auto& message : m_lobbyQueue )
+        {
+            message.appendTo( outState.m_outbound );
+        }
+        outState.m_appState = saveState();
+        outState.m_socket = m_isDetached ? -1 : releaseSocket().m_nativeSocket;
+        return true;
+    }
+
+    // hot restart: data of the previous process (before 'continueSession()')
+    void restoreTransport( std::string_view inbound, std::string outbound )
+    {
+        if ( ! m_receiveBuffer.append( inbound ) )
+        {
+            LOG_ERR( "TcpClientSession restored request is too long" );
+        }
+        if ( ! outbound.empty() )
+        {
+            addQueuedSize( outbound.size() );
+            m_writeQueue.push_back( OutboundMessage{ {}, std::move(outbound) } );
+        }
+    }
+
+    // hot restart: 'start()' of a restored session (no greeting; the handed over requests are handled first)
+    void continueSession()
+    {
+        if ( m_captureWriter != nullptr )
+        {
+            m_captureWriter->write( m_sessionId, capture::crt_open );
+        }
+
+        if ( ! m_socket.is_open() )
+        {
+            return;
+        }
+
+        touchIdleTimer();
+        resumeIo();
+    }
+
+    // moves the session to the io thread of 'home': the session is paused (as for hot restart), then its socket
+    // and armed timers are transferred; 'onArrived' is called on the new thread (false -> the session stays paused);
+    // must be called on the session's io thread
+    void migrate( SessionHome home, std::function<bool()> onArrived )
+    {
+        if ( m_isPaused || m_isDetached || m_isSocketReleased || ! m_socket.is_open() || homeContext() == &home.m_context )
+        {
+            return;
+        }
+
+        pause( [this,home,onArrived=std::move(onArrived)] () mutable
+        {
+            std::vector<std::pair<uint8_t,TimerWheel::Clock::duration>> timers;
+            for( uint8_t kind=0; kind<timerNumber(); kind++ )
+            {
+                if ( auto remaining = m_timerWheel->release( timer(kind) ); remaining )
+                {
+                    timers.emplace_back( kind, *remaining );
+                }
+            }
+
+            boost::system::error_code ec;
+            auto protocol = m_socket.local_endpoint( ec ).protocol();
+            int nativeSocket = m_socket.release( ec );
+
+            // from here the session belongs to the new io thread: its handlers (and 'enqueue()') run there,
+            // messages are queued until 'arrive()' assigns the socket
+            auto self = shared_from_this();
+            m_homeContext.store( &home.m_context, std::memory_order_release );
+
+            boost::asio::post( home.m_context, [self,home,protocol,nativeSocket,timers=std::move(timers),onArrived=std::move(onArrived)]
+            {
+                self->arrive( home, protocol, nativeSocket, timers, onArrived );
+            });
+        });
+    }
+
+    // called on the session's io thread when the outbound queue drained below the low watermark
+    // after some lobby updates were dropped
+    virtual void onLobbyUpdatesDropped() {}
+
+    // message type index for metrics ('frame' is ';'-terminated or not)
+    virtual size_t messageTypeIndex( std::string_view frame ) const { return 0; }
+
+    // must be called before 'start()'
+    void setOutboundLimits( const OutboundLimits& limits ) { m_outboundLimits = limits; }
+
+    // must be called before 'start()'
+    void setQuickAck( bool isQuickAck ) { m_isQuickAck = isQuickAck; }
+    
+    // reads from the socket into the persistent receive buffer
+    // and passes every complete ';'-terminated frame to 'onMessage'
+    void read()
+    {
+#ifdef TCP_SERVER_IO_URING
+        // one multishot receive serves the session until it ends (see 'onUringReceive()')
+        m_receiveOperation.m_self = shared_from_this();
+        m_ring->receiveMultishot( m_socket.native_handle(), m_receiveOperation );
+#else
+        // the receive buffer is taken only when the socket is readable: an idle connection waits without one;
+        // the socket is read until 'would_block' (the reactor is edge-triggered)
+        boost::system::error_code ec;
+        if ( ! m_socket.non_blocking() )
+        {
+            m_socket.non_blocking( true, ec );
+        }
+
+        auto buffer = m_receiveBuffer.prepare();
+        if ( buffer.size() == 0 )
+        {
+            LOG_ERR( "TcpClientSession request is too long" );
+            closeSocket();
+            captureClose();
+            connectionLost( boost::asio::error::message_size );
+            return;
+        }
+
+        size_t dataSize = m_socket.read_some( buffer, ec );
+        if ( ec == boost::asio::error::would_block )
+        {
+            m_receiveBuffer.trim();
+            m_isReading = true;
+            m_socket.async_wait( boost::asio::ip::tcp::socket::wait_read, [self=shared_from_this()] ( auto error )
+            {
+                self->onReadable( error );
+            });
+            return;
+        }
+        if ( ec )
+        {
+            onReadError( ec );
+            return;
+        }
+
+        m_receiveBuffer.commit( dataSize );
+        onDataReceived();
+
+        // the next read runs after the other handlers of the thread
+        m_isReading = true;
+        boost::asio::post( m_socket.get_executor(), [self=shared_from_this()]
+        {
+            self->onReadable( {} );
+        });
+#endif
+    }
+
+    // can be called from any thread:
+    // the message is queued on the session's own io thread and sent in order;
+    // all messages queued while a write is in flight are sent by the next single 'async_write'
+    //
+    // (messages issued in some order by different threads are queued in the same order: the session's own thread
+    // queues directly only when no message of another thread is waiting in 'm_postedMessages', see 'enqueue()')
+    void write( std::string message )
+    {
+        enqueue( OutboundMessage{ {}, std::move(message) } );
+    }
+
+    // message serialized once for many sessions
+    void write( std::shared_ptr<const std::string> message )
+    {
+        enqueue( OutboundMessage{ std::move(message), {} } );
+    }
+
+    // shared prefix + own tail (sent by one 'writev')
+    void write( std::shared_ptr<const std::string> prefix, std::string tail )
+    {
+        enqueue( OutboundMessage{ std::move(prefix), std::move(tail) } );
+    }
+
+    // lobby update or snapshot with its lobby sequence number: sent after the queued game messages,
+    // superseded by a newer queued snapshot, dropped when the peer does not read (see OutboundLimits)
+    void writeLobbyUpdate( std::shared_ptr<const std::string> message, uint64_t sequence, bool isSnapshot = false )
+    {
+        enqueue( OutboundMessage{ std::move(message), {}, true, isSnapshot, sequence } );
+    }
+
+    // runs 'func' on the session's io thread
+    template<class FuncT>
+    void runInSessionThread( FuncT&& func )
+    {
+        postHome( shared_from_this(), std::forward<FuncT>(func) );
+    }
+
+private:
+#ifndef TCP_SERVER_IO_URING
+    void onReadable( boost::system::error_code error )
+    {
+        m_isReading = false;
+        if ( m_isPaused )
+        {
+            // (the data is left in the socket)
+            checkPaused();
+            return;
+        }
+
+        if ( error )
+        {
+            onReadError( error );
+            return;
+        }
+        read();
+    }
+#endif
+
+    void onDataReceived()
+    {
+        touchIdleTimer();
+        if ( m_isQuickAck && m_socket.is_open() )
+        {
+            int isOn = 1;
+            setsockopt( m_socket.native_handle(), IPPROTO_TCP, TCP_QUICKACK, &isOn, sizeof(isOn) );
+        }
+
+        // (a paused session hands the rest over unhandled)
+        std::string_view request;
+        while ( ! m_isPaused && m_receiveBuffer.nextFrame( request ) )
+        {
+            LOG_DBG( "TcpClientSession read request: " << request );
+            metrics::messageIn( messageTypeIndex( request ), request.size()+1 );
+            if ( m_captureWriter != nullptr )
+            {
+                m_captureWriter->write( m_sessionId, capture::crt_frame, request );
+            }
+
+            metrics::HandlerTimer timer;
+            onMessage( request );
+        }
+        m_receiveBuffer.trim();
+    }
+
+    void onReadError( boost::system::error_code error )
+    {
+        if ( m_isSocketReleased )
+        {
+            // the connection continues elsewhere
+            captureClose();
+            return;
+        }
+
+        LOG_ERR( "TcpClientSession read error: " << error.message() );
+        if ( error != boost::asio::error::eof )
+        {
+            metrics::count( metrics::c_read_errors );
+        }
+        captureClose();
+        connectionLost( error );
+    }
+
+    // 'shutdown' first: reads and writes in flight (also io_uring ones) complete at once
+    void closeSocket()
+    {
+        boost::system::error_code ec;
+        m_socket.shutdown( boost::asio::ip::tcp::socket::shutdown_both, ec );
+        m_socket.close( ec );
+    }
+
+    // (a handler posted by the session's own thread goes to its thread-private queue and can run after
+    // a handler posted later by another thread, so the order is kept by 'm_postedMessages', not by the io_context)
+    void enqueue( OutboundMessage&& message )
+    {
+        bool isDirect = homeContext()->get_executor().running_in_this_thread();
+        {
+            std::lock_guard<std::mutex> lock( m_postedMessageMutex );
+            isDirect = isDirect && m_postedMessages.empty() && ! m_isDrainingPostedMessages;
+            if ( ! isDirect )
+            {
+                m_postedMessages.push_back( std::move(message) );
+                if ( m_postedMessages.size() > 1 )
+                {
+                    // the drain is already posted
+                    return;
+                }
+            }
+        }
+
+        if ( isDirect )
+        {
+            // (e.g. a relay between the players of a game, see TcpServer::coLocateSession())
+            pushOutboundMessage( std::move(message) );
+            return;
+        }
+
+        postHome( shared_from_this(), [self=shared_from_this()] { self->drainPostedMessages(); } );
+    }
+
+    void drainPostedMessages()
+    {
+        std::vector<OutboundMessage> messages;
+        m_isDrainingPostedMessages = true;
+        for(;;)
+        {
+            {
+                std::lock_guard<std::mutex> lock( m_postedMessageMutex );
+                if ( m_postedMessages.empty() )
+                {
+                    break;
+                }
+                messages.swap( m_postedMessages );
+            }
+
+            for( auto& message : messages )
+            {
+                pushOutboundMessage( std::move(message) );
+            }
+            messages.clear();
+        }
+        m_isDrainingPostedMessages = false;
+    }
+
+    // a handler that arrives at the previous io thread of a migrated session is forwarded
+    template<class FuncT>
+    static void postHome( std::shared_ptr<TcpClientSession> self, FuncT func )
+    {
+        auto* home = self->homeContext();
+        boost::asio::post( *home, [self=std::move(self),home,func=std::move(func)] () mutable
+        {
+            if ( self->homeContext() != home )
+            {
+                postHome( std::move(self), std::move(func) );
+                return;
+            }
+            func();
+        });
+    }
+
+    // 'migrate()' on the new io thread
+    void arrive( SessionHome home, boost::asio::ip::tcp protocol, int nativeSocket,
+                 const std::vector<std::pair<uint8_t,TimerWheel::Clock::duration>>& timers, const std::function<bool()>& onArrived )
+    {
+        m_timerWheel = &home.m_timerWheel;
+#ifdef TCP_SERVER_IO_URING
+        m_ring = &home.m_ring;
+#endif
+        for( const auto& [kind,remaining] : timers )
+        {
+            m_timerWheel->arm( timer(kind), *this, kind, remaining );
+        }
+
+        boost::system::error_code ec;
+        m_socket = boost::asio::ip::tcp::socket( home.m_context );
+        m_socket.assign( protocol, nativeSocket, ec );
+        if ( ec )
+        {
+            LOG_ERR( "TcpClientSession migration error: " << ec.message() );
+            ::close( nativeSocket );
+            m_isPaused = false;
+            captureClose();
+            connectionLost( ec );
+            return;
+        }
+
+        if ( ! onArrived() )
+        {
+            return;
+        }
+        m_isPaused = false;
+        resumeIo();
+    }
+
+    // after a pause: the queued messages are sent, the received requests are handled
+    void resumeIo()
+    {
+        if ( hasQueuedMessages() && ! m_isWriting )
+        {
+            writeQueuedMessages();
+        }
+        onDataReceived();
+        if ( m_socket.is_open() )
+        {
+            read();
+        }
+    }
+
+    void checkPaused()
+    {
+#ifdef TCP_SERVER_IO_URING
+        bool isReading = m_receiveOperation.isInFlight();
+#else
+        bool isReading = m_isReading;
+#endif
+        if ( m_onPaused && ! isReading && ! m_isWriting )
+        {
+            auto onPaused = std::move(m_onPaused);
+            m_onPaused = nullptr;
+            onPaused();
+        }
+    }
+
+    void pushOutboundMessage( OutboundMessage&& message )
+    {
+        if ( m_isOverflowed && message.m_isLobbyUpdate )
+        {
+            countDropped( message );
+            return;
+        }
+        if ( message.m_isLobbyUpdate && isSupersededLobbyUpdate( message ) )
+        {
+            metrics::count( metrics::c_collapsed_lobby_updates );
+            return;
+        }
+
+        // (a paused session keeps queuing: e.g. a migrating one has no socket until 'arrive()', then 'resumeIo()' sends)
+        if ( ! m_socket.is_open() && ! m_isDetached && ! m_isPaused )
+        {
+            return;
+        }
+
+        metrics::messageOut( messageTypeIndex( message.m_sharedData ? *message.m_sharedData : message.m_data ), message.size() );
+
+        addQueuedSize( message.size() );
+        if ( message.m_isLobbyUpdate )
+        {
+            m_lobbyQueue.push_back( std::move(message) );
+        }
+        else
+        {
+            m_writeQueue.push_back( std::move(message) );
+        }
+        metrics::record( metrics::h_queue_depth, m_writeQueue.size() + m_lobbyQueue.size() );
+
+        if ( m_queuedSize > m_outboundLimits.m_highWatermark )
+        {
+            onHighWatermark();
+        }
+        else if ( ! m_isWriting && m_socket.is_open() && ! m_isPaused )
+        {
+            writeQueuedMessages();
+        }
+    }
+
+    void onHighWatermark()
+    {
+        if ( ! m_isOverflowed )
+        {
+            gBackPressureCounters.m_overflowNumber.fetch_add( 1, std::memory_order_relaxed );
+        }
+
+        if ( m_outboundLimits.m_overflowPolicy == op_drop_lobby_updates )
+        {
+            m_isOverflowed = true;
+
+            // not in flight lobby updates are superseded by the snapshot sent after resynchronization
+            for( const auto& message : m_lobbyQueue )
+            {
+                countDropped( message );
+                removeQueuedSize( message.size() );
+            }
+            m_lobbyQueue.clear();
+            m_lobbySnapshotSequence.reset();
+
+            if ( m_queuedSize <= m_outboundLimits.m_highWatermark )
+            {
+                if ( ! m_isWriting && hasQueuedMessages() && m_socket.is_open() && ! m_isPaused )
+                {
+                    writeQueuedMessages();
+                }
+                return;
+            }
+        }
+
+        // the peer is stuck: the pending read fails and calls 'connectionLost()'
+        LOG_ERR( "TcpClientSession evicted (slow consumer): " << this << " queued bytes: " << m_queuedSize );
+        gBackPressureCounters.m_evictedSessionNumber.fetch_add( 1, std::memory_order_relaxed );
+
+        for( const auto& message : m_writeQueue )
+        {
+            removeQueuedSize( message.size() );
+        }
+        for( const auto& message : m_lobbyQueue )
+        {
+            removeQueuedSize( message.size() );
+        }
+        m_writeQueue.clear();
+        m_lobbyQueue.clear();
+        closeSocket();
+    }
+
+    // a lobby update older than a queued (or already sent) snapshot is ignored by the peer anyway;
+    // a new snapshot removes the queued lobby updates it supersedes
+    bool isSupersededLobbyUpdate( const OutboundMessage& message )
+    {
+        if ( m_lobbySnapshotSequence && message.m_lobbySequence <= *m_lobbySnapshotSequence )
+        {
+            return true;
+        }
+        if ( ! message.m_isSnapshot )
+        {
+            return false;
+        }
+
+        m_lobbySnapshotSequence = message.m_lobbySequence;
+        auto end = std::remove_if( m_lobbyQueue.begin(), m_lobbyQueue.end(), [this,&message] ( const auto& queued )
+        {
+            if ( queued.m_lobbySequence <= message.m_lobbySequence )
+            {
+                metrics::count( metrics::c_collapsed_lobby_updates );
+                removeQueuedSize( queued.size() );
+                return true;
+            }
+            return false;
+        });
+        m_lobbyQueue.erase( end, m_lobbyQueue.end() );
+        return false;
+    }
+
+    bool hasQueuedMessages() const { return ! m_writeQueue.empty() || ! m_lobbyQueue.empty(); }
+
+    static void countDropped( const OutboundMessage& message )
+    {
+        gBackPressureCounters.m_droppedMessageNumber.fetch_add( 1, std::memory_order_relaxed );
+        gBackPressureCounters.m_droppedByteNumber.fetch_add( message.size(), std::memory_order_relaxed );
+    }
+
+    static uint32_t nextSessionId()
+    {
+        static std::atomic<uint32_t> lastSessionId{0};
+        return ++lastSessionId;
+    }
+
+    void captureClose()
+    {
+        if ( m_captureWriter != nullptr )
+        {
+            m_captureWriter->write( m_sessionId, capture::crt_close );
+        }
+    }
+
+    void touchIdleTimer()
+    {
+        if ( m_timerWheel != nullptr && m_idleTimeout.count() > 0 )
+        {
+            m_timerWheel->arm( m_idleTimer, *this, tk_idle, m_idleTimeout );
+        }
+    }
+
+    void addQueuedSize( size_t size )
+    {
+        m_queuedSize += size;
+        metrics::changeQueuedBytes( int64_t(size) );
+    }
+
+    void removeQueuedSize( size_t size )
+    {
+        m_queuedSize -= size;
+        metrics::changeQueuedBytes( -int64_t(size) );
+    }
+
+    void writeQueuedMessages()
+    {
+        m_isWriting = true;
+
+        m_writeBatch.swap( m_writeQueue );
+
+        // lobby updates after the game messages, limited per write
+        // (so a game message queued meanwhile is not stuck behind a long lobby backlog)
+        size_t lobbySize = 0;
+        auto lobbyEnd = m_lobbyQueue.begin();
+        while ( lobbyEnd != m_lobbyQueue.end()
+                && ( lobbySize == 0 || lobbySize + lobbyEnd->size() <= m_outboundLimits.m_maxLobbyBatchSize ) )
+        {
+            lobbySize += lobbyEnd->size();
+            ++lobbyEnd;
+        }
+        std::move( m_lobbyQueue.begin(), lobbyEnd, std::back_inserter( m_writeBatch ) );
+        m_lobbyQueue.erase( m_lobbyQueue.begin(), lobbyEnd );
+
+        m_writeBuffers.clear();
+        for( const auto& message : m_writeBatch )
+        {
+            if ( message.m_sharedData )
+            {
+                m_writeBuffers.push_back( boost::asio::buffer( *message.m_sharedData ) );
+            }
+            if ( ! message.m_data.empty() )
+            {
+                m_writeBuffers.push_back( boost::asio::buffer( message.m_data ) );
+            }
+        }
+
+#ifdef TCP_SERVER_IO_URING
+        m_sendBufferIndex = 0;
+        m_sentSize = 0;
+        sendLinked();
+    }
+
+    // sends the rest of 'm_writeBuffers' by a chain of linked sends
+    void sendLinked()
+    {
+        auto begin = m_writeBuffers.begin() + m_sendBufferIndex;
+        auto end = begin + std::min( m_writeBuffers.size() - m_sendBufferIndex, IoUring::MAX_LINKED_SEND_NUMBER );
+
+        m_sendOperation.m_self = shared_from_this();
+        m_ring->sendLinked( m_socket.native_handle(), begin, end, m_sendOperation );
+    }
+
+    // one completion per send of the chain (in order)
+    void onUringSend( int result, uint32_t flags )
+    {
+        if ( result >= 0 )
+        {
+            m_chainSentSize += size_t(result);
+        }
+        else if ( result != -ECANCELED && m_chainError == 0 )
+        {
+            // sends after a failed or short one are canceled
+            m_chainError = -result;
+        }
+
+        if ( m_sendOperation.isInFlight() )
+        {
+            return;
+        }
+        auto self = std::move( m_sendOperation.m_self );
+
+        m_sentSize += m_chainSentSize;
+        for( auto size = m_chainSentSize; size > 0; )
+        {
+            auto& buffer = m_writeBuffers[m_sendBufferIndex];
+            if ( size < buffer.size() )
+            {
+                buffer += size;
+                break;
+            }
+            size -= buffer.size();
+            m_sendBufferIndex++;
+        }
+        m_chainSentSize = 0;
+
+        boost::system::error_code error;
+        if ( m_chainError != 0 )
+        {
+            error.assign( m_chainError, boost::system::system_category() );
+            m_chainError = 0;
+        }
+        else if ( m_sendBufferIndex < m_writeBuffers.size() )
+        {
+            if ( m_socket.is_open() && ! m_isPaused )
+            {
+                sendLinked();
+                return;
+            }
+            error = m_isPaused ? boost::asio::error::operation_aborted : boost::asio::error::bad_descriptor;
+        }
+
+        onWriteCompleted( error, m_sentSize );
+    }
+
+    void onUringReceive( int result, uint32_t flags )
+    {
+        if ( result > 0 )
+        {
+            // the provided buffer is returned to the ring at once
+            const char* data = m_ring->bufferData( flags );
+            for( size_t offset = 0; offset < size_t(result) && m_socket.is_open(); )
+            {
+                auto buffer = m_receiveBuffer.prepare();
+                if ( buffer.size() == 0 )
+                {
+                    LOG_ERR( "TcpClientSession request is too long" );
+                    closeSocket();
+                    break;
+                }
+
+                auto size = std::min( buffer.size(), size_t(result) - offset );
+                std::memcpy( buffer.data(), data+offset, size );
+                offset += size;
+
+                m_receiveBuffer.commit( size );
+                if ( ! m_isPaused )
+                {
+                    onDataReceived();
+                }
+            }
+            m_ring->releaseBuffer( flags );
+        }
+
+        if ( m_receiveOperation.isInFlight() )
+        {
+            return;
+        }
+        auto self = std::move( m_receiveOperation.m_self );
+
+        if ( m_isPaused )
+        {
+            // hot restart: the received data is handed over unhandled
+            checkPaused();
+            return;
+        }
+
+        // multishot receive ended: it is restarted unless the connection is lost
+        // (-ENOBUFS: all provided buffers were in use)
+        if ( ( result > 0 || result == -ENOBUFS ) && m_socket.is_open() )
+        {
+            read();
+            return;
+        }
+
+        boost::system::error_code error = boost::asio::error::operation_aborted;
+        if ( result == 0 )
+        {
+            error = boost::asio::error::eof;
+        }
+        else if ( result < 0 )
+        {
+            error.assign( -result, boost::system::system_category() );
+        }
+        onReadError( error );
+    }
+#else
+        boost::asio::async_write( m_socket, m_writeBuffers, [self=shared_from_this()] ( auto error, auto sentSize )
+        {
+            self->onWriteCompleted( error, sentSize );
+        });
+    }
+#endif
+
+    void onWriteCompleted( boost::system::error_code error, size_t sentSize )
+    {
+        if ( m_isPaused )
+        {
+            // hot restart: the rest of the canceled batch is handed over
+            std::string unsent;
+            for( const auto& message : m_writeBatch )
+            {
+                auto offset = std::min( sentSize, message.size() );
+                sentSize -= offset;
+                message.appendTo( unsent, offset );
+                removeQueuedSize( message.size() );
+            }
+            m_writeBatch.clear();
+            if ( ! unsent.empty() )
+            {
+                addQueuedSize( unsent.size() );
+                m_writeQueue.insert( m_writeQueue.begin(), OutboundMessage{ {}, std::move(unsent) } );
+            }
+            m_isWriting = false;
+            checkPaused();
+            return;
+        }
+
+        if (error)
+        {
+            LOG_ERR( "TcpClientSession write error: " << error.message() );
+            metrics::count( metrics::c_write_errors );
+
+            // only the batch is lost: queued messages are kept for a resumed connection (see 'attachSocket()')
+            for( const auto& message : m_writeBatch )
+            {
+                removeQueuedSize( message.size() );
+            }
+            m_writeBatch.clear();
+            m_isWriting = false;
+            return;
+        }
+
+        m_writeBatch.clear();
+        removeQueuedSize( sentSize );
+        if ( m_isOverflowed && m_queuedSize <= m_outboundLimits.m_lowWatermark )
+        {
+            m_isOverflowed = false;
+            onLobbyUpdatesDropped();
+        }
+
+        if ( ! hasQueuedMessages() || ! m_socket.is_open() )
+        {
+            m_isWriting = false;
+        }
+        else
+        {
+            writeQueuedMessages();
+        }
+    }
+};
+
+// TcpServer - accepts connections on the calling thread of 'run()'
+// and spreads accepted sockets (round-robin) over a pool of io workers,
+// each worker is an io_context served by its own thread
+//
+class TcpServer
+{
+    struct IoWorker
     {
-        m_request.clear();
-        
-        boost::asio::async_read_until( m_socket, boost::asio::dynamic_buffer(m_request), ';',
-            [self=shared_from_this()] ( auto error, size_t dataSize )
+        boost::asio::io_context                                                  m_context;
+        boost::asio::executor_work_guard<boost::asio::io_context::executor_type> m_workGuard;
+        std::thread                                                              m_thread;
+
+        TimerWheel                                                               m_timerWheel;
+
+        // sessions of the worker (for hot restart; accessed only on the worker thread),
+        // expired items are pruned when the vector doubles
+        std::vector<std::weak_ptr<TcpClientSession>>                             m_sessions;
+        size_t                                                                   m_prunedSessionNumber = 0;
+
+        // hot restart: a paused session has no io in flight that would keep it alive
+        std::vector<std::shared_ptr<TcpClientSession>>                           m_pausedSessions;
+        bool                                                                     m_isHandingOver = false;
+
+        void addSession( const std::shared_ptr<TcpClientSession>& session )
         {
-            if ( error )
+            if ( m_sessions.size() >= 2*m_prunedSessionNumber + 64 )
             {
-                LOG_ERR( "TcpClientSession read error: " << error.message() );
-                self->connectionLost( error );
-                return;
+                auto end = std::remove_if( m_sessions.begin(), m_sessions.end(), [] ( const auto& item ) { return item.expired(); } );
+                m_sessions.erase( end, m_sessions.end() );
+                m_prunedSessionNumber = m_sessions.size();
             }
-            
-            LOG( "TcpClientSession read request: " << self->m_request );
-            
-            self->m_request.pop_back();
-            self->onMessage( self->m_request );
-        });
-    }
+            m_sessions.push_back( session );
+        }
 
-    void write( const std::string& response )
-    {
-        m_socket.async_send( boost::asio::mutable_buffer( (void*)response.c_str(), response.size() ),
-            [self=shared_from_this()] ( auto error, auto sentSize )
+        // (a migrated session is listed by each worker it has been on)
+        std::vector<std::shared_ptr<TcpClientSession>> liveSessions()
         {
-            if (error)
+            std::vector<std::shared_ptr<TcpClientSession>> sessions;
+            for( const auto& item : m_sessions )
             {
-                LOG_ERR( "TcpClientSession async_send error: " << error.message() );
+                if ( auto session = item.lock(); session && session->homeContext() == &m_context )
+                {
+                    sessions.push_back( std::move(session) );
+                }
             }
-        });
-    }
-};
+            std::sort( sessions.begin(), sessions.end() );
+            sessions.erase( std::unique( sessions.begin(), sessions.end() ), sessions.end() );
+            return sessions;
+        }
+
+        SessionHome home()
+        {
+#ifdef TCP_SERVER_IO_URING
+            return SessionHome{ m_context, m_timerWheel, m_ring };
+#else
+            return SessionHome{ m_context, m_timerWheel };
+#endif
+        }
+
+#ifdef TCP_SERVER_IO_URING
+        IoUring                                                                  m_ring;
+
+        // concurrency hint 1: each io_context is served by exactly one thread
+        IoWorker() : m_context(1), m_workGuard( m_context.get_executor() ), m_timerWheel( m_context ), m_ring( m_context ) {}
+#else
+        // concurrency hint 1: each io_context is served by exactly one thread
+        IoWorker() : m_context(1), m_workGuard( m_context.get_executor() ), m_timerWheel( m_context ) {}
+#endif
+    };
+
+#ifdef TCP_SERVER_IO_URING
+    // multishot accept on the acceptor thread
+    struct AcceptOperation : IoUringOperation
+    {
+        TcpServer& m_server;
+
+        AcceptOperation( TcpServer& server ) : m_server( server ) {}
+
+        void onCompletion( int result, uint32_t flags ) override { m_server.onUringAccept( result, flags ); }
+    };
+#endif
 
-class TcpServer
-{
     boost::asio::io_context                         m_context;
     boost::asio::ip::tcp::endpoint                  m_endpoint;
     std::optional<boost::asio::ip::tcp::acceptor>   m_acceptor;
 
-    boost::asio::ip::tcp::socket     m_socket;
+    std::vector<std::unique_ptr<IoWorker>>          m_ioWorkers;
+    size_t                                          m_nextWorkerIndex = 0;
+
+    OutboundLimits                                  m_outboundLimits;
+    SocketOptions                                   m_socketOptions;
+    std::chrono::milliseconds                       m_idleTimeout{0};     // opt-in: the bundled clients send no keepalive
+
+    std::optional<metrics::MetricsEndpoint>         m_metricsEndpoint;
+    std::unique_ptr<capture::CaptureWriter>         m_captureWriter;
+
+#ifdef TCP_SERVER_IO_URING
+    AcceptOperation                                 m_acceptOperation{ *this };
+    std::optional<IoUring>                          m_acceptorRing;
+#endif
+
+    // hot restart (acceptor thread): a new process takes over (see HotRestart.h)
+    using HotRestartAcceptor = boost::asio::basic_socket_acceptor<boost::asio::generic::seq_packet_protocol>;
+    std::optional<HotRestartAcceptor>               m_hotRestartAcceptor;
+    int                                             m_successorChannel = -1;
+    bool                                            m_isAcceptStopped = false;
+    std::atomic<size_t>                             m_pausingSessionNumber{0};
+    size_t                                          m_collectingWorkerNumber = 0;
+    bool                                            m_isCollectingStarted = false;
+    std::vector<hot_restart::SessionState>          m_handedOverSessions;
+    std::optional<boost::asio::steady_timer>        m_handOverTimer;
 
 public:
-    TcpServer( const std::string& addr, const std::string& port )
+    // sessions that are not paused until the deadline are dropped by hot restart
+    static constexpr std::chrono::seconds HOT_RESTART_PAUSE_TIMEOUT{5};
+
+    // 'ioThreadNumber' == 0 -> one io thread per core;
+    // 'listenSocket' >= 0 -> listening socket inherited by hot restart (instead of binding 'addr')
+    TcpServer( const std::string& addr, const std::string& port, size_t ioThreadNumber = 0, int listenSocket = -1,
+               const SocketOptions& socketOptions = {} )
       :
-        m_context(),
-        m_socket(m_context)
+        m_context(1),
+        m_socketOptions( socketOptions )
     {
+        if ( ioThreadNumber == 0 )
+        {
+            ioThreadNumber = std::max( 1u, std::thread::hardware_concurrency() );
+        }
+
         try
         {
+            for( size_t i=0; i<ioThreadNumber; i++ )
+            {
+                m_ioWorkers.push_back( std::make_unique<IoWorker>() );
+            }
+#ifdef TCP_SERVER_IO_URING
+            // the acceptor ring needs no provided buffers
+            m_acceptorRing.emplace( m_context, 64, 0 );
+#endif
+
             boost::asio::ip::tcp::resolver resolver(m_context);
             m_endpoint = *resolver.resolve( addr, port ).begin();
 
-            m_acceptor = boost::asio::ip::tcp::acceptor( m_context, m_endpoint );
+            if ( listenSocket >= 0 )
+            {
+                m_acceptor.emplace( m_context );
+                m_acceptor->assign( m_endpoint.protocol(), listenSocket );
+                setListenerOptions();
+            }
+            else
+            {
+                // (the options of the listener are set before 'bind')
+                m_acceptor.emplace( m_context );
+                m_acceptor->open( m_endpoint.protocol() );
+                m_acceptor->set_option( boost::asio::ip::tcp::acceptor::reuse_address(true) );
+                setListenerOptions();
+                m_acceptor->bind( m_endpoint );
+                m_acceptor->listen();
+            }
         }
         catch( std::runtime_error& e ) {
             LOG("TcpServer exception: " << e.what() )
@@ -93,41 +1403,543 @@ public:
             exit(0);
         }
     }
-    
+
+    virtual ~TcpServer()
+    {
+        shutdown();
+        joinIoThreads();
+    }
+
+    size_t ioThreadNumber() const { return m_ioWorkers.size(); }
+
+    // applied to sessions accepted after the call
+    void setOutboundLimits( const OutboundLimits& limits ) { m_outboundLimits = limits; }
+
+    // connection without incoming data during 'timeout' is closed (0 -> never, the default);
+    // applied to sessions accepted after the call
+    void setIdleTimeout( std::chrono::milliseconds timeout ) { m_idleTimeout = timeout; }
+
+    // inbound frames of sessions accepted after the call are written to 'path' (see Capture.h);
+    // must be called before 'run()'
+    bool startCapture( const std::string& path )
+    {
+        m_captureWriter = std::make_unique<capture::CaptureWriter>( path );
+        return m_captureWriter->isOpen();
+    }
+
+    // metrics are served (as plain text) by the acceptor thread; must be called before 'run()'
+    void startMetricsEndpoint( const std::string& addr, const std::string& port )
+    {
+        m_metricsEndpoint.emplace( m_context, addr, port, [this] ( std::ostream& out ) { writeMetrics( out ); } );
+    }
+
+    // io_context of the acceptor thread (for endpoints and links served by it)
+    boost::asio::io_context& acceptorContext() { return m_context; }
+
+    virtual void writeMetrics( std::ostream& out )
+    {
+        out << "io_threads " << m_ioWorkers.size() << "\n";
+
+        metrics::render( out, [this] ( size_t type ) { return messageTypeName( type ); } );
+
+        out << "outbound_overflows "       << gBackPressureCounters.m_overflowNumber.load() << "\n";
+        out << "outbound_dropped_messages " << gBackPressureCounters.m_droppedMessageNumber.load() << "\n";
+        out << "outbound_dropped_bytes "    << gBackPressureCounters.m_droppedByteNumber.load() << "\n";
+        out << "evicted_sessions "          << gBackPressureCounters.m_evictedSessionNumber.load() << "\n";
+    }
+
+    // name of message type index (see TcpClientSession::messageTypeIndex())
+    virtual std::string_view messageTypeName( size_t type ) const { return {}; }
+
     void run()
     {
+        for( auto& worker : m_ioWorkers )
+        {
+            if ( ! worker->m_thread.joinable() )
+            {
+                worker->m_thread = std::thread( [&context=worker->m_context] { context.run(); } );
+            }
+        }
+
         asyncAccept();
         m_context.run();
+
+        joinIoThreads();
     }
 
     void shutdown()
     {
+        if ( m_captureWriter )
+        {
+            m_captureWriter->flush();
+        }
+
         m_context.stop();
+        for( auto& worker : m_ioWorkers )
+        {
+            worker->m_context.stop();
+        }
     }
     
     void asyncAccept()
     {
-        m_acceptor->async_accept( m_socket, m_endpoint, [this] (auto errorCode)
+#ifdef TCP_SERVER_IO_URING
+        m_acceptorRing->acceptMultishot( m_acceptor->native_handle(), m_acceptOperation );
+#else
+        auto& worker = nextIoWorker();
+
+        m_acceptor->async_accept( worker.m_context, [this,&worker] ( auto errorCode, boost::asio::ip::tcp::socket socket )
         {
             if (errorCode)
             {
-                LOG_ERR( "async_accept error: " << errorCode.message() );
+                if ( ! m_isAcceptStopped )
+                {
+                    LOG_ERR( "async_accept error: " << errorCode.message() );
+                }
+            }
+            else if ( m_isAcceptStopped )
+            {
+                handOverAcceptedSocket( socket.release() );
             }
             else
             {
-                boost::asio::socket_base::keep_alive option(true);
-                m_socket.set_option(option);
-                
-                auto session = createSession( std::move(m_socket) );
-                session->start();
+                setConnectionOptions( socket.native_handle() );
+                startSession( worker, std::move(socket) );
                 asyncAccept();
             }
         });
+#endif
+    }
+
+    // serves already connected stream socket (e.g. one end of 'socketpair()') as accepted connection;
+    // can be called from any thread
+    void adoptSocket( int nativeSocket )
+    {
+        boost::asio::post( m_context, [this,nativeSocket]
+        {
+            auto& worker = nextIoWorker();
+            boost::asio::ip::tcp::socket socket( worker.m_context );
+            boost::system::error_code ec;
+            socket.assign( boost::asio::ip::tcp::v4(), nativeSocket, ec );
+            if ( ec )
+            {
+                LOG_ERR( "adoptSocket error: " << ec.message() );
+                return;
+            }
+            startSession( worker, std::move(socket) );
+        });
     }
     
-    virtual std::shared_ptr<TcpClientSession> createSession( boost::asio::ip::tcp::socket&& )
+    virtual std::shared_ptr<TcpClientSession> createSession( boost::asio::ip::tcp::socket&& socket )
     {
-        return std::make_shared<TcpClientSession>( std::move(m_socket) );
+        return std::make_shared<TcpClientSession>( std::move(socket) );
     }
-};
 
+    // moves 'session' to the io thread of 'partner' (e.g. the players of a game: their messages are relayed
+    // on one thread without posts); can be called from any thread
+    void coLocateSession( const std::shared_ptr<TcpClientSession>& session, const TcpClientSession& partner )
+    {
+        auto* partnerContext = partner.homeContext();
+        auto it = std::find_if( m_ioWorkers.begin(), m_ioWorkers.end(), [partnerContext] ( const auto& worker ) { return &worker->m_context == partnerContext; } );
+        if ( it == m_ioWorkers.end() || session->homeContext() == partnerContext )
+        {
+            return;
+        }
+
+        session->runInSessionThread( [session,&worker=**it]
+        {
+            session->migrate( worker.home(), [session,&worker]
+            {
+                metrics::count( metrics::c_migrated_sessions );
+                worker.addSession( session );
+                if ( worker.m_isHandingOver )
+                {
+                    worker.m_pausedSessions.push_back( session );
+                    return false;
+                }
+                return true;
+            });
+        });
+    }
+
+    // hot restart: a new process connecting to 'path' (see hot_restart::Inheritance) takes over
+    // the listening socket and the sessions, then 'run()' returns; must be called before 'run()'
+    void listenHotRestart( const std::string& path )
+    {
+        ::unlink( path.c_str() );
+        try
+        {
+            // (Unix domain SOCK_SEQPACKET)
+            boost::asio::generic::seq_packet_protocol::endpoint endpoint{ boost::asio::local::stream_protocol::endpoint( path ) };
+            m_hotRestartAcceptor.emplace( m_context, endpoint );
+        }
+        catch( boost::system::system_error& e )
+        {
+            LOG_ERR( "TcpServer hot restart: cannot listen on " << path << ": " << e.what() );
+            m_hotRestartAcceptor.reset();
+            return;
+        }
+
+        m_hotRestartAcceptor->async_accept( [this] ( auto error, boost::asio::generic::seq_packet_protocol::socket channel )
+        {
+            if ( error )
+            {
+                LOG_ERR( "TcpServer hot restart: accept error: " << error.message() );
+                return;
+            }
+
+            boost::system::error_code ec;
+            m_successorChannel = channel.release( ec );
+            handOver();
+        });
+    }
+
+    // hot restart: a session continued from the previous process
+    struct RestoredSession
+    {
+        std::shared_ptr<TcpClientSession>   m_session;
+        std::string                         m_state;        // of TcpClientSession::saveState()
+        bool                                m_isDetached;   // no connection (see TcpClientSession::detach())
+    };
+
+    // hot restart: continues the sessions handed over by the previous process; must be called before 'run()'
+    void restoreSessions( hot_restart::Inheritance& inheritance )
+    {
+        if ( inheritance.serverState().empty() && inheritance.sessionNumber() == 0 )
+        {
+            return;
+        }
+
+        std::vector<RestoredSession> restoredSessions;
+        std::vector<IoWorker*> workers;
+        for( auto& state : inheritance.takeSessions() )
+        {
+            auto& worker = nextIoWorker();
+            boost::asio::ip::tcp::socket socket( worker.m_context );
+            if ( state.m_socket >= 0 )
+            {
+                boost::system::error_code ec;
+                socket.assign( m_endpoint.protocol(), state.m_socket, ec );
+                if ( ec )
+                {
+                    LOG_ERR( "TcpServer hot restart: restore error: " << ec.message() );
+                    ::close( state.m_socket );
+                    continue;
+                }
+            }
+
+            auto session = createSession( std::move(socket) );
+            setUpSession( worker, *session );
+            session->restoreTransport( state.m_inbound, std::move(state.m_outbound) );
+            worker.addSession( session );
+
+            restoredSessions.push_back( RestoredSession{ session, std::move(state.m_appState), state.m_socket < 0 } );
+            workers.push_back( &worker );
+        }
+
+        restoreState( inheritance.serverState(), restoredSessions );
+
+        for( size_t i=0; i<restoredSessions.size(); i++ )
+        {
+            boost::asio::post( workers[i]->m_context, [session=restoredSessions[i].m_session] { session->continueSession(); } );
+        }
+    }
+
+    // hot restart: state of the derived server, taken when all sessions are paused (on the acceptor thread)
+    virtual std::string saveServerState() { return {}; }
+
+    // hot restart: the derived server restores its state and the state of its sessions
+    // (called before the restored sessions continue)
+    virtual void restoreState( std::string_view serverState, std::vector<RestoredSession>& sessions ) {}
+
+private:
+#ifdef TCP_SERVER_IO_URING
+    void onUringAccept( int result, uint32_t flags )
+    {
+        if ( result < 0 )
+        {
+            if ( ! m_isAcceptStopped )
+            {
+                LOG_ERR( "io_uring accept error: " << strerror(-result) );
+            }
+        }
+        else if ( m_isAcceptStopped )
+        {
+            handOverAcceptedSocket( result );
+        }
+        else
+        {
+            auto& worker = nextIoWorker();
+            boost::asio::ip::tcp::socket socket( worker.m_context );
+            boost::system::error_code ec;
+            socket.assign( m_endpoint.protocol(), result, ec );
+            if ( ec )
+            {
+                LOG_ERR( "io_uring accept error: " << ec.message() );
+                ::close( result );
+            }
+            else
+            {
+                setConnectionOptions( socket.native_handle() );
+                startSession( worker, std::move(socket) );
+            }
+        }
+
+        // multishot accept ended (e.g. on error): it is restarted
+        if ( ! m_acceptOperation.isInFlight() && ! m_isAcceptStopped )
+        {
+            asyncAccept();
+        }
+    }
+#endif
+
+    // failures are logged, the server continues without the option
+    void setListenerOptions()
+    {
+        auto setOption = [this] ( int level, int name, int value, const char* optionName )
+        {
+            if ( setsockopt( m_acceptor->native_handle(), level, name, &value, sizeof(value) ) < 0 )
+            {
+                LOG_ERR( "TcpServer cannot set " << optionName << ": " << strerror(errno) );
+            }
+        };
+
+        if ( m_socketOptions.m_isReusePort )
+        {
+            setOption( SOL_SOCKET, SO_REUSEPORT, 1, "SO_REUSEPORT" );
+        }
+        if ( m_socketOptions.m_receiveBufferSize > 0 )
+        {
+            setOption( SOL_SOCKET, SO_RCVBUF, m_socketOptions.m_receiveBufferSize, "SO_RCVBUF" );
+        }
+        if ( m_socketOptions.m_sendBufferSize > 0 )
+        {
+            setOption( SOL_SOCKET, SO_SNDBUF, m_socketOptions.m_sendBufferSize, "SO_SNDBUF" );
+        }
+        if ( m_socketOptions.m_deferAcceptSeconds > 0 )
+        {
+            setOption( IPPROTO_TCP, TCP_DEFER_ACCEPT, m_socketOptions.m_deferAcceptSeconds, "TCP_DEFER_ACCEPT" );
+        }
+    }
+
+    // (errors are ignored: the connection works with the system defaults)
+    void setConnectionOptions( int nativeSocket )
+    {
+        int isKeepAlive = m_socketOptions.m_isKeepAlive;
+        setsockopt( nativeSocket, SOL_SOCKET, SO_KEEPALIVE, &isKeepAlive, sizeof(isKeepAlive) );
+        int isNoDelay = m_socketOptions.m_isNoDelay;
+        setsockopt( nativeSocket, IPPROTO_TCP, TCP_NODELAY, &isNoDelay, sizeof(isNoDelay) );
+
+        if ( m_socketOptions.m_userTimeoutMs > 0 )
+        {
+            unsigned int timeout = m_socketOptions.m_userTimeoutMs;
+            setsockopt( nativeSocket, IPPROTO_TCP, TCP_USER_TIMEOUT, &timeout, sizeof(timeout) );
+        }
+    }
+
+    // must be called on the acceptor thread
+    void startSession( IoWorker& worker, boost::asio::ip::tcp::socket&& socket )
+    {
+        auto session = createSession( std::move(socket) );
+        setUpSession( worker, *session );
+
+        // session handlers must run on its own io thread
+        boost::asio::post( worker.m_context, [&worker,session]
+        {
+            worker.addSession( session );
+            session->start();
+        });
+    }
+
+    void setUpSession( IoWorker& worker, TcpClientSession& session )
+    {
+        metrics::count( metrics::c_accepted_connections );
+
+        session.setOutboundLimits( m_outboundLimits );
+        session.setQuickAck( m_socketOptions.m_isQuickAck );
+        session.setHomeContext( worker.m_context );
+        session.setTimerWheel( worker.m_timerWheel, m_idleTimeout );
+        session.setCaptureWriter( m_captureWriter.get() );
+#ifdef TCP_SERVER_IO_URING
+        session.setRing( worker.m_ring );
+#endif
+    }
+
+    // hot restart (acceptor thread):
+    //   1. accepting is stopped, all sessions are paused (no request is handled since)
+    //   2. the states of paused sessions are taken on their io threads
+    //   3. the listening socket, the server state and the sessions are sent to the successor, then the server stops
+    void handOver()
+    {
+        LOG( "TcpServer hot restart: handing over" );
+        m_hotRestartAcceptor.reset();
+
+        // the successor binds its own metrics endpoint
+        m_metricsEndpoint.reset();
+
+        m_isAcceptStopped = true;
+#ifdef TCP_SERVER_IO_URING
+        if ( m_acceptOperation.isInFlight() )
+        {
+            m_acceptorRing->cancel( m_acceptOperation );
+        }
+#else
+        boost::system::error_code ec;
+        m_acceptor->cancel( ec );
+#endif
+
+        // each worker holds one count until all its sessions are counted
+        m_pausingSessionNumber = m_ioWorkers.size();
+        for( auto& worker : m_ioWorkers )
+        {
+            boost::asio::post( worker->m_context, [this,&worker=*worker]
+            {
+                // (a session migrating here meanwhile stays paused, see 'coLocateSession()')
+                worker.m_isHandingOver = true;
+                worker.m_pausedSessions = worker.liveSessions();
+                m_pausingSessionNumber += worker.m_pausedSessions.size();
+                for( auto& session : worker.m_pausedSessions )
+                {
+                    session->pause( [this] { onSessionPaused(); } );
+                }
+                onSessionPaused();
+            });
+        }
+
+        m_handOverTimer.emplace( m_context, HOT_RESTART_PAUSE_TIMEOUT );
+        m_handOverTimer->async_wait( [this] ( auto error )
+        {
+            if ( ! error )
+            {
+                LOG_ERR( "TcpServer hot restart: not all sessions are paused in time (they are dropped)" );
+                collectSessions();
+            }
+        });
+    }
+
+    // can be called from any thread
+    void onSessionPaused()
+    {
+        if ( --m_pausingSessionNumber == 0 )
+        {
+            boost::asio::post( m_context, [this] { collectSessions(); } );
+        }
+    }
+
+    void collectSessions()
+    {
+        if ( m_isCollectingStarted )
+        {
+            return;
+        }
+        m_isCollectingStarted = true;
+
+        m_collectingWorkerNumber = m_ioWorkers.size();
+        for( auto& worker : m_ioWorkers )
+        {
+            boost::asio::post( worker->m_context, [this,&worker=*worker]
+            {
+                std::vector<hot_restart::SessionState> states;
+                for( auto& session : worker.m_pausedSessions )
+                {
+                    hot_restart::SessionState state;
+                    if ( session->handOver( state ) )
+                    {
+                        states.push_back( std::move(state) );
+                    }
+                }
+
+                boost::asio::post( m_context, [this,states=std::move(states)] () mutable
+                {
+                    std::move( states.begin(), states.end(), std::back_inserter( m_handedOverSessions ) );
+                    if ( --m_collectingWorkerNumber == 0 )
+                    {
+                        sendInheritance();
+                    }
+                });
+            });
+        }
+    }
+
+    void sendInheritance()
+    {
+        // (the pending timer kept 'run()' busy while the sessions were collected)
+        m_handOverTimer->cancel();
+
+        int channel = m_successorChannel;
+        int flags = fcntl( channel, F_GETFL );
+        fcntl( channel, F_SETFL, flags & ~O_NONBLOCK );
+
+        timeval timeout{ HOT_RESTART_PAUSE_TIMEOUT.count(), 0 };
+        setsockopt( channel, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout) );
+        int bufferSize = int( hot_restart::MAX_RECORD_SIZE );
+        setsockopt( channel, SOL_SOCKET, SO_SNDBUF, &bufferSize, sizeof(bufferSize) );
+
+        size_t sentNumber = 0;
+        if ( hot_restart::sendRecord( channel, hot_restart::hr_server, saveServerState(), m_acceptor->native_handle() ) )
+        {
+            for( auto& state : m_handedOverSessions )
+            {
+                // (a session that cannot be sent is dropped)
+                if ( hot_restart::sendRecord( channel, hot_restart::hr_session, hot_restart::serialize( state ), state.m_socket ) )
+                {
+                    sentNumber++;
+                }
+            }
+
+            hot_restart::RecordType type;
+            std::string payload;
+            int socket;
+            if ( hot_restart::sendRecord( channel, hot_restart::hr_end, {} ) && hot_restart::receiveRecord( channel, type, payload, socket ) )
+            {
+                LOG( "TcpServer hot restart: handed over sessions: " << sentNumber << " of " << m_handedOverSessions.size() );
+            }
+            else
+            {
+                LOG_ERR( "TcpServer hot restart: the successor did not confirm" );
+            }
+        }
+
+        for( auto& state : m_handedOverSessions )
+        {
+            if ( state.m_socket >= 0 )
+            {
+                ::close( state.m_socket );
+            }
+        }
+        m_handedOverSessions.clear();
+        ::close( channel );
+
+        shutdown();
+    }
+
+    // accepted after the hot restart is started: handed over as a new session
+    void handOverAcceptedSocket( int nativeSocket )
+    {
+        setConnectionOptions( nativeSocket );
+
+        hot_restart::SessionState state;
+        state.m_socket = nativeSocket;
+        state.m_outbound = "Hi;";
+        m_handedOverSessions.push_back( std::move(state) );
+    }
+
+    IoWorker& nextIoWorker()
+    {
+        auto& worker = *m_ioWorkers[m_nextWorkerIndex];
+        m_nextWorkerIndex = (m_nextWorkerIndex+1) % m_ioWorkers.size();
+        return worker;
+    }
+
+    void joinIoThreads()
+    {
+        for( auto& worker : m_ioWorkers )
+        {
+            if ( worker->m_thread.joinable() && worker->m_thread.get_id() != std::this_thread::get_id() )
+            {
+                worker->m_context.stop();
+                worker->m_thread.join();
+            }
+        }
+    }
+};
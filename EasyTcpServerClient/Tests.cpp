@@ -0,0 +1,1107 @@
+// TicTacTests - behaviour scenarios of TicTacServer (one ctest test per scenario and TcpServer backend, see CMakeLists.txt)
+//
+// Each scenario starts its own TicTacServer in the process (as STANDALONE_TEST of main.cpp) on its own port
+// and drives scripted TicTacClient players from the test thread: the players share one io_context,
+// which is run by 'runUntil()' between the steps of the scenario.
+// A failed check prints the scenario, the line and the messages received by the players.
+//
+// Usage:
+//   TicTacTests [scenario...]      (no scenario -> all)
+//
+
+#include "TicTacTcpServer.h"
+#include "TicTacClient.h"
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using namespace std::chrono_literals;
+
+constexpr const char* HOST = "127.0.0.1";
+
+// player that records all received messages; requests are sent by the scenario
+class TestPlayer : public tic_tac::TicTacClient
+{
+    // true -> messages are only recorded (no registration on "Hi"; the scenario writes raw messages)
+    bool                        m_isRaw = false;
+    bool                        m_isRegistered = false;
+    bool                        m_isResumed = false;
+
+public:
+    std::vector<std::string>    m_messages;
+
+    // called for every received message after it is recorded (e.g. an immediate answer)
+    std::function<void( TestPlayer&, std::string_view )>   m_onMessage;
+
+    TestPlayer( boost::asio::io_context& context, std::string playerName, bool isLobbySubscriber = true, bool isRaw = false )
+      : TicTacClient( context, playerName ),
+        m_isRaw( isRaw )
+    {
+        m_isLobbySubscriber = isLobbySubscriber;
+    }
+
+    const std::string& name() const { return m_playerName; }
+    bool isRegistered() const { return m_isRegistered; }
+    bool isResumed() const { return m_isResumed; }
+    const std::map<std::string,bool>& lobby() const { return m_availablePlayerList; }
+
+    // number of received messages of type 'messageType'
+    size_t count( std::string_view messageType ) const
+    {
+        size_t number = 0;
+        for( const auto& message : m_messages )
+        {
+            number += ( MessageTokens<1>( message )[0] == messageType );
+        }
+        return number;
+    }
+
+    // true -> 'message' is received
+    bool has( std::string_view message ) const
+    {
+        return std::find( m_messages.begin(), m_messages.end(), message ) != m_messages.end();
+    }
+
+    void invite( const std::string& partnerName ) { sendInvitaion( partnerName ); }
+    void accept( const std::string& partnerName ) { sendInvitaionResponse( partnerName, true ); }
+    void findGame() { sendFindGame(); }
+    void cancelFindGame() { sendCancelFindGame(); }
+    void watch( const std::string& playerName ) { sendWatch( playerName ); }
+    void step( const std::string& partnerName, const std::string& x_0, int x, int y ) { sendStep( partnerName, x_0, std::to_string(x), std::to_string(y) ); }
+    void closeGame( const std::string& partnerName ) { sendCloseGame( partnerName ); }
+    void gameEnded( const std::string& result ) { sendGameEnded( result ); }
+    void resumeConnection( const std::string& port ) { m_isResumed = false; reconnect( HOST, port ); }
+
+    void print() const
+    {
+        std::cerr << "  " << m_playerName << " received:" << std::endl;
+        for( const auto& message : m_messages )
+        {
+            std::cerr << "    " << message << std::endl;
+        }
+    }
+
+protected:
+    void onMessageReceived( std::string_view message ) override
+    {
+        m_messages.emplace_back( message );
+        if ( ! m_isRaw )
+        {
+            TicTacClient::onMessageReceived( message );
+        }
+        if ( m_onMessage )
+        {
+            m_onMessage( *this, message );
+        }
+    }
+
+    void onRegistered() override { m_isRegistered = true; }
+    void onResumed() override { m_isResumed = true; }
+    void onPlayerListChanged() override {}
+    void onInvitation( std::string ) override {}
+    void onAcceptedInvitation( std::string, bool ) override {}
+    void onPlayerOfflined( std::string ) override {}
+    void onPartnerStep( std::string, bool, int, int ) override {}
+};
+
+// waits until the port can be bound: a listener of the previous run can be released a bit later
+// (e.g. by the io_uring teardown), and TcpServer exits with 0 when the port is in use
+void waitForFreePort( const std::string& port )
+{
+    auto deadline = std::chrono::steady_clock::now() + 5s;
+    boost::asio::io_context context;
+    boost::asio::ip::tcp::endpoint endpoint( boost::asio::ip::make_address( HOST ), uint16_t( std::stoi( port ) ) );
+    for(;;)
+    {
+        boost::system::error_code ec;
+        boost::asio::ip::tcp::acceptor acceptor( context );
+        acceptor.open( endpoint.protocol(), ec );
+        acceptor.set_option( boost::asio::ip::tcp::acceptor::reuse_address(true), ec );
+        acceptor.bind( endpoint, ec );
+        if ( ! ec )
+        {
+            return;
+        }
+        if ( std::chrono::steady_clock::now() > deadline )
+        {
+            std::cerr << "port " << port << " is in use" << std::endl;
+            std::exit( 1 );
+        }
+        std::this_thread::sleep_for( 20ms );
+    }
+}
+
+// server of one scenario, run by its own thread
+class TestServer
+{
+    tic_tac::TicTacServer   m_server;
+    std::thread             m_thread;
+
+    static const std::string& freePort( const std::string& port, int listenSocket )
+    {
+        if ( listenSocket < 0 )
+        {
+            waitForFreePort( port );
+        }
+        return port;
+    }
+
+public:
+    // 'listenSocket' - of a hot restart (see hot_restart::Inheritance)
+    TestServer( const std::string& port, size_t ioThreadNumber = 1, int listenSocket = -1, const SocketOptions& socketOptions = {} )
+      : m_server( HOST, freePort( port, listenSocket ), ioThreadNumber, listenSocket, socketOptions ) {}
+
+    ~TestServer() { stop(); }
+
+    tic_tac::TicTacServer& operator*() { return m_server; }
+    tic_tac::TicTacServer* operator->() { return &m_server; }
+
+    void start()
+    {
+        m_thread = std::thread( [this] { m_server.run(); } );
+    }
+
+    void stop()
+    {
+        if ( m_thread.joinable() )
+        {
+            m_server.shutdown();
+            m_thread.join();
+        }
+    }
+};
+
+// runs the players' handlers until 'condition' is true (false -> timeout)
+bool runUntil( boost::asio::io_context& context, const std::function<bool()>& condition, std::chrono::milliseconds timeout = 5s )
+{
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    while ( ! condition() )
+    {
+        if ( std::chrono::steady_clock::now() > deadline )
+        {
+            return false;
+        }
+
+        context.run_one_for( 10ms );
+        if ( context.stopped() )
+        {
+            // no pending handlers
+            context.restart();
+            std::this_thread::sleep_for( 1ms );
+        }
+    }
+    return true;
+}
+
+// sum of 'counter' of all threads of the process (the in-process servers)
+uint64_t counterValue( metrics::Counter counter )
+{
+    uint64_t value = 0;
+    metrics::Registry::instance().forEach( [&] ( const metrics::ThreadMetrics& threadMetrics ) { value += threadMetrics.m_counters[counter].value(); } );
+    return value;
+}
+
+uint64_t toSequence( std::string_view token )
+{
+    uint64_t sequence = 0;
+    std::from_chars( token.data(), token.data()+token.size(), sequence );
+    return sequence;
+}
+
+std::vector<const TestPlayer*> gPlayers;   // players of the current scenario (printed on failure)
+
+#define CHECK( condition ) \
+    if ( ! (condition) ) \
+    { \
+        std::cerr << __FILE__ << ":" << __LINE__ << ": check failed: " #condition << std::endl; \
+        for( auto* player : gPlayers ) \
+        { \
+            player->print(); \
+        } \
+        return false; \
+    }
+
+// starts the players and waits for their registration
+bool registerPlayers( boost::asio::io_context& context, const std::vector<TestPlayer*>& players, const std::string& port )
+{
+    for( auto* player : players )
+    {
+        gPlayers.push_back( player );
+        player->start( HOST, port );
+    }
+    return runUntil( context, [&] { return std::all_of( players.begin(), players.end(), [] ( auto* player ) { return player->isRegistered(); } ); } );
+}
+
+// lobby updates are sent from several io threads while games, registrations and disconnections
+// run concurrently: the lobby subscriber must see consecutive sequence numbers (no [GetPlayerList] resync)
+// and end with the actual list
+bool lobbySequenceOrdering()
+{
+    TestServer server( "15401", 4 );
+    server.start();
+
+    boost::asio::io_context context;
+    TestPlayer observer( context, "Observer" );
+    TestPlayer player0( context, "Player0" );
+    TestPlayer player1( context, "Player1" );
+    CHECK( registerPlayers( context, { &observer, &player0, &player1 }, "15401" ) );
+
+    player0.invite( "Player1" );
+    CHECK( runUntil( context, [&] { return player1.count( tic_tac::SMT_INVITITAION ) == 1; } ) );
+    player1.accept( "Player0" );
+    CHECK( runUntil( context, [&] { return player0.count( tic_tac::SMT_INVITITAION_ACCEPTED ) == 1; } ) );
+
+    std::vector<std::unique_ptr<TestPlayer>> churn;
+    for( int i=0; i<64; i++ )
+    {
+        churn.push_back( std::make_unique<TestPlayer>( context, "Churn" + std::to_string(i) ) );
+        churn.back()->start( HOST, "15401" );
+
+        // steps of the game between the lobby updates
+        player0.step( "Player1", "X", i%3, i/3%3 );
+        if ( i%8 == 7 )
+        {
+            CHECK( runUntil( context, [&] { return std::all_of( churn.end()-8, churn.end(), [] ( auto& player ) { return player->isRegistered(); } ); } ) );
+            for( auto it = churn.end()-8; it != churn.end(); it++ )
+            {
+                (*it)->closeSocket();
+            }
+        }
+    }
+
+    std::map<std::string,bool> expectedLobby = { { "Player0", false }, { "Player1", false } };
+    CHECK( runUntil( context, [&] { return observer.count( tic_tac::SMT_PLAYER_LEFT ) == 64 && player1.count( tic_tac::SMT_ON_STEP ) == 64; } ) );
+    CHECK( observer.lobby() == expectedLobby );
+
+    CHECK( observer.count( tic_tac::SMT_PLAYER_LIST ) == 1 );
+
+    uint64_t sequence = 0;
+    for( const auto& message : observer.m_messages )
+    {
+        MessageTokens<2> tokens( message );
+        if ( tokens[0] == tic_tac::SMT_PLAYER_LIST )
+        {
+            sequence = toSequence( tokens[1] );
+        }
+        else if ( tokens[0] == tic_tac::SMT_PLAYER_JOINED || tokens[0] == tic_tac::SMT_PLAYER_LEFT || tokens[0] == tic_tac::SMT_PLAYER_BUSY )
+        {
+            // (events already in the snapshot are older)
+            auto eventSequence = toSequence( tokens[1] );
+            if ( eventSequence > sequence )
+            {
+                CHECK( eventSequence == sequence+1 );
+                sequence = eventSequence;
+            }
+        }
+    }
+    // 64 joined, 64 left, 2 busy
+    CHECK( sequence >= 130 );
+    return true;
+}
+
+// [FindGame] pairs the waiting player with the next one ([CancelFindGame] withdraws it);
+// the pair gets complementary sides, steps are relayed and the lobby shows both as busy
+bool matchmaking()
+{
+    TestServer server( "15402", 2 );
+    server.start();
+
+    boost::asio::io_context context;
+    TestPlayer observer( context, "Observer" );
+    TestPlayer playerA( context, "PlayerA", false );
+    TestPlayer playerB( context, "PlayerB", false );
+    TestPlayer playerC( context, "PlayerC", false );
+    CHECK( registerPlayers( context, { &observer, &playerA, &playerB, &playerC }, "15402" ) );
+    CHECK( playerA.count( tic_tac::SMT_PLAYER_LIST ) == 0 );
+
+    // ([Watch] of a player is refused: its [OnError] tells that the requests before it are handled)
+    playerA.findGame();
+    playerA.cancelFindGame();
+    playerA.watch( "Nobody" );
+    CHECK( runUntil( context, [&] { return playerA.count( tic_tac::SMT_ON_ERROR ) == 1; } ) );
+    CHECK( playerA.count( tic_tac::SMT_GAME_FOUND ) == 0 );
+
+    // (a pairing would send [GameFound] to PlayerB before its [OnError])
+    playerB.findGame();
+    playerB.watch( "Nobody" );
+    CHECK( runUntil( context, [&] { return playerB.count( tic_tac::SMT_ON_ERROR ) == 1; } ) );
+    CHECK( playerB.count( tic_tac::SMT_GAME_FOUND ) == 0 );
+
+    playerC.findGame();
+    CHECK( runUntil( context, [&] { return playerB.count( tic_tac::SMT_GAME_FOUND ) == 1 && playerC.count( tic_tac::SMT_GAME_FOUND ) == 1; } ) );
+    CHECK( playerB.has( "[GameFound],PlayerC,X" ) );
+    CHECK( playerC.has( "[GameFound],PlayerB,0" ) );
+    CHECK( playerA.count( tic_tac::SMT_GAME_FOUND ) == 0 );
+
+    playerB.step( "PlayerC", "X", 1, 1 );
+    CHECK( runUntil( context, [&] { return playerC.has( "[OnStep],PlayerC,X,1,1" ); } ) );
+    playerC.step( "PlayerB", "0", 0, 2 );
+    CHECK( runUntil( context, [&] { return playerB.has( "[OnStep],PlayerB,0,0,2" ); } ) );
+
+    std::map<std::string,bool> expectedLobby = { { "PlayerA", true }, { "PlayerB", false }, { "PlayerC", false } };
+    CHECK( runUntil( context, [&] { return observer.lobby() == expectedLobby; } ) );
+    return true;
+}
+
+// a player that does not answer the partner's step within the move timeout loses the game:
+// both players receive [GameIsOver],timeout,<silent player> and become free
+bool moveTimeout()
+{
+    TestServer server( "15403", 2 );
+    server->setMoveTimeout( 300ms );
+    server.start();
+
+    boost::asio::io_context context;
+    TestPlayer observer( context, "Observer" );
+    TestPlayer playerA( context, "PlayerA", false );
+    TestPlayer playerB( context, "PlayerB", false );
+    CHECK( registerPlayers( context, { &observer, &playerA, &playerB }, "15403" ) );
+
+    // (PlayerA waits first: [OnError] of its [Watch] comes after its [FindGame] is handled)
+    playerA.findGame();
+    playerA.watch( "Nobody" );
+    CHECK( runUntil( context, [&] { return playerA.count( tic_tac::SMT_ON_ERROR ) == 1; } ) );
+    playerB.findGame();
+    CHECK( runUntil( context, [&] { return playerA.has( "[GameFound],PlayerB,X" ) && playerB.count( tic_tac::SMT_GAME_FOUND ) == 1; } ) );
+
+    // answered in time
+    playerA.step( "PlayerB", "X", 1, 1 );
+    CHECK( runUntil( context, [&] { return playerB.count( tic_tac::SMT_ON_STEP ) == 1; } ) );
+    playerB.step( "PlayerA", "0", 0, 0 );
+    CHECK( runUntil( context, [&] { return playerA.count( tic_tac::SMT_ON_STEP ) == 1; } ) );
+    playerA.step( "PlayerB", "X", 2, 2 );
+    CHECK( runUntil( context, [&] { return playerB.count( tic_tac::SMT_ON_STEP ) == 2; } ) );
+
+    // PlayerB does not answer
+    CHECK( runUntil( context, [&] { return playerA.count( tic_tac::SMT_GAME_IS_OVER ) == 1 && playerB.count( tic_tac::SMT_GAME_IS_OVER ) == 1; } ) );
+    CHECK( playerA.has( "[GameIsOver],timeout,PlayerB" ) );
+    CHECK( playerB.has( "[GameIsOver],timeout,PlayerB" ) );
+
+    std::map<std::string,bool> expectedLobby = { { "PlayerA", true }, { "PlayerB", true } };
+    CHECK( runUntil( context, [&] { return observer.lobby() == expectedLobby; } ) );
+    return true;
+}
+
+// spectators of a game (on other io threads) receive every relayed [OnStep] and the final [GameIsOver];
+// a disconnected spectator does not disturb the others
+bool spectatorFanOut()
+{
+    TestServer server( "15404", 4 );
+    server.start();
+
+    boost::asio::io_context context;
+    TestPlayer playerA( context, "PlayerA", false );
+    TestPlayer playerB( context, "PlayerB", false );
+    std::vector<std::unique_ptr<TestPlayer>> watchers;
+    std::vector<TestPlayer*> players = { &playerA, &playerB };
+    for( int i=0; i<4; i++ )
+    {
+        watchers.push_back( std::make_unique<TestPlayer>( context, "Watcher" + std::to_string(i), false ) );
+        players.push_back( watchers.back().get() );
+    }
+    CHECK( registerPlayers( context, players, "15404" ) );
+
+    playerA.invite( "PlayerB" );
+    CHECK( runUntil( context, [&] { return playerB.count( tic_tac::SMT_INVITITAION ) == 1; } ) );
+    playerB.accept( "PlayerA" );
+    CHECK( runUntil( context, [&] { return playerA.count( tic_tac::SMT_INVITITAION_ACCEPTED ) == 1; } ) );
+
+    for( int i=0; i<3; i++ )
+    {
+        watchers[i]->watch( "PlayerA" );
+    }
+    watchers[3]->watch( "Nobody" );
+    CHECK( runUntil( context, [&] { return std::all_of( watchers.begin(), watchers.begin()+3, [] ( auto& watcher ) { return watcher->count( tic_tac::SMT_WATCHING ) == 1; } ); } ) );
+    CHECK( runUntil( context, [&] { return watchers[3]->count( tic_tac::SMT_ON_ERROR ) == 1; } ) );
+    CHECK( watchers[0]->has( "[Watching],PlayerA,PlayerB" ) || watchers[0]->has( "[Watching],PlayerB,PlayerA" ) );
+
+    playerA.step( "PlayerB", "X", 1, 1 );
+    CHECK( runUntil( context, [&] { return playerB.has( "[OnStep],PlayerB,X,1,1" ); } ) );
+    playerB.step( "PlayerA", "0", 0, 2 );
+    CHECK( runUntil( context, [&] { return playerA.has( "[OnStep],PlayerA,0,0,2" ); } ) );
+    for( int i=0; i<3; i++ )
+    {
+        CHECK( runUntil( context, [&] { return watchers[i]->count( tic_tac::SMT_ON_STEP ) == 2; } ) );
+        CHECK( watchers[i]->has( "[OnStep],PlayerB,X,1,1" ) && watchers[i]->has( "[OnStep],PlayerA,0,0,2" ) );
+    }
+
+    // (the session of the closed watcher is gone before the next step)
+    auto closedNumber = counterValue( metrics::c_closed_connections );
+    watchers[2]->closeSocket();
+    CHECK( runUntil( context, [&] { return counterValue( metrics::c_closed_connections ) == closedNumber+1; } ) );
+    playerA.step( "PlayerB", "X", 2, 2 );
+    CHECK( runUntil( context, [&] { return watchers[0]->count( tic_tac::SMT_ON_STEP ) == 3 && watchers[1]->count( tic_tac::SMT_ON_STEP ) == 3; } ) );
+
+    playerA.closeGame( "PlayerB" );
+    CHECK( runUntil( context, [&] { return playerB.has( "[GameClosed],PlayerA" ); } ) );
+    CHECK( runUntil( context, [&] { return watchers[0]->has( "[GameIsOver],closed,PlayerA" ) && watchers[1]->has( "[GameIsOver],closed,PlayerA" ); } ) );
+    CHECK( watchers[2]->count( tic_tac::SMT_GAME_IS_OVER ) == 0 );
+    CHECK( watchers[3]->count( tic_tac::SMT_ON_STEP ) == 0 );
+    return true;
+}
+
+std::string readFile( const std::string& path )
+{
+    std::ifstream file( path, std::ios::binary );
+    return std::string( std::istreambuf_iterator<char>( file ), std::istreambuf_iterator<char>() );
+}
+
+void writeFile( const std::string& path, const std::string& data )
+{
+    std::ofstream file( path, std::ios::binary | std::ios::trunc );
+    file.write( data.data(), std::streamsize( data.size() ) );
+}
+
+// size, top and records of the leaderboard file (opening it applies a valid journal)
+std::string leaderboardState( const std::string& path, const std::vector<std::string>& playerNames )
+{
+    tic_tac::Leaderboard leaderboard( path, 64, 3 );
+    std::ostringstream state;
+    state << "size " << leaderboard.size() << "; top";
+    for( const auto& entry : leaderboard.top() )
+    {
+        state << " " << entry.m_name;
+    }
+    for( const auto& playerName : playerNames )
+    {
+        tic_tac::Leaderboard::Entry entry;
+        if ( leaderboard.find( playerName, entry ) )
+        {
+            state << "; " << entry.m_name << " " << entry.m_rating << " " << entry.m_wins << "/" << entry.m_losses << "/" << entry.m_draws;
+        }
+    }
+    return state.str();
+}
+
+// a game result interrupted at any point (journal valid, then some of the records and the counter written)
+// is completed on the next open: the records, the size and the top equal those of the uninterrupted update
+bool leaderboardJournalRecovery()
+{
+    auto path = ( std::filesystem::temp_directory_path() / "TicTacTests.leaderboard" ).string();
+    std::filesystem::remove( path );
+
+    {
+        tic_tac::Leaderboard leaderboard( path, 64, 3 );
+        CHECK( leaderboard.isOpen() );
+        leaderboard.addGameResult( "PlayerA", "PlayerB", 0 );
+        leaderboard.addGameResult( "PlayerC", "PlayerD", 0 );
+        leaderboard.addGameResult( "PlayerA", "PlayerC", -1 );
+    }
+    auto before = readFile( path );
+
+    // a new player wins (its record is added)
+    {
+        tic_tac::Leaderboard leaderboard( path, 64, 3 );
+        leaderboard.addGameResult( "PlayerE", "PlayerA", 0 );
+    }
+    auto after = readFile( path );
+    CHECK( before.size() == after.size() );
+
+    std::vector<std::string> playerNames = { "PlayerA", "PlayerB", "PlayerC", "PlayerD", "PlayerE" };
+    auto expectedState = leaderboardState( path, playerNames );
+    CHECK( expectedState.find( "size 5; top PlayerE" ) == 0 );
+
+    // (the journal images stay in the header after the update, only 'm_isValid' is cleared)
+    tic_tac::LeaderboardHeader header;
+    std::memcpy( &header, after.data(), sizeof(header) );
+    CHECK( header.m_journal.m_recordNumber == 2 );
+    uint32_t oldSize;
+    std::memcpy( &oldSize, before.data() + offsetof( tic_tac::LeaderboardHeader, m_size ), sizeof(oldSize) );
+    CHECK( oldSize == 4 && header.m_size == 5 );
+
+    auto recordOffset = [&] ( int i ) { return tic_tac::LEADERBOARD_HEADER_SIZE + header.m_journal.m_indices[i] * sizeof(tic_tac::LeaderboardRecord); };
+    for( int writtenRecordNumber = 0; writtenRecordNumber <= 2; writtenRecordNumber++ )
+    {
+        for( bool isSizeWritten : { false, true } )
+        {
+            auto interrupted = before;
+            header.m_journal.m_isValid = 1;
+            header.m_size = isSizeWritten ? 5 : 4;
+            std::memcpy( interrupted.data(), &header, sizeof(header) );
+            for( int i=0; i<writtenRecordNumber; i++ )
+            {
+                interrupted.replace( recordOffset(i), sizeof(tic_tac::LeaderboardRecord), after, recordOffset(i), sizeof(tic_tac::LeaderboardRecord) );
+            }
+            writeFile( path, interrupted );
+
+            CHECK( leaderboardState( path, playerNames ) == expectedState );
+
+            // the journal is cleared: reopening changes nothing
+            CHECK( leaderboardState( path, playerNames ) == expectedState );
+        }
+    }
+
+    std::filesystem::remove( path );
+    return true;
+}
+
+// resume token of the player (from [Ok]],<token>)
+std::string resumeToken( const TestPlayer& player )
+{
+    for( const auto& message : player.m_messages )
+    {
+        MessageTokens<2> tokens( message );
+        if ( tokens[0] == tic_tac::SMT_OK && tokens.size() == 2 )
+        {
+            return std::string( tokens[1] );
+        }
+    }
+    return {};
+}
+
+// a lost connection keeps its session (and game) for the grace period: messages sent to the player meanwhile
+// are delivered after [Resumed], requests pipelined right after [Resume] are handled by the resumed session;
+// an unknown token is refused and a session that is not resumed in time leaves the lobby
+bool resume()
+{
+    TestServer server( "15406", 2 );
+    server->setResumeGracePeriod( 1000ms );
+    server.start();
+
+    boost::asio::io_context context;
+    TestPlayer observer( context, "Observer" );
+    TestPlayer playerA( context, "PlayerA", false );
+    TestPlayer playerB( context, "PlayerB", false );
+    TestPlayer playerC( context, "PlayerC", false );
+    CHECK( registerPlayers( context, { &observer, &playerA, &playerB, &playerC }, "15406" ) );
+    CHECK( ! resumeToken( playerA ).empty() && ! resumeToken( playerB ).empty() );
+
+    // ([Watch] of a player is refused: its [OnError] tells that the requests before it are handled)
+    playerA.findGame();
+    playerA.watch( "Nobody" );
+    CHECK( runUntil( context, [&] { return playerA.count( tic_tac::SMT_ON_ERROR ) == 1; } ) );
+    playerB.findGame();
+    CHECK( runUntil( context, [&] { return playerA.count( tic_tac::SMT_GAME_FOUND ) == 1 && playerB.count( tic_tac::SMT_GAME_FOUND ) == 1; } ) );
+
+    // a message to the detached session is delivered after [Resumed]
+    playerA.closeSocket();
+    CHECK( runUntil( context, [&] { return server->detachedSessionNumber() == 1; } ) );
+    playerB.step( "PlayerA", "0", 1, 1 );
+    playerB.watch( "Nobody" );
+    CHECK( runUntil( context, [&] { return playerB.count( tic_tac::SMT_ON_ERROR ) == 1; } ) );
+    playerA.resumeConnection( "15406" );
+    CHECK( runUntil( context, [&] { return playerA.isResumed() && playerA.has( "[OnStep],PlayerA,0,1,1" ); } ) );
+    CHECK( playerA.m_messages.back() == "[OnStep],PlayerA,0,1,1" );
+    CHECK( playerA.count( tic_tac::SMT_RESUMED ) == 1 );
+
+    // [Step] in the same segment as [Resume]
+    auto tokenB = resumeToken( playerB );
+    playerB.closeSocket();
+    CHECK( runUntil( context, [&] { return server->detachedSessionNumber() == 1; } ) );
+    TestPlayer rawB( context, "PlayerB", false, true );
+    gPlayers.push_back( &rawB );
+    rawB.start( HOST, "15406" );
+    CHECK( runUntil( context, [&] { return rawB.has( "Hi" ); } ) );
+    rawB.write( "[Resume]," + tokenB + ";[Step],PlayerA,0,2,2;" );
+    CHECK( runUntil( context, [&] { return rawB.count( tic_tac::SMT_RESUMED ) == 1 && playerA.has( "[OnStep],PlayerA,0,2,2" ); } ) );
+
+    // (the token was taken by the resumption)
+    TestPlayer rawStranger( context, "Stranger", false, true );
+    gPlayers.push_back( &rawStranger );
+    rawStranger.start( HOST, "15406" );
+    CHECK( runUntil( context, [&] { return rawStranger.has( "Hi" ); } ) );
+    rawStranger.write( "[Resume]," + tokenB + ";" );
+    CHECK( runUntil( context, [&] { return rawStranger.count( tic_tac::SMT_ON_ERROR ) == 1; } ) );
+
+    // a [Step] split by the resumption: its start is received with [Resume], the rest by the resumed session
+    rawB.closeSocket();
+    CHECK( runUntil( context, [&] { return server->detachedSessionNumber() == 1; } ) );
+    TestPlayer splitB( context, "PlayerB", false, true );
+    gPlayers.push_back( &splitB );
+    splitB.start( HOST, "15406" );
+    CHECK( runUntil( context, [&] { return splitB.has( "Hi" ); } ) );
+    splitB.write( "[Resume]," + tokenB + ";[Step],Play" );
+    CHECK( runUntil( context, [&] { return splitB.count( tic_tac::SMT_RESUMED ) == 1; } ) );
+    splitB.write( "erA,0,0,1;" );
+    CHECK( runUntil( context, [&] { return playerA.has( "[OnStep],PlayerA,0,0,1" ); } ) );
+
+    // none of this was visible in the lobby; a session that is not resumed leaves it after the grace period
+    CHECK( observer.count( tic_tac::SMT_PLAYER_LEFT ) == 0 );
+    playerC.closeSocket();
+    CHECK( runUntil( context, [&] { return server->detachedSessionNumber() == 1; } ) );
+    CHECK( observer.lobby().count( "PlayerC" ) == 1 );
+    CHECK( runUntil( context, [&] { return observer.count( tic_tac::SMT_PLAYER_LEFT ) == 1 && observer.lobby().count( "PlayerC" ) == 0; } ) );
+    return true;
+}
+
+// a game between players of 2 cluster nodes: when the remote player leaves, and when its node is lost,
+// the local partner receives [PlayerOfflined] and is free again in the lobbies of both nodes
+bool crossNodeDisconnect()
+{
+    std::vector<cluster::NodeAddress> peers = { { 1, HOST, "15417" }, { 2, HOST, "15418" } };
+
+    TestServer server1( "15407" );
+    waitForFreePort( "15417" );
+    server1->startCluster( 1, HOST, "15417", peers );
+    server1.start();
+
+    auto server2 = std::make_unique<TestServer>( "15408" );
+    waitForFreePort( "15418" );
+    (*server2)->startCluster( 2, HOST, "15418", peers );
+    server2->start();
+
+    boost::asio::io_context context;
+    TestPlayer playerA( context, "PlayerA" );
+    CHECK( registerPlayers( context, { &playerA }, "15407" ) );
+    TestPlayer playerB( context, "PlayerB" );
+    TestPlayer playerC( context, "PlayerC" );
+    CHECK( registerPlayers( context, { &playerB, &playerC }, "15408" ) );
+
+    // (the nodes link and announce their players)
+    std::map<std::string,bool> expectedLobby = { { "PlayerB", true }, { "PlayerC", true } };
+    CHECK( runUntil( context, [&] { return playerA.lobby() == expectedLobby && playerC.lobby().count( "PlayerA" ) == 1; } ) );
+
+    playerA.invite( "PlayerB" );
+    CHECK( runUntil( context, [&] { return playerB.has( "[Invitation],PlayerA" ); } ) );
+    playerB.accept( "PlayerA" );
+    CHECK( runUntil( context, [&] { return playerA.has( "[InvitationAccepted],PlayerB" ); } ) );
+    playerA.step( "PlayerB", "X", 1, 1 );
+    CHECK( runUntil( context, [&] { return playerB.has( "[OnStep],PlayerB,X,1,1" ); } ) );
+    playerB.step( "PlayerA", "0", 0, 0 );
+    CHECK( runUntil( context, [&] { return playerA.has( "[OnStep],PlayerA,0,0,0" ); } ) );
+    CHECK( runUntil( context, [&] { return playerC.lobby() == std::map<std::string,bool>{ { "PlayerA", false }, { "PlayerB", false } }; } ) );
+
+    // the remote player leaves
+    playerB.closeSocket();
+    CHECK( runUntil( context, [&] { return playerA.has( "[PlayerOfflined],PlayerB" ); } ) );
+    expectedLobby = { { "PlayerC", true } };
+    CHECK( runUntil( context, [&] { return playerA.lobby() == expectedLobby; } ) );
+    CHECK( runUntil( context, [&] { return playerC.lobby() == std::map<std::string,bool>{ { "PlayerA", true } }; } ) );
+
+    // the node of the remote player is lost
+    playerA.invite( "PlayerC" );
+    CHECK( runUntil( context, [&] { return playerC.has( "[Invitation],PlayerA" ); } ) );
+    playerC.accept( "PlayerA" );
+    CHECK( runUntil( context, [&] { return playerA.has( "[InvitationAccepted],PlayerC" ); } ) );
+    playerA.step( "PlayerC", "X", 2, 2 );
+    CHECK( runUntil( context, [&] { return playerC.has( "[OnStep],PlayerC,X,2,2" ); } ) );
+
+    server2.reset();
+    CHECK( runUntil( context, [&] { return playerA.has( "[PlayerOfflined],PlayerC" ); } ) );
+    CHECK( runUntil( context, [&] { return playerA.lobby().empty(); } ) );
+    return true;
+}
+
+// the accepting player of a game is moved to the io thread of the inviter while the inviter's first step
+// and lobby updates of other threads are written to it: nothing is lost or reordered (every [OnStep]
+// arrives, no [GetPlayerList] resync), over several rounds with changing partners
+bool migrationUnderConcurrentWrites()
+{
+    TestServer server( "15409", 4 );
+    server.start();
+
+    constexpr int PAIR_NUMBER = 8;
+    constexpr int ROUND_NUMBER = 12;
+
+    boost::asio::io_context context;
+    std::vector<std::unique_ptr<TestPlayer>> players;
+    std::vector<TestPlayer*> playerPtrs;
+    for( int i=0; i<2*PAIR_NUMBER; i++ )
+    {
+        players.push_back( std::make_unique<TestPlayer>( context, "Player" + std::to_string(i) ) );
+        playerPtrs.push_back( players.back().get() );
+    }
+    CHECK( registerPlayers( context, playerPtrs, "15409" ) );
+    CHECK( runUntil( context, [&] { return std::all_of( players.begin(), players.end(), [] ( auto& player ) { return player->lobby().size() == 2*PAIR_NUMBER-1; } ); } ) );
+
+    // inviters step as soon as the invitation is accepted, acceptors answer the step
+    for( int i=0; i<2*PAIR_NUMBER; i++ )
+    {
+        players[i]->m_onMessage = [] ( TestPlayer& player, std::string_view message )
+        {
+            MessageTokens<2> tokens( message );
+            if ( tokens[0] == tic_tac::SMT_INVITITAION_ACCEPTED )
+            {
+                player.step( std::string( tokens[1] ), "X", 1, 1 );
+            }
+        };
+    }
+
+    for( int round = 0; round < ROUND_NUMBER; round++ )
+    {
+        auto acceptor = [&] ( int pair ) -> TestPlayer& { return *players[ PAIR_NUMBER + (pair+round) % PAIR_NUMBER ]; };
+
+        for( int pair = 0; pair < PAIR_NUMBER; pair++ )
+        {
+            players[pair]->invite( acceptor(pair).name() );
+        }
+        CHECK( runUntil( context, [&]
+        {
+            for( int pair = 0; pair < PAIR_NUMBER; pair++ )
+            {
+                if ( ! acceptor(pair).has( "[Invitation]," + players[pair]->name() ) ) return false;
+            }
+            return true;
+        }));
+
+        for( int pair = 0; pair < PAIR_NUMBER; pair++ )
+        {
+            acceptor(pair).accept( players[pair]->name() );
+        }
+        auto stepNumber = size_t( round+1 );
+        CHECK( runUntil( context, [&]
+        {
+            for( int pair = 0; pair < PAIR_NUMBER; pair++ )
+            {
+                if ( acceptor(pair).count( tic_tac::SMT_ON_STEP ) != stepNumber ) return false;
+            }
+            return true;
+        }));
+
+        for( int pair = 0; pair < PAIR_NUMBER; pair++ )
+        {
+            players[pair]->closeGame( acceptor(pair).name() );
+        }
+        CHECK( runUntil( context, [&]
+        {
+            for( int pair = 0; pair < PAIR_NUMBER; pair++ )
+            {
+                if ( acceptor(pair).count( tic_tac::SMT_GAME_CLOSED ) != stepNumber ) return false;
+            }
+            return true;
+        }));
+        for( int pair = 0; pair < PAIR_NUMBER; pair++ )
+        {
+            acceptor(pair).m_messages.erase( std::remove( acceptor(pair).m_messages.begin(), acceptor(pair).m_messages.end(), "[Invitation]," + players[pair]->name() ), acceptor(pair).m_messages.end() );
+        }
+    }
+
+    // all free again
+    CHECK( runUntil( context, [&]
+    {
+        return std::all_of( players.begin(), players.end(), [] ( auto& player )
+        {
+            return std::all_of( player->lobby().begin(), player->lobby().end(), [] ( auto& nameAndIsFree ) { return nameAndIsFree.second; } );
+        });
+    }));
+    for( auto& player : players )
+    {
+        CHECK( player->count( tic_tac::SMT_PLAYER_LIST ) == 1 );
+    }
+    return true;
+}
+
+// a hot restart hands the listening socket, the lobby, a running game (with a frame received in part)
+// and a detached session over: the players continue without reconnecting and nothing is seen in the lobby
+bool hotRestart()
+{
+    auto path = ( std::filesystem::temp_directory_path() / "TicTacTests.hot-restart" ).string();
+    auto oldServer = std::make_unique<TestServer>( "15414", 2 );
+    (*oldServer)->setResumeGracePeriod( 30s );
+    (*oldServer)->listenHotRestart( path );
+    oldServer->start();
+
+    boost::asio::io_context context;
+    TestPlayer observer( context, "Observer" );
+    TestPlayer playerA( context, "PlayerA", false );
+    TestPlayer playerB( context, "PlayerB", false );
+    TestPlayer playerC( context, "PlayerC", false );
+    CHECK( registerPlayers( context, { &observer, &playerA, &playerB, &playerC }, "15414" ) );
+    CHECK( runUntil( context, [&] { return observer.lobby().size() == 3; } ) );
+
+    playerA.invite( "PlayerB" );
+    CHECK( runUntil( context, [&] { return playerB.has( "[Invitation],PlayerA" ); } ) );
+    playerB.accept( "PlayerA" );
+    CHECK( runUntil( context, [&] { return playerA.has( "[InvitationAccepted],PlayerB" ); } ) );
+    playerA.step( "PlayerB", "X", 1, 1 );
+    CHECK( runUntil( context, [&] { return playerB.has( "[OnStep],PlayerB,X,1,1" ); } ) );
+
+    // (the start of the next frame is sent with the previous one)
+    playerB.write( "[Step],PlayerA,0,0,1;[Step],PlayerA,0,0," );
+    CHECK( runUntil( context, [&] { return playerA.has( "[OnStep],PlayerA,0,0,1" ); } ) );
+
+    playerC.closeSocket();
+    CHECK( runUntil( context, [&] { return (*oldServer)->detachedSessionNumber() == 1; } ) );
+
+    // (the players' handlers do not run meanwhile: their messages wait in the socket buffers)
+    hot_restart::Inheritance inheritance;
+    CHECK( inheritance.receive( path ) );
+    CHECK( inheritance.sessionNumber() == 4 );
+    TestServer newServer( "15414", 2, inheritance.takeListenSocket() );
+    newServer->setResumeGracePeriod( 30s );
+    newServer->restoreSessions( inheritance );
+    newServer.start();
+    oldServer.reset();
+    CHECK( newServer->detachedSessionNumber() == 1 );
+
+    // the game continues: the frame received in part by the old server is completed
+    playerB.write( "2;" );
+    CHECK( runUntil( context, [&] { return playerA.has( "[OnStep],PlayerA,0,0,2" ); } ) );
+    playerA.step( "PlayerB", "X", 2, 2 );
+    CHECK( runUntil( context, [&] { return playerB.has( "[OnStep],PlayerB,X,2,2" ); } ) );
+
+    // the detached session is resumed, a new player is accepted by the inherited listening socket
+    playerC.resumeConnection( "15414" );
+    CHECK( runUntil( context, [&] { return playerC.isResumed(); } ) );
+    TestPlayer playerD( context, "PlayerD", false );
+    CHECK( registerPlayers( context, { &playerD }, "15414" ) );
+    CHECK( runUntil( context, [&] { return observer.lobby().count( "PlayerD" ) == 1; } ) );
+
+    CHECK( observer.count( tic_tac::SMT_PLAYER_LEFT ) == 0 );
+    CHECK( playerA.count( tic_tac::SMT_HI ) == 1 && playerB.count( tic_tac::SMT_HI ) == 1 );
+    return true;
+}
+
+// (written by 'capture', replayed by the 'capture_replay' test, see CMakeLists.txt)
+constexpr const char* CAPTURE_PATH = "TicTacTests.ttcap";
+
+// the inbound frames of every session are captured in order between its open and close records
+bool captureFrames()
+{
+    std::filesystem::remove( CAPTURE_PATH );
+    boost::asio::io_context context;
+    TestPlayer playerA( context, "PlayerA", false );
+    TestPlayer playerB( context, "PlayerB", false );
+    {
+        TestServer server( "15410", 2 );
+        CHECK( server->startCapture( CAPTURE_PATH ) );
+        server.start();
+
+        CHECK( registerPlayers( context, { &playerA, &playerB }, "15410" ) );
+        playerA.invite( "PlayerB" );
+        CHECK( runUntil( context, [&] { return playerB.count( tic_tac::SMT_INVITITAION ) == 1; } ) );
+        playerB.accept( "PlayerA" );
+        CHECK( runUntil( context, [&] { return playerA.count( tic_tac::SMT_INVITITAION_ACCEPTED ) == 1; } ) );
+        playerA.step( "PlayerB", "X", 1, 1 );
+        CHECK( runUntil( context, [&] { return playerB.has( "[OnStep],PlayerB,X,1,1" ); } ) );
+        playerB.closeSocket();
+        CHECK( runUntil( context, [&] { return playerA.has( "[PlayerOfflined],PlayerB" ); } ) );
+    }
+
+    std::vector<capture::CaptureRecord> records;
+    CHECK( capture::readCapture( CAPTURE_PATH, records ) );
+    std::stable_sort( records.begin(), records.end(), [] ( const auto& a, const auto& b ) { return a.m_timeNs < b.m_timeNs; } );
+
+    // session id -> "open", frames, "close"
+    std::map<uint32_t,std::vector<std::string>> sessions;
+    for( const auto& record : records )
+    {
+        auto& session = sessions[record.m_sessionId];
+        if ( record.m_type == capture::crt_open )        session.push_back( "open" );
+        else if ( record.m_type == capture::crt_frame )  session.push_back( record.m_payload );
+        else                                             session.push_back( "close" );
+    }
+    CHECK( sessions.size() == 2 );
+
+    std::vector<std::vector<std::string>> frames;
+    for( auto& [sessionId,session] : sessions )
+    {
+        frames.push_back( std::move(session) );
+    }
+    if ( frames[0].size() > 1 && frames[0][1].find( "PlayerB" ) != std::string::npos )
+    {
+        std::swap( frames[0], frames[1] );
+    }
+    CHECK( frames[0].size() == 4 && frames[0][0] == "open" && frames[0][2] == "[Invite],PlayerB" && frames[0][3] == "[Step],PlayerB,X,1,1" );
+    CHECK( frames[1].size() == 4 && frames[1][0] == "open" && frames[1][2] == "[AcceptInvitation],PlayerA" && frames[1][3] == "close" );
+    return true;
+}
+
+// the metrics endpoint answers, and closes a connection that is not closed by the client
+bool metricsEndpoint()
+{
+    TestServer server( "15412" );
+    waitForFreePort( "15413" );
+    server->startMetricsEndpoint( HOST, "15413" );
+    server.start();
+
+    boost::asio::io_context context;
+    boost::asio::ip::tcp::socket socket( context );
+    CHECK( runUntil( context, [&]
+    {
+        boost::system::error_code ec;
+        socket.close( ec );
+        socket.connect( { boost::asio::ip::make_address( HOST ), 15413 }, ec );
+        return ! ec;
+    } ) );
+
+    std::string response;
+    boost::system::error_code readError;
+    boost::asio::async_read( socket, boost::asio::dynamic_buffer( response ), [&] ( auto error, auto ) { readError = error; } );
+    CHECK( runUntil( context, [&] { return readError == boost::asio::error::eof; } ) );
+    CHECK( response.rfind( "HTTP/1.0 200 OK", 0 ) == 0 && response.find( "accepted_connections " ) != std::string::npos );
+
+    // the client keeps its side open (and writing): the endpoint closes the connection after the deadline,
+    // then a write is reset
+    CHECK( runUntil( context, [&]
+    {
+        boost::system::error_code ec;
+        socket.write_some( boost::asio::buffer( "x", 1 ), ec );
+        std::this_thread::sleep_for( 10ms );
+        return bool( ec );
+    }, metrics::METRICS_CONNECTION_TIMEOUT + 2s ) );
+    return true;
+}
+
+// socket of this process: its local port is 'localPort' (and it listens), or its peer port is 'peerPort'; -1 -> none
+int findSocket( uint16_t localPort, uint16_t peerPort )
+{
+    for( const auto& entry : std::filesystem::directory_iterator( "/proc/self/fd" ) )
+    {
+        auto name = entry.path().filename().string();
+        int fd = -1;
+        std::from_chars( name.data(), name.data()+name.size(), fd );
+
+        sockaddr_in address{};
+        socklen_t size = sizeof(address);
+        if ( localPort != 0 && getsockname( fd, reinterpret_cast<sockaddr*>(&address), &size ) == 0
+             && address.sin_family == AF_INET && ntohs( address.sin_port ) == localPort )
+        {
+            int isListening = 0;
+            socklen_t optionSize = sizeof(isListening);
+            if ( getsockopt( fd, SOL_SOCKET, SO_ACCEPTCONN, &isListening, &optionSize ) == 0 && isListening )
+            {
+                return fd;
+            }
+        }
+        size = sizeof(address);
+        if ( peerPort != 0 && getpeername( fd, reinterpret_cast<sockaddr*>(&address), &size ) == 0
+             && address.sin_family == AF_INET && ntohs( address.sin_port ) == peerPort )
+        {
+            return fd;
+        }
+    }
+    return -1;
+}
+
+int socketOption( int fd, int level, int name )
+{
+    int value = -1;
+    socklen_t size = sizeof(value);
+    getsockopt( fd, level, name, &value, &size );
+    return value;
+}
+
+// the options of a socket options profile are set on the listener and on the accepted connections
+// (the server sockets are found among the descriptors of the process)
+bool socketOptions()
+{
+    SocketOptions options;
+    for( auto profile : SOCKET_OPTIONS_PROFILES )
+    {
+        CHECK( socketOptionsProfile( profile, options ) );
+    }
+    CHECK( ! socketOptionsProfile( "unknown", options ) );
+
+    struct Case
+    {
+        const char* m_profile;
+        int         m_noDelay;
+        int         m_userTimeoutMs;
+        bool        m_isSmallBuffer;
+        bool        m_isDeferAccept;
+    };
+    const Case cases[] =
+    {
+        { "nodelay",        1, 0,     false, false },
+        { "nagle",          0, 0,     false, false },
+        { "small-buffers",  1, 0,     true,  false },
+        { "user-timeout",   1, 10000, false, false },
+        { "defer-accept",   1, 0,     false, true },
+    };
+
+    for( const auto& testCase : cases )
+    {
+        CHECK( socketOptionsProfile( testCase.m_profile, options ) );
+        TestServer server( "15415", 1, -1, options );
+        server.start();
+
+        int listener = findSocket( 15415, 0 );
+        CHECK( listener >= 0 );
+        CHECK( ( socketOption( listener, IPPROTO_TCP, TCP_DEFER_ACCEPT ) > 0 ) == testCase.m_isDeferAccept );
+
+        boost::asio::io_context context;
+        boost::asio::ip::tcp::socket socket( context );
+        CHECK( runUntil( context, [&]
+        {
+            boost::system::error_code ec;
+            socket.close( ec );
+            socket.connect( { boost::asio::ip::make_address( HOST ), 15415 }, ec );
+            return ! ec;
+        } ) );
+
+        // (a deferred connection is accepted with its first data; the greeting is sent after the options are set)
+        boost::asio::write( socket, boost::asio::buffer( std::string_view( "[PlayerName],Probe;" ) ) );
+        std::string greeting;
+        bool isGreeted = false;
+        boost::asio::async_read_until( socket, boost::asio::dynamic_buffer( greeting ), ';', [&] ( auto error, auto ) { isGreeted = ! error; } );
+        CHECK( runUntil( context, [&] { return isGreeted; } ) );
+        CHECK( greeting.rfind( "Hi;", 0 ) == 0 );
+
+        int connection = findSocket( 0, socket.local_endpoint().port() );
+        CHECK( connection >= 0 );
+        CHECK( socketOption( connection, IPPROTO_TCP, TCP_NODELAY ) == testCase.m_noDelay );
+        CHECK( socketOption( connection, SOL_SOCKET, SO_KEEPALIVE ) == 1 );
+        CHECK( socketOption( connection, IPPROTO_TCP, TCP_USER_TIMEOUT ) == testCase.m_userTimeoutMs );
+        // (the kernel doubles the requested size)
+        CHECK( ( socketOption( connection, SOL_SOCKET, SO_RCVBUF ) <= 2*4096 ) == testCase.m_isSmallBuffer );
+    }
+    return true;
+}
+
+struct Scenario
+{
+    const char* m_name;
+    bool        (*m_run)();
+};
+
+const Scenario SCENARIOS[] =
+{
+    { "lobby_sequence_ordering",    lobbySequenceOrdering },
+    { "matchmaking",                matchmaking },
+    { "move_timeout",               moveTimeout },
+    { "spectator_fan_out",          spectatorFanOut },
+    { "leaderboard_journal_recovery", leaderboardJournalRecovery },
+    { "resume",                     resume },
+    { "migration_under_concurrent_writes", migrationUnderConcurrentWrites },
+    { "cross_node_disconnect",      crossNodeDisconnect },
+    { "hot_restart",                hotRestart },
+    { "capture",                    captureFrames },
+    { "metrics_endpoint",           metricsEndpoint },
+    { "socket_options",             socketOptions },
+};
+
+} // namespace
+
+int main( int argc, char* argv[] )
+{
+    logs::setLogLevel( LOG_LEVEL_NONE );
+
+    int failedNumber = 0;
+    for( const auto& scenario : SCENARIOS )
+    {
+        bool isSelected = ( argc == 1 );
+        for( int i=1; i<argc; i++ )
+        {
+            isSelected = isSelected || std::strcmp( argv[i], scenario.m_name ) == 0;
+        }
+        if ( ! isSelected )
+        {
+            continue;
+        }
+
+        gPlayers.clear();
+        bool isPassed = scenario.m_run();
+        std::cout << ( isPassed ? "passed: " : "FAILED: " ) << scenario.m_name << std::endl;
+        failedNumber += ! isPassed;
+    }
+    return failedNumber == 0 ? 0 : 1;
+}
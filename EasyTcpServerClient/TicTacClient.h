@@ -1,13 +1,15 @@
 #pragma once
 
 #include <boost/asio.hpp>
-#include <boost/algorithm/string.hpp>
 
+#include <charconv>
 #include <map>
 #include <string>
+#include <vector>
 
 #include "TcpClient.h"
 #include "TicTacProtocol.h"
+#include "MessageTokenizer.h"
 #include "Logs.h"
 
 namespace tic_tac {
@@ -20,6 +22,9 @@ protected:
 
     virtual void onRegistered() = 0;
 
+    // [Resume] result: the session continues (messages sent to us meanwhile follow)
+    virtual void onResumed() {}
+
     // returned 'true'  -> if invitation accepted
     // returned 'false' -> if invitation rejected
     virtual void onInvitation( std::string playName ) = 0;
@@ -35,6 +40,18 @@ protected:
     virtual void onPlayerOfflined( std::string playName ) = 0;
 
     virtual void onPartnerStep( std::string partnerName, bool isX, int x, int y ) = 0;
+
+    // [FindGame] result: game with 'partnerName' is started ('isX' -> we move first)
+    virtual void onGameFound( std::string partnerName, bool isX ) {}
+
+    // game is finished by the server ('reason' == "timeout": 'playerName' did not move in time)
+    virtual void onGameIsOver( std::string reason, std::string playerName ) {}
+
+    // [Watch] result: steps of the game of 'playerName0' and 'playerName1' follow ([OnStep], then [GameIsOver])
+    virtual void onWatching( std::string playerName0, std::string playerName1 ) {}
+
+    // [GetLeaderboard] result: best players first, (name, rating)
+    virtual void onLeaderboard( std::vector<std::pair<std::string,int>> leaderboard ) {}
 };
 
 class TicTacClient: public TcpClient, ITicTacClient
@@ -48,190 +65,380 @@ class TicTacClient: public TcpClient, ITicTacClient
     CurrentState    m_currentState = ttcst_initial;
     std::string     m_partnerName;
 
-    std::string     m_request;
+    // sequence number of the last applied lobby change; 0 -> no [PlayerList] received yet
+    uint64_t        m_lobbySequence = 0;
+
+    // from [Ok]] (empty -> the server does not keep sessions of lost connections)
+    std::string     m_resumeToken;
     
 protected:
     std::string                 m_playerName;
     std::map<std::string,bool>  m_availablePlayerList;
+
+    // false -> registered without lobby updates (for clients that use only [FindGame]);
+    // must be set before connection
+    bool                        m_isLobbySubscriber = true;
     
 public:
     TicTacClient( std::string playerName ) : m_playerName(playerName) {}
+    TicTacClient( boost::asio::io_context& context, std::string playerName ) : TcpClient(context), m_playerName(playerName) {}
     
 protected:
     
     std::string clientName() const override { return m_playerName; }
+
+    // new connection continues the session by [Resume] (if the server gave a token), otherwise registers again;
+    // must be called after the previous connection is closed
+    void reconnect( const std::string& address, const std::string& port )
+    {
+        m_currentState = ttcst_initial;
+        start( address, port );
+    }
     
-    void sendInvitaion( std::string partnerName )
+    // (on the client's executor, see TcpClient)
+    template<class ...Fields>
+    void sendRequest( std::string_view messageType, const Fields&... fields )
     {
-        std::lock_guard<std::mutex>  lock(m_mutex);
+        writeMessage( [&] ( std::string& out ) { appendMessage( out, messageType, fields... ); } );
+    }
 
+    void sendPlayerName()
+    {
+        if ( m_isLobbySubscriber )
+        {
+            sendRequest( CMT_PLAYER_NAME, m_playerName );
+        }
+        else
+        {
+            sendRequest( CMT_PLAYER_NAME, m_playerName, "0" );
+        }
+    }
+
+    void sendInvitaion( std::string partnerName )
+    {
         m_partnerName = partnerName;
-        m_request = (CMT_INVITE) +  "," + partnerName;
-        write( m_request );
+        sendRequest( CMT_INVITE, partnerName );
     }
 
-    void sendCloseGame( std::string partnerName )
+    void sendFindGame()
+    {
+        sendRequest( CMT_FIND_GAME );
+    }
+
+    void sendCancelFindGame()
+    {
+        sendRequest( CMT_CANCEL_FIND_GAME );
+    }
+
+    void sendWatch( std::string playerName )
     {
-        std::lock_guard<std::mutex>  lock(m_mutex);
+        sendRequest( CMT_WATCH, playerName );
+    }
+
+    // 'result': "win", "loss" or "draw"
+    void sendGameEnded( std::string result )
+    {
+        sendRequest( CMT_GAME_ENDED, result );
+    }
 
+    void sendGetLeaderboard()
+    {
+        sendRequest( CMT_GET_LEADERBOARD );
+    }
+
+    void sendCloseGame( std::string partnerName )
+    {
         m_partnerName = partnerName;
-        m_request = (CMT_CLOSE_GAME) +  "," + partnerName;
-        write( m_request );
+        sendRequest( CMT_CLOSE_GAME, partnerName );
     }
 
     void sendStep( std::string partnerName, std::string x_0, std::string x, std::string y )
     {
-        std::lock_guard<std::mutex> lock(m_mutex);
-
         m_partnerName = partnerName;
-        m_request = (CMT_STEP) +  "," + partnerName + "," + x_0 + "," + x + "," + y;
-        write( m_request );
+        sendRequest( CMT_STEP, partnerName, x_0, x, y );
     }
 
     void sendInvitaionResponse( std::string partnerName, bool isAccepted )
     {
-        std::lock_guard<std::mutex> lock(m_mutex);
-
         if ( isAccepted )
         {
             m_partnerName = partnerName;
-            m_request = (CMT_ACCEPT_INVITITAION) +  "," + partnerName;
-            write( m_request );
+            sendRequest( CMT_ACCEPT_INVITITAION, partnerName );
         }
         else
         {
-            m_request = (CMT_REJECT_INVITITAION) +  "," + partnerName;
-            write( m_request );
+            sendRequest( CMT_REJECT_INVITITAION, partnerName );
             return;
         }
     }
 
-    virtual void onMessageReceived( const std::string& message ) override
+    static uint64_t toLobbySequence( std::string_view token )
+    {
+        uint64_t sequence = 0;
+        std::from_chars( token.data(), token.data()+token.size(), sequence );
+        return sequence;
+    }
+
+    virtual void onMessageReceived( std::string_view message ) override
     {
-        LOG( "> Client::onMessageReceived: (" << m_playerName.c_str() << "): " << message.c_str() );
+        LOG_DBG( "> Client::onMessageReceived: (" << m_playerName.c_str() << "): " << message );
         
         if ( message.empty() )
         {
-            LOG_ERR( "Client::onMessageReceived empty response: '" << message.c_str() << "'" );
+            LOG_ERR( "Client::onMessageReceived empty response: '" << message << "'" );
             return;
         }
         
-        std::vector<std::string> tokens;
-        boost::split( tokens, message, boost::is_any_of(",") );
+        MessageTokens<5> tokens( message );
 
-        std::string messageType = tokens[0];
+        auto messageType = tokens[0];
         
-        if ( messageType == "Hi" )
+        switch ( messageTypeOf( messageType ) )
         {
-            if ( m_currentState != ttcst_initial )
+            case mt_hi:
             {
-                LOG_ERR( "invalid server greeting: " << message.c_str() );
+                if ( m_currentState != ttcst_initial )
+                {
+                    LOG_ERR( "invalid server greeting: " << message );
+                    return;
+                }
+
+                m_currentState = ttcst_handshaking;
+                if ( ! m_resumeToken.empty() )
+                {
+                    sendRequest( CMT_RESUME, m_resumeToken );
+                    return;
+                }
+                sendPlayerName();
                 return;
             }
+            case mt_ok:
+            {
+                m_resumeToken = tokens[1];
+                m_currentState = ttcst_registered;
+                onRegistered();
+                return;
+            }
+            case mt_resumed:
+            {
+                m_currentState = ttcst_registered;
+                onResumed();
+                return;
+            }
+            case mt_on_error:
+            {
+                LOG( "server error: " << message );
+                if ( m_currentState == ttcst_handshaking && ! m_resumeToken.empty() )
+                {
+                    // the session has expired: register again
+                    m_resumeToken.clear();
+                    sendPlayerName();
+                }
+                return;
+            }
+            case mt_player_list:
+            {
+                m_availablePlayerList.clear();
 
-            m_currentState = ttcst_handshaking;
-            m_request = (CMT_PLAYER_NAME) + "," + m_playerName;
-            write( m_request );
-            return;
-        }
-        else if ( messageType == SMT_OK )
-        {
-            m_currentState = ttcst_registered;
-            onRegistered();
-            return;
-        }
-        else if ( messageType == SMT_PLAYER_LIST )
-        {
-            m_availablePlayerList.clear();
-            for( size_t i=1; i<tokens.size(); i+=2 )
+                // <seq>, then pairs: <name>,<isBuzy>
+                std::string_view playerList = message.substr( messageType.size() );
+                std::string_view playerName;
+                std::string_view isBuzy;
+                nextToken( playerList, playerName ); // empty token after message type
+
+                std::string_view sequence;
+                nextToken( playerList, sequence );
+                m_lobbySequence = toLobbySequence( sequence );
+
+                for( size_t i=0; nextToken( playerList, playerName ) && nextToken( playerList, isBuzy ); i+=2 )
+                {
+                    auto isNotBuzy = isBuzy.empty();
+                    LOG_DBG( "PlayerList[" << i << "]: " << playerName << " " << isNotBuzy );
+                    if ( playerName == m_playerName )
+                    {
+                        continue;
+                    }
+                    
+                    m_availablePlayerList[std::string(playerName)] = isNotBuzy;
+                }
+
+                onPlayerListChanged();
+                return;
+            }
+            case mt_player_joined:
+            case mt_player_left:
+            case mt_player_busy:
             {
-                auto playerName = tokens[i];
-                auto isNotBuzy = tokens[i+1].empty();
-                LOG( "PlayerList[" << i-1 << "]: " << playerName.c_str() << " " << isNotBuzy );
+                if ( tokens.size() < 3 )
+                {
+                    LOG_ERR( "protocol error: tokens.size() " << message );
+                    return;
+                }
+
+                if ( m_lobbySequence == 0 )
+                {
+                    // snapshot is not received yet
+                    return;
+                }
+
+                auto sequence = toLobbySequence( tokens[1] );
+                if ( sequence <= m_lobbySequence )
+                {
+                    // already in the snapshot
+                    return;
+                }
+                if ( sequence != m_lobbySequence+1 )
+                {
+                    LOG( "lobby sequence gap: " << m_lobbySequence << " -> " << sequence );
+                    m_lobbySequence = 0;
+                    sendRequest( CMT_GET_PLAYER_LIST );
+                    return;
+                }
+                m_lobbySequence = sequence;
+
+                auto playerName = tokens[2];
                 if ( playerName == m_playerName )
                 {
-                    continue;
+                    return;
                 }
-                
-                m_availablePlayerList[playerName] = isNotBuzy;
-            }
 
-            onPlayerListChanged();
-            return;
-        }
-        else if ( messageType == SMT_INVITITAION )
-        {
-            if ( tokens.size() < 2 )
+                switch ( messageTypeOf( messageType ) )
+                {
+                    case mt_player_joined:
+                        m_availablePlayerList[std::string(playerName)] = true;
+                        break;
+                    case mt_player_left:
+                        m_availablePlayerList.erase( std::string(playerName) );
+                        break;
+                    default:
+                        m_availablePlayerList[std::string(playerName)] = ( tokens[3] != "1" );
+                        break;
+                }
+
+                onPlayerListChanged();
+                return;
+            }
+            case mt_invitation:
             {
-                LOG_ERR( "protocol error: tokens.size() " << message.c_str() );
+                if ( tokens.size() < 2 )
+                {
+                    LOG_ERR( "protocol error: tokens.size() " << message );
+                    return;
+                }
+
+                onInvitation( std::string(tokens[1]) );
                 return;
             }
+            case mt_player_offlined:
+            {
+                if ( tokens.size() < 2 )
+                {
+                    LOG_ERR( "protocol error: tokens.size() " << message );
+                    return;
+                }
 
-            auto partnerName = tokens[1];
+                onPlayerOfflined( std::string(tokens[1]) );
+                return;
+            }
+            case mt_invitation_rejected:
+            {
+                if ( tokens.size() < 2 )
+                {
+                    LOG_ERR( "protocol error: tokens.size() " << message );
+                    return;
+                }
 
-            onInvitation(partnerName);
-            return;
-        }
-        else if ( messageType == SMT_PLAYER_OFFLINED )
-        {
-            if ( tokens.size() < 2 )
+                onAcceptedInvitation( std::string(tokens[1]), false );
+                return;
+            }
+            case mt_invitation_accepted:
             {
-                LOG_ERR( "protocol error: tokens.size() " << message.c_str() );
+                if ( tokens.size() < 2 )
+                {
+                    LOG_ERR( "protocol error: tokens.size() " << message );
+                    return;
+                }
+
+                onAcceptedInvitation( std::string(tokens[1]), true );
                 return;
             }
+            case mt_game_found:
+            {
+                if ( tokens.size() < 3 )
+                {
+                    LOG_ERR( "protocol error: tokens.size() " << message );
+                    return;
+                }
 
-            auto playerName = tokens[1];
-            onPlayerOfflined( playerName );
-            return;
-        }
-        else if ( messageType == SMT_INVITITAION_REJECTED )
-        {
-            if ( tokens.size() < 2 )
+                m_partnerName = tokens[1];
+                onGameFound( m_partnerName, tokens[2] == "X" );
+                return;
+            }
+            case mt_watching:
             {
-                LOG_ERR( "protocol error: tokens.size() " << message.c_str() );
+                if ( tokens.size() < 3 )
+                {
+                    LOG_ERR( "protocol error: tokens.size() " << message );
+                    return;
+                }
+
+                onWatching( std::string(tokens[1]), std::string(tokens[2]) );
                 return;
             }
+            case mt_on_step:
+            {
+                LOG_DBG( "SMT_ON_STEP received" );
+                if ( tokens.size() < 5 )
+                {
+                    LOG_ERR( "protocol error: tokens.size() " << message );
+                    return;
+                }
 
-            auto playerName = tokens[1];
-            onAcceptedInvitation( playerName, false );
-            return;
-        }
-        else if ( messageType == SMT_INVITITAION_ACCEPTED )
-        {
-            if ( tokens.size() < 2 )
+                auto x_or_0 = tokens[2];
+                int x = 0;
+                int y = 0;
+                std::from_chars( tokens[3].data(), tokens[3].data()+tokens[3].size(), x );
+                std::from_chars( tokens[4].data(), tokens[4].data()+tokens[4].size(), y );
+                onPartnerStep( m_partnerName, x_or_0 != "0", x, y );
+                return;
+            }
+            case mt_game_is_over:
             {
-                LOG_ERR( "protocol error: tokens.size() " << message.c_str() );
+                onGameIsOver( std::string(tokens[1]), std::string(tokens[2]) );
                 return;
             }
+            case mt_leaderboard:
+            {
+                // <name>,<rating>,<wins>,<losses>,<draws>,...
+                std::vector<std::pair<std::string,int>> leaderboard;
+                std::string_view list = message.substr( messageType.size() );
+                std::string_view token;
+                nextToken( list, token ); // empty token after message type
 
-            auto partnerName = tokens[1];
-            onAcceptedInvitation( partnerName, true );
-            return;
-        }
-        else if ( messageType == SMT_ON_STEP )
-        {
-            LOG( "SMT_ON_STEP received" );
-            if ( tokens.size() < 5 )
+                std::string_view name;
+                std::string_view fields[4];
+                while ( nextToken( list, name ) && nextToken( list, fields[0] ) && nextToken( list, fields[1] )
+                        && nextToken( list, fields[2] ) && nextToken( list, fields[3] ) )
+                {
+                    int rating = 0;
+                    std::from_chars( fields[0].data(), fields[0].data()+fields[0].size(), rating );
+                    leaderboard.emplace_back( name, rating );
+                }
+
+                onLeaderboard( std::move(leaderboard) );
+                return;
+            }
+            case mt_game_closed:
             {
-                LOG_ERR( "protocol error: tokens.size() " << message.c_str() );
                 return;
             }
-
-            auto myName = tokens[1];
-            auto x_or_0 = tokens[2];
-            int x = std::stoi(tokens[3]);
-            int y = std::stoi(tokens[4]);
-            onPartnerStep( m_partnerName, x_or_0 != "0", x, y );
-        }
-        else if ( messageType == SMT_GAME_IS_OVER )
-        {
-        }
-        else
-        {
-            LOG( "!!! unknown message type: " << messageType.c_str() );
+            default:
+            {
+                LOG( "!!! unknown message type: " << messageType );
 #ifdef DEBUG
-            assert(0);
+                assert(0);
 #endif
+            }
         }
     }
 };
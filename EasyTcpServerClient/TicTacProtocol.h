@@ -1,28 +1,252 @@
 #pragma once
 
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
 namespace tic_tac {
 
-const std::string SMT_OK              = "[Ok]]";
-const std::string SMT_ON_ERROR        = "[OnError]";
-const std::string CMT_PLAYER_NAME     = "[PlayerName]";
-const std::string SMT_PLAYER_LIST     = "[PlayerList]";
-const std::string SMT_PLAYER_OFFLINED = "[PlayerOfflined]";
+constexpr std::string_view SMT_HI              = "Hi";      // greeting of TcpClientSession::start()
+constexpr std::string_view SMT_OK              = "[Ok]]";      // [Ok]][,<resume token>]
+constexpr std::string_view SMT_ON_ERROR        = "[OnError]";
+constexpr std::string_view CMT_PLAYER_NAME     = "[PlayerName]";       // [PlayerName],<name>[,0] (0 -> no lobby updates)
+constexpr std::string_view SMT_PLAYER_LIST     = "[PlayerList]";       // [PlayerList],<seq>,<name>,<isBuzy>,...
+constexpr std::string_view SMT_PLAYER_OFFLINED = "[PlayerOfflined]";
+
+// Lobby changes after the [PlayerList] snapshot; each event increments lobby sequence number.
+// On sequence gap client requests new snapshot by [GetPlayerList]
+constexpr std::string_view SMT_PLAYER_JOINED   = "[PlayerJoined]";     // [PlayerJoined],<seq>,<name>
+constexpr std::string_view SMT_PLAYER_LEFT     = "[PlayerLeft]";       // [PlayerLeft],<seq>,<name>
+constexpr std::string_view SMT_PLAYER_BUSY     = "[PlayerBusy]";       // [PlayerBusy],<seq>,<name>,<isBuzy>
+constexpr std::string_view CMT_GET_PLAYER_LIST = "[GetPlayerList]";
+
+// Session resumption: when the server keeps sessions of lost connections (see TicTacServer::setResumeGracePeriod),
+// [Ok]] carries a token; a new connection continues the session by [Resume],<token> (instead of [PlayerName])
+// until the grace period expires (a pending [FindGame] is canceled on disconnection). Answer: [Resumed],<name>, then messages queued meanwhile
+// (requests pipelined after [Resume] are handled by the resumed session)
+constexpr std::string_view CMT_RESUME          = "[Resume]";
+constexpr std::string_view SMT_RESUMED         = "[Resumed]";
+
+constexpr std::string_view CMT_INVITE          = "[Invite]";
+constexpr std::string_view SMT_INVITITAION     = "[Invitation]";
+
+constexpr std::string_view CMT_ACCEPT_INVITITAION      = "[AcceptInvitation]";
+constexpr std::string_view CMT_REJECT_INVITITAION      = "[RejectInvitation]";
+constexpr std::string_view SMT_INVITITAION_REJECTED    = "[InvitationRejected]";
+constexpr std::string_view SMT_INVITITAION_ACCEPTED    = "[InvitationAccepted]";
+
+// Matchmaking: the server pairs players waiting for a game (no lobby needed);
+// both players receive [GameFound],<partner>,<X|0> (X moves first)
+constexpr std::string_view CMT_FIND_GAME               = "[FindGame]";
+constexpr std::string_view CMT_CANCEL_FIND_GAME        = "[CancelFindGame]";
+constexpr std::string_view SMT_GAME_FOUND              = "[GameFound]";
+
+// Spectators: [Watch],<player> subscribes to the running game of the player (from its next step);
+// answer: [Watching],<player>,<player>, then the game's [OnStep] and finally
+// [GameIsOver],<timeout|closed|offline>,<player>
+constexpr std::string_view CMT_WATCH                   = "[Watch]";
+constexpr std::string_view SMT_WATCHING                = "[Watching]";
+
+constexpr std::string_view CMT_CLOSE_GAME              = "[CloseGame]";
+constexpr std::string_view SMT_GAME_CLOSED             = "[GameClosed]";
 
-const std::string CMT_INVITE          = "[Invite]";
-const std::string SMT_INVITITAION     = "[Invitation]";
+constexpr std::string_view CMT_STEP = "[Step]";
+constexpr std::string_view SMT_ON_STEP = "[OnStep]";
 
-const std::string CMT_ACCEPT_INVITITAION      = "[AcceptInvitation]";
-const std::string CMT_REJECT_INVITITAION      = "[RejectInvitation]";
-const std::string SMT_INVITITAION_REJECTED    = "[InvitationRejected]";
-const std::string SMT_INVITITAION_ACCEPTED    = "[InvitationAccepted]";
+// Game result: each player reports [GameEnded],<win|loss|draw> (from its point of view);
+// when both reports agree, the result is recorded in the leaderboard and the game is over
+constexpr std::string_view CMT_GAME_ENDED      = "[GameEnded]";
+constexpr std::string_view SMT_GAME_IS_OVER    = "[GameIsOver]";      // [GameIsOver],won,<winner> | [GameIsOver],draw,
+                                                                      // [GameIsOver],timeout,<player who did not move in time>
+                                                                      // (spectators also: closed|offline,<player who closed|left>)
+
+constexpr std::string_view CMT_GET_LEADERBOARD = "[GetLeaderboard]";
+constexpr std::string_view SMT_LEADERBOARD     = "[Leaderboard]";     // [Leaderboard],<name>,<rating>,<wins>,<losses>,<draws>,... (the best first)
+
+// Cluster: messages between the nodes (see Cluster.h, TicTacServer::startCluster());
+// each node announces its own players, messages for a player of another node are forwarded to that node
+// (not in MESSAGE_TYPE_TAGS: clients cannot send them, see TicTacServer::onNodeMessage())
+constexpr std::string_view NMT_PLAYER_JOINED   = "[NodePlayerJoined]";  // [NodePlayerJoined],<name>,<isBuzy>
+constexpr std::string_view NMT_PLAYER_LEFT     = "[NodePlayerLeft]";    // [NodePlayerLeft],<name>
+constexpr std::string_view NMT_PLAYER_BUSY     = "[NodePlayerBusy]";    // [NodePlayerBusy],<name>,<isBuzy>
+constexpr std::string_view NMT_FORWARD         = "[Forward]";           // [Forward],<receiver>,<message to the receiver>
+
+enum MessageType : uint8_t
+{
+    mt_unknown,
+    mt_hi,
+    mt_ok,
+    mt_on_error,
+    mt_player_name,
+    mt_player_list,
+    mt_player_offlined,
+    mt_player_joined,
+    mt_player_left,
+    mt_player_busy,
+    mt_get_player_list,
+    mt_resume,
+    mt_resumed,
+    mt_invite,
+    mt_invitation,
+    mt_accept_invitation,
+    mt_reject_invitation,
+    mt_invitation_rejected,
+    mt_invitation_accepted,
+    mt_find_game,
+    mt_cancel_find_game,
+    mt_game_found,
+    mt_watch,
+    mt_watching,
+    mt_close_game,
+    mt_game_closed,
+    mt_step,
+    mt_on_step,
+    mt_game_ended,
+    mt_game_is_over,
+    mt_get_leaderboard,
+    mt_leaderboard,
+};
+
+struct MessageTypeTag
+{
+    std::string_view m_tag;
+    MessageType      m_type;
+};
+
+constexpr MessageTypeTag MESSAGE_TYPE_TAGS[] =
+{
+    { SMT_HI,                   mt_hi },
+    { SMT_OK,                   mt_ok },
+    { SMT_ON_ERROR,             mt_on_error },
+    { CMT_PLAYER_NAME,          mt_player_name },
+    { SMT_PLAYER_LIST,          mt_player_list },
+    { SMT_PLAYER_OFFLINED,      mt_player_offlined },
+    { SMT_PLAYER_JOINED,        mt_player_joined },
+    { SMT_PLAYER_LEFT,          mt_player_left },
+    { SMT_PLAYER_BUSY,          mt_player_busy },
+    { CMT_GET_PLAYER_LIST,      mt_get_player_list },
+    { CMT_RESUME,               mt_resume },
+    { SMT_RESUMED,              mt_resumed },
+    { CMT_INVITE,               mt_invite },
+    { SMT_INVITITAION,          mt_invitation },
+    { CMT_ACCEPT_INVITITAION,   mt_accept_invitation },
+    { CMT_REJECT_INVITITAION,   mt_reject_invitation },
+    { SMT_INVITITAION_REJECTED, mt_invitation_rejected },
+    { SMT_INVITITAION_ACCEPTED, mt_invitation_accepted },
+    { CMT_FIND_GAME,            mt_find_game },
+    { CMT_CANCEL_FIND_GAME,     mt_cancel_find_game },
+    { SMT_GAME_FOUND,           mt_game_found },
+    { CMT_WATCH,                mt_watch },
+    { SMT_WATCHING,             mt_watching },
+    { CMT_CLOSE_GAME,           mt_close_game },
+    { SMT_GAME_CLOSED,          mt_game_closed },
+    { CMT_STEP,                 mt_step },
+    { SMT_ON_STEP,              mt_on_step },
+    { CMT_GAME_ENDED,           mt_game_ended },
+    { SMT_GAME_IS_OVER,         mt_game_is_over },
+    { CMT_GET_LEADERBOARD,      mt_get_leaderboard },
+    { SMT_LEADERBOARD,          mt_leaderboard },
+};
+
+constexpr size_t MESSAGE_TYPE_NUMBER = sizeof(MESSAGE_TYPE_TAGS)/sizeof(MESSAGE_TYPE_TAGS[0]);
+
+// FNV-1a
+constexpr uint32_t messageTypeHash( std::string_view tag )
+{
+    uint32_t hash = 2166136261u;
+    for( char c : tag )
+    {
+        hash = (hash ^ uint8_t(c)) * 16777619u;
+    }
+    return hash;
+}
 
-const std::string CMT_CLOSE_GAME              = "[CloseGame]";
-const std::string SMT_GAME_CLOSED             = "[GameClosed]";
+// Perfect hash table over MESSAGE_TYPE_TAGS, built at compile time:
+// the smallest table size without collisions is chosen
+//
+namespace detail {
 
-const std::string CMT_STEP = "[Step]";
-const std::string SMT_ON_STEP = "[OnStep]";
+constexpr size_t MESSAGE_TYPE_TABLE_MAX_SIZE = 256;
 
-const std::string CMT_GAME_ENDED      = "[GameEnded]";
-const std::string SMT_GAME_IS_OVER    = "[GameIsOver]";
+constexpr bool hasMessageTypeCollisions( size_t tableSize )
+{
+    std::array<bool,MESSAGE_TYPE_TABLE_MAX_SIZE> isUsed{};
+    for( const auto& tag : MESSAGE_TYPE_TAGS )
+    {
+        auto index = messageTypeHash( tag.m_tag ) % tableSize;
+        if ( isUsed[index] )
+        {
+            return true;
+        }
+        isUsed[index] = true;
+    }
+    return false;
+}
+
+constexpr size_t messageTypeTableSize()
+{
+    for( size_t size = MESSAGE_TYPE_NUMBER; size <= MESSAGE_TYPE_TABLE_MAX_SIZE; size++ )
+    {
+        if ( ! hasMessageTypeCollisions( size ) )
+        {
+            return size;
+        }
+    }
+    return 0;
+}
+
+constexpr size_t MESSAGE_TYPE_TABLE_SIZE = messageTypeTableSize();
+static_assert( MESSAGE_TYPE_TABLE_SIZE != 0, "no perfect hash for message type tags" );
+
+// table item is (index in MESSAGE_TYPE_TAGS + 1); 0 -> empty slot
+constexpr std::array<uint8_t,MESSAGE_TYPE_TABLE_SIZE> makeMessageTypeTable()
+{
+    std::array<uint8_t,MESSAGE_TYPE_TABLE_SIZE> table{};
+    for( size_t i=0; i<MESSAGE_TYPE_NUMBER; i++ )
+    {
+        table[ messageTypeHash( MESSAGE_TYPE_TAGS[i].m_tag ) % MESSAGE_TYPE_TABLE_SIZE ] = uint8_t(i+1);
+    }
+    return table;
+}
+
+constexpr std::array<uint8_t,MESSAGE_TYPE_TABLE_SIZE> MESSAGE_TYPE_TABLE = makeMessageTypeTable();
+
+} // namespace detail
+
+// one hash and one string compare
+constexpr MessageType messageTypeOf( std::string_view tag )
+{
+    auto item = detail::MESSAGE_TYPE_TABLE[ messageTypeHash( tag ) % detail::MESSAGE_TYPE_TABLE_SIZE ];
+    if ( item == 0 || MESSAGE_TYPE_TAGS[item-1].m_tag != tag )
+    {
+        return mt_unknown;
+    }
+    return MESSAGE_TYPE_TAGS[item-1].m_type;
+}
+
+static_assert( messageTypeOf( CMT_STEP ) == mt_step );
+static_assert( messageTypeOf( "[Step" ) == mt_unknown );
+
+// appendMessage( out, SMT_ON_STEP, name, x_0, x, y ) appends "[OnStep],name,x_0,x,y;"
+// (no allocation when 'out' has the capacity)
+template<class ...Fields>
+void appendMessage( std::string& out, std::string_view messageType, const Fields&... fields )
+{
+    out += messageType;
+    ( ( out += ',', out += std::string_view(fields) ), ... );
+    out += ';';
+}
+
+// makeMessage( SMT_ON_STEP, name, x_0, x, y ) -> "[OnStep],name,x_0,x,y;"
+// (single allocation)
+template<class ...Fields>
+std::string makeMessage( std::string_view messageType, const Fields&... fields )
+{
+    std::string message;
+    message.reserve( messageType.size() + ( std::string_view(fields).size() + ... + 0 ) + sizeof...(Fields) + 1 );
+    appendMessage( message, messageType, fields... );
+    return message;
+}
 
 }
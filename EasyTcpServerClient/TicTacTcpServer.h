@@ -1,12 +1,22 @@
 #include "TcpServer.h"
 #include "TicTacProtocol.h"
+#include "MessageTokenizer.h"
+#include "Leaderboard.h"
+#include "Cluster.h"
 #include "Logs.h"
+#include <array>
+#include <cstdio>
+#include <cstring>
 #include <map>
+#include <mutex>
+#include <random>
+#include <unordered_map>
 
 namespace tic_tac {
 
 //class  TicTacServer;
-struct TicTacClientSession;
+class TicTacClientSession;
+class TicTacGame;
 
 // TicTacServer - abstart class (interface) that defines 'addClient' abstract function
 //
@@ -17,22 +27,165 @@ class ITicTacServer
 public:
     using ClientName = const std::string;
     
-    virtual bool addClient( ClientName&, const std::weak_ptr<TicTacClientSession>&, std::string& errorText ) = 0;
+    // 'isLobbySubscriber' == false -> the client does not receive lobby changes
+    virtual bool addClient( ClientName&, const std::weak_ptr<TicTacClientSession>&, bool isLobbySubscriber, std::string& errorText ) = 0;
     virtual void removeClient( const TicTacClientSession& ) = 0;
-    virtual std::string getPlayerListResponse() = 0;
     
-    virtual void sendPlayerListToAll() = 0;
+    // sends lobby snapshot; then the session receives lobby changes ([PlayerJoined],...)
+    virtual void sendPlayerList( TicTacClientSession& ) = 0;
     
-    virtual bool sendInvitaion( std::string senderPlayerName, std::string playerName, std::string& outErrorText ) = 0;
+    virtual bool sendInvitaion( std::string_view senderPlayerName, std::string_view playerName, std::string& outErrorText ) = 0;
     
-    virtual bool sendInvitaionAccepted( bool isAccepted, std::string senderPlayerName, std::string playerName, std::string& outErrorText ) = 0;
+    virtual bool sendInvitaionAccepted( bool isAccepted, std::string_view senderPlayerName, std::string_view playerName, std::string& outErrorText ) = 0;
     
-    virtual bool sendStep( std::string playerName, std::string x_0, std::string x, std::string y ) = 0;
+    virtual bool sendStep( std::string_view playerName, std::string_view x_0, std::string_view x, std::string_view y ) = 0;
     
-    virtual bool sendCloseGame( std::string playerName, std::string otherPlayerName ) = 0;
+    // pairs the session with the waiting player or makes it waiting
+    virtual bool findGame( TicTacClientSession&, std::string& outErrorText ) = 0;
+    virtual void cancelFindGame( const TicTacClientSession& ) = 0;
+    
+    virtual bool sendCloseGame( std::string_view playerName, std::string_view otherPlayerName ) = 0;
+    
+    // returns the running game of the player (nullptr -> 'outErrorText')
+    virtual std::shared_ptr<TicTacGame> findRunningGame( std::string_view playerName, std::string& outErrorText ) = 0;
+    
+    // game is closed or one of players disconnected (both players become free in the lobby)
+    virtual void onGameClosed( const TicTacGame& ) = 0;
+    
+    // time for a player to answer the partner's step (0 -> unlimited)
+    virtual std::chrono::milliseconds moveTimeout() const = 0;
+    
+    // finished game ('winnerIndex' -1 -> draw) is recorded in the leaderboard
+    virtual void onGameResult( const TicTacGame&, int winnerIndex ) = 0;
+    virtual void sendLeaderboard( TicTacClientSession& ) = 0;
+    
+    // session resumption: a registered session of a lost connection is kept for the grace period (0 -> not kept)
+    // and can be continued by [Resume],<token>
+    virtual std::chrono::milliseconds resumeGracePeriod() const = 0;
+    virtual void addDetachedSession( const std::shared_ptr<TicTacClientSession>& ) = 0;
+    
+    // removes the detached session of 'token' (nullptr -> unknown token, already resumed or expired)
+    virtual std::shared_ptr<TicTacClientSession> takeDetachedSession( const std::string& token ) = 0;
 };
 
 
+// TicTacGame - 2 players bound on [AcceptInvitation]
+//
+// [Step] and [CloseGame] are relayed to the partner session directly
+// (no lookup in the client map); "[OnStep],<receiver>," is serialized once per game
+//
+// Spectators ([Watch]) receive [OnStep] and [GameIsOver]: such a message is serialized once
+// into a shared buffer that the partner and all spectator write queues refer to
+//
+class TicTacGame: public std::enable_shared_from_this<TicTacGame>
+{
+    std::weak_ptr<TicTacClientSession>  m_players[2];
+    const TicTacClientSession*          m_playerPtrs[2];    // only for sender identification
+    std::string                         m_playerNames[2];
+    std::shared_ptr<const std::string>  m_onStepPrefix[2];
+
+    // number of relayed steps (see TicTacClientSession move timer)
+    std::atomic<uint64_t>               m_stepNumber{0};
+
+    // spectators are added on their own io threads, messages are sent on the players' io threads
+    std::mutex                                          m_spectatorMutex;
+    std::vector<std::weak_ptr<TicTacClientSession>>     m_spectators;
+
+    // [GameEnded] reports: winner index by each player (NOT_REPORTED, -1 -> draw)
+    static constexpr int                                NOT_REPORTED = -2;
+    std::mutex                                          m_resultMutex;
+    int                                                 m_reportedWinners[2] = { NOT_REPORTED, NOT_REPORTED };
+
+public:
+    enum ResultReport
+    {
+        rr_pending,     // the partner has not reported yet
+        rr_agreed,      // both players reported the same result
+        rr_conflict,    // the reports differ (both are dropped)
+    };
+
+    TicTacGame( const std::shared_ptr<TicTacClientSession>& player0, const std::shared_ptr<TicTacClientSession>& player1 );
+
+    const std::string& playerName( int index ) const { return m_playerNames[index]; }
+
+    int playerIndex( const TicTacClientSession& player ) const { return 1 - partnerIndex( player ); }
+
+    bool sendStep( const TicTacClientSession& sender, std::string_view x_0, std::string_view x, std::string_view y );
+
+    uint64_t stepNumber() const { return m_stepNumber.load(); }
+
+    // sends [GameClosed] to the partner and unbinds both sessions
+    bool close( const TicTacClientSession& sender );
+
+    // sends [PlayerOfflined] to the partner and unbinds it
+    void playerDisconnected( const TicTacClientSession& sender );
+
+    // the partner of 'sender' did not answer its step in time:
+    // sends [GameIsOver] to both players and unbinds the partner
+    void moveTimedOut( const TicTacClientSession& sender );
+
+    // 'winnerIndex' reported by 'sender' ([GameEnded])
+    ResultReport reportResult( const TicTacClientSession& sender, int winnerIndex );
+
+    // the reported result is agreed: sends [GameIsOver] to both players and unbinds the partner
+    void finish( const TicTacClientSession& sender, int winnerIndex );
+
+    void addSpectator( const std::shared_ptr<TicTacClientSession>& spectator );
+    void removeSpectator( const TicTacClientSession& spectator );
+
+    // hot restart: (-2 -> not reported)
+    int reportedWinner( int index );
+    void restoreProgress( uint64_t stepNumber, int reportedWinner0, int reportedWinner1 );
+
+private:
+    // must be called under 'm_spectatorMutex'
+    void sendToSpectators( const std::shared_ptr<const std::string>& message );
+
+    // sends [GameIsOver] to the spectators and drops them
+    void endForSpectators( std::string_view reason, std::string_view playerName );
+
+    // sends [GameIsOver] to both players and the spectators and unbinds the partner of 'sender'
+    void gameOver( const TicTacClientSession& sender, std::string&& message );
+
+    int partnerIndex( const TicTacClientSession& sender ) const;
+    void unbind( int index );
+};
+
+
+// 128 random bits (hex), kept inline: a 32-char std::string does not fit its small buffer
+class ResumeToken
+{
+    std::array<char,32> m_data;
+    uint8_t             m_size = 0;
+
+public:
+    bool empty() const { return m_size == 0; }
+
+    std::string_view view() const { return std::string_view( m_data.data(), m_size ); }
+
+    // longer 'token' -> empty
+    void assign( std::string_view token )
+    {
+        m_size = ( token.size() <= m_data.size() ) ? uint8_t( token.size() ) : 0;
+        std::memcpy( m_data.data(), token.data(), m_size );
+    }
+
+    static ResumeToken make()
+    {
+        thread_local std::random_device randomDevice;
+
+        ResumeToken token;
+        for( int i=0; i<4; i++ )
+        {
+            char hex[9];
+            std::snprintf( hex, sizeof(hex), "%08x", unsigned( randomDevice() ) );
+            std::memcpy( token.m_data.data() + 8*i, hex, 8 );
+        }
+        token.m_size = 32;
+        return token;
+    }
+};
+
 // Session derived from TCP session
 // It is from applied/subject level of the program
 // It related to subject logic
@@ -42,7 +195,20 @@ class TicTacClientSession: public TcpClientSession
     ITicTacServer& m_ticTacServer;
     std::string    m_playerName;
     
-    std::weak_ptr<TicTacClientSession>  m_otherPlayer;
+    // current game (accessed only on the session's io thread)
+    std::shared_ptr<TicTacGame>  m_game;
+    
+    // game watched by [Watch] (accessed only on the session's io thread)
+    std::weak_ptr<TicTacGame>    m_watchedGame;
+    
+    // armed when our step is relayed: the partner must answer until the deadline
+    enum { tk_move = tk_session_timer_number, tk_resume, tk_tic_tac_timer_number };
+    TimerWheel::Timer            m_moveTimer;
+    uint64_t                     m_awaitedStepNumber = 0;
+    
+    // session resumption (see ITicTacServer::resumeGracePeriod): empty token -> the session ends with its connection
+    ResumeToken                  m_resumeToken;
+    TimerWheel::Timer            m_resumeTimer;     // grace period of the detached session
     
 public:
     TicTacClientSession( ITicTacServer& ticTacServer, boost::asio::ip::tcp::socket&& socket )
@@ -52,19 +218,203 @@ public:
     
     ~TicTacClientSession()
     {
-        LOG( "~TicTacClientSession: " << this );
+        LOG_DBG( "~TicTacClientSession: " << this );
     }
     
     void connectionLost( boost::system::error_code error ) override
     {
+        // the player stays in the lobby and in its game until [Resume] or the end of the grace period
+        if ( ! m_resumeToken.empty() && m_timerWheel != nullptr )
+        {
+            // (a live player must not be paired with it)
+            m_ticTacServer.cancelFindGame( *this );
+            detachForResume();
+            return;
+        }
+        endSession();
+    }
+    
+    void detachForResume()
+    {
+        detach();
+        m_ticTacServer.addDetachedSession( std::static_pointer_cast<TicTacClientSession>( shared_from_this() ) );
+        m_timerWheel->arm( m_resumeTimer, *this, tk_resume, m_ticTacServer.resumeGracePeriod() );
+    }
+    
+    void endSession()
+    {
+        stopWatching();
+        if ( auto game = std::move(m_game); game )
+        {
+            game->playerDisconnected( *this );
+            m_ticTacServer.onGameClosed( *game );
+        }
         m_ticTacServer.removeClient( *this );
     }
 
-    std::string playerName() const { return m_playerName; }
+    uint8_t timerNumber() const override { return tk_tic_tac_timer_number; }
+    
+    TimerWheel::Timer& timer( uint8_t kind ) override
+    {
+        switch ( kind )
+        {
+            case tk_move:   return m_moveTimer;
+            case tk_resume: return m_resumeTimer;
+            default:        return TcpClientSession::timer( kind );
+        }
+    }
     
-    void onMessage( const std::string& request ) override
+    void onTimer( uint8_t kind ) override
     {
-        LOG( "TicTacClientSession::onMessage: " << request );
+        // hot restart: the state is handed over as is
+        if ( isPaused() )
+        {
+            return;
+        }
+        
+        if ( kind == tk_resume )
+        {
+            // not resumed in time (otherwise the token is already taken)
+            if ( auto self = m_ticTacServer.takeDetachedSession( std::string( m_resumeToken.view() ) ); self )
+            {
+                LOG( "TicTacClientSession resume grace period expired: " << m_playerName );
+                endSession();
+            }
+            return;
+        }
+        
+        if ( kind != tk_move )
+        {
+            TcpClientSession::onTimer( kind );
+            return;
+        }
+        
+        // the partner has not answered (otherwise the step number is changed)
+        if ( m_game && m_game->stepNumber() == m_awaitedStepNumber )
+        {
+            auto game = std::move(m_game);
+            game->moveTimedOut( *this );
+            m_ticTacServer.onGameResult( *game, game->playerIndex( *this ) );
+            m_ticTacServer.onGameClosed( *game );
+        }
+    }
+    
+    // lobby updates were dropped by back-pressure: resynchronize by new snapshot
+    void onLobbyUpdatesDropped() override
+    {
+        if ( ! m_playerName.empty() )
+        {
+            m_ticTacServer.sendPlayerList( *this );
+        }
+    }
+
+    size_t messageTypeIndex( std::string_view frame ) const override
+    {
+        return messageTypeOf( frame.substr( 0, frame.find_first_of( ",;" ) ) );
+    }
+
+    const std::string& playerName() const { return m_playerName; }
+    std::string_view resumeToken() const { return m_resumeToken.view(); }
+    
+    // hot restart (see TicTacServer::restoreState())
+    struct SavedState
+    {
+        std::string     m_playerName;           // empty -> not registered
+        std::string     m_resumeToken;
+        std::string     m_partnerName;          // empty -> no game
+        int             m_playerIndex = 0;
+        uint64_t        m_stepNumber = 0;
+        int             m_reportedWinner = -2;
+        uint64_t        m_awaitedStepNumber = 0; // 0 -> the move timer is not armed
+        std::string     m_watchedPlayerName;
+    };
+    
+    std::string saveState() const override
+    {
+        hot_restart::StateWriter writer;
+        writer.put( m_playerName );
+        writer.put( m_resumeToken.view() );
+        
+        int index = m_game ? m_game->playerIndex( *this ) : 0;
+        writer.put( m_game ? std::string_view( m_game->playerName( 1-index ) ) : std::string_view() );
+        writer.put( uint64_t(index) );
+        writer.put( m_game ? m_game->stepNumber() : 0 );
+        writer.put( uint64_t( ( m_game ? m_game->reportedWinner( index ) : -2 ) + 2 ) );
+        writer.put( ( m_moveTimer.m_deadlineTick != 0 ) ? m_awaitedStepNumber : 0 );
+        
+        auto watchedGame = m_watchedGame.lock();
+        writer.put( watchedGame ? std::string_view( watchedGame->playerName(0) ) : std::string_view() );
+        return std::move( writer.data() );
+    }
+    
+    static bool parseState( std::string_view data, SavedState& outState )
+    {
+        hot_restart::StateReader reader( data );
+        outState.m_playerName        = reader.getString();
+        outState.m_resumeToken       = reader.getString();
+        outState.m_partnerName       = reader.getString();
+        outState.m_playerIndex       = int( reader.getNumber() ) & 1;
+        outState.m_stepNumber        = reader.getNumber();
+        outState.m_reportedWinner    = int( reader.getNumber() ) - 2;
+        outState.m_awaitedStepNumber = reader.getNumber();
+        outState.m_watchedPlayerName = reader.getString();
+        return reader.isOk();
+    }
+    
+    // must be called before the session continues
+    void restoreRegistration( const SavedState& state )
+    {
+        m_playerName = state.m_playerName;
+        m_resumeToken.assign( state.m_resumeToken );
+    }
+    
+    // (the move timer is re-armed for the whole timeout)
+    void restoreGame( const std::shared_ptr<TicTacGame>& game, uint64_t awaitedStepNumber )
+    {
+        m_game = game;
+        if ( auto timeout = m_ticTacServer.moveTimeout(); awaitedStepNumber != 0 && timeout.count() > 0 && m_timerWheel != nullptr )
+        {
+            m_awaitedStepNumber = awaitedStepNumber;
+            m_timerWheel->arm( m_moveTimer, *this, tk_move, timeout );
+        }
+    }
+    
+    void restoreWatching( const std::shared_ptr<TicTacGame>& game )
+    {
+        game->addSpectator( std::static_pointer_cast<TicTacClientSession>( shared_from_this() ) );
+        m_watchedGame = game;
+    }
+    
+    // continues the detached session on the connection of [Resume] (on the session's io thread)
+    void resume( ReleasedSocket socket )
+    {
+        TimerWheel::disarm( m_resumeTimer );
+        if ( ! attachSocket( socket, makeMessage( SMT_RESUMED, m_playerName ) ) )
+        {
+            endSession();
+        }
+    }
+
+    // must be called on the session's io thread
+    void setGame( const std::shared_ptr<TicTacGame>& game )
+    {
+        m_game = game;
+        TimerWheel::disarm( m_moveTimer );
+    }
+    const std::shared_ptr<TicTacGame>& game() const { return m_game; }
+    
+    void stopWatching()
+    {
+        if ( auto watchedGame = m_watchedGame.lock(); watchedGame )
+        {
+            watchedGame->removeSpectator( *this );
+        }
+        m_watchedGame.reset();
+    }
+    
+    void onMessage( std::string_view request ) override
+    {
+        LOG_DBG( "TicTacClientSession::onMessage: " << request );
         
         if ( request.empty() )
         {
@@ -72,270 +422,1363 @@ public:
             return;
         }
         
-        std::vector<std::string> tokens;
-        boost::split( tokens, request, boost::is_any_of(",") );
+        MessageTokens<5> tokens( request );
         
-        std::string messageType = tokens[0];
+        auto messageType = tokens[0];
         
-        if ( messageType == CMT_PLAYER_NAME )
+        switch ( messageTypeOf( messageType ) )
         {
-            if ( tokens.size() < 2 )
+            case mt_player_name:
             {
-                LOG_ERR( "TcpClientSession bad request (2): " << request );
-                return;
+                if ( tokens.size() < 2 )
+                {
+                    LOG_ERR( "TcpClientSession bad request (2): " << request );
+                    return;
+                }
+                
+                std::string playerName( tokens[1] );
+                LOG_DBG( "playerName: " << playerName );
+                
+                bool isLobbySubscriber = ( tokens[2] != "0" );
+                
+                std::string errorText;
+                if ( ! m_playerName.empty() )
+                {
+                    write( makeMessage( SMT_ON_ERROR, "already registered" ) );
+                    return;
+                }
+                if ( ! m_ticTacServer.addClient( playerName, std::dynamic_pointer_cast<TicTacClientSession>( shared_from_this() ), isLobbySubscriber, errorText ) )
+                {
+                    write( makeMessage( SMT_ON_ERROR, errorText ) );
+                    return;
+                }
+                m_playerName = std::move(playerName);
+                
+                if ( m_ticTacServer.resumeGracePeriod().count() > 0 )
+                {
+                    m_resumeToken = ResumeToken::make();
+                    write( makeMessage( SMT_OK, m_resumeToken.view() ) );
+                }
+                else
+                {
+                    write( makeMessage( SMT_OK ) );
+                }
+                
+                if ( isLobbySubscriber )
+                {
+                    m_ticTacServer.sendPlayerList( *this );
+                }
+                break;
             }
-            
-            m_playerName = tokens[1];
-            LOG( "playerName: " << m_playerName );
-            
-            std::string errorText;
-            if ( ! m_ticTacServer.addClient( m_playerName, std::dynamic_pointer_cast<TicTacClientSession>( shared_from_this() ), errorText ) )
+            case mt_get_player_list:
             {
-                std::string response = (SMT_ON_ERROR) + "," + errorText + ";";
-                write( response );
-                return;
+                m_ticTacServer.sendPlayerList( *this );
+                break;
             }
-            
-            std::string response = (SMT_OK) + ";";
-            write( response );
-            
-            m_ticTacServer.sendPlayerListToAll();
-        }
-        else if ( messageType == CMT_INVITE )
-        {
-            if ( tokens.size() < 2 )
+            case mt_resume:
             {
-                LOG_ERR( "TcpClientSession bad request (3): " << request );
-                return;
+                if ( tokens.size() < 2 || ! m_playerName.empty() )
+                {
+                    LOG_ERR( "TcpClientSession bad request (resume): " << request );
+                    return;
+                }
+                
+                auto session = m_ticTacServer.takeDetachedSession( std::string( tokens[1] ) );
+                if ( ! session )
+                {
+                    write( makeMessage( SMT_ON_ERROR, "unknown or expired resume token" ) );
+                    return;
+                }
+                
+                // this connection continues the detached session (on its io thread, without lobby events)
+                // with the data received after [Resume]; this session ends
+                releaseSocketWhenIdle( [session] ( ReleasedSocket socket )
+                {
+                    session->runInSessionThread( [session,socket=std::move(socket)]
+                    {
+                        session->resume( socket );
+                    });
+                });
+                break;
             }
-            
-            auto& otherPlayerName = tokens[1];
-            LOG( "otherPlayerName: " << otherPlayerName );
-            
-            std::string outErrorText;
-            
-            if ( ! m_ticTacServer.sendInvitaion( m_playerName, otherPlayerName, outErrorText ) )
+            case mt_invite:
+            {
+                if ( tokens.size() < 2 )
+                {
+                    LOG_ERR( "TcpClientSession bad request (3): " << request );
+                    return;
+                }
+                
+                auto otherPlayerName = tokens[1];
+                LOG_DBG( "otherPlayerName: " << otherPlayerName );
+                
+                std::string outErrorText;
+                
+                if ( ! m_ticTacServer.sendInvitaion( m_playerName, otherPlayerName, outErrorText ) )
+                {
+                    LOG_DBG( "Invite error: " << outErrorText );
+                    write( makeMessage( SMT_INVITITAION_REJECTED, otherPlayerName ) );
+                }
+                break;
+            }
+            case mt_accept_invitation:
+            case mt_reject_invitation:
+            {
+                if ( tokens.size() < 2 )
+                {
+                    LOG_ERR( "TcpClientSession bad request (4): " << request );
+                    return;
+                }
+                
+                auto otherPlayerName = tokens[1];
+                LOG_DBG( "otherPlayerName: " << otherPlayerName );
+                
+                std::string outErrorText;
+                
+                if ( ! m_ticTacServer.sendInvitaionAccepted( (messageType == CMT_ACCEPT_INVITITAION), m_playerName, otherPlayerName, outErrorText ) )
+                {
+                    LOG_DBG( "Invite error: " << outErrorText );
+                    write( makeMessage( SMT_PLAYER_OFFLINED, otherPlayerName ) );
+                }
+                break;
+            }
+            case mt_find_game:
+            {
+                std::string outErrorText;
+                if ( m_game )
+                {
+                    write( makeMessage( SMT_ON_ERROR, "already in game" ) );
+                }
+                else if ( ! m_ticTacServer.findGame( *this, outErrorText ) )
+                {
+                    write( makeMessage( SMT_ON_ERROR, outErrorText ) );
+                }
+                break;
+            }
+            case mt_cancel_find_game:
+            {
+                m_ticTacServer.cancelFindGame( *this );
+                break;
+            }
+            case mt_watch:
+            {
+                if ( tokens.size() < 2 )
+                {
+                    LOG_ERR( "TcpClientSession bad request (5): " << request );
+                    return;
+                }
+                
+                std::string outErrorText;
+                if ( m_game )
+                {
+                    write( makeMessage( SMT_ON_ERROR, "already in game" ) );
+                }
+                else if ( auto game = m_ticTacServer.findRunningGame( tokens[1], outErrorText ); ! game )
+                {
+                    write( makeMessage( SMT_ON_ERROR, outErrorText ) );
+                }
+                else
+                {
+                    stopWatching();
+                    m_watchedGame = game;
+                    
+                    // [Watching] is queued before the first relayed message
+                    write( makeMessage( SMT_WATCHING, game->playerName(0), game->playerName(1) ) );
+                    game->addSpectator( std::dynamic_pointer_cast<TicTacClientSession>( shared_from_this() ) );
+                }
+                break;
+            }
+            case mt_step:
+            {
+                if ( tokens.size() != 5 )
+                {
+                    LOG_ERR( "TcpClientSession bad request (4): " << request );
+                    return;
+                }
+                
+                if ( m_game )
+                {
+                    if ( ! m_game->sendStep( *this, tokens[2], tokens[3], tokens[4] ) )
+                    {
+                        write( makeMessage( SMT_PLAYER_OFFLINED, tokens[1] ) );
+                    }
+                    else if ( auto timeout = m_ticTacServer.moveTimeout(); timeout.count() > 0 && m_timerWheel != nullptr )
+                    {
+                        m_awaitedStepNumber = m_game->stepNumber();
+                        m_timerWheel->arm( m_moveTimer, *this, tk_move, timeout );
+                    }
+                }
+                else if ( ! m_ticTacServer.sendStep( tokens[1], tokens[2], tokens[3], tokens[4] ) )
+                {
+                    write( makeMessage( SMT_PLAYER_OFFLINED, tokens[1] ) );
+                }
+                break;
+            }
+            case mt_game_ended:
+            {
+                if ( tokens.size() < 2 )
+                {
+                    LOG_ERR( "TcpClientSession bad request (6): " << request );
+                    return;
+                }
+                
+                if ( ! m_game )
+                {
+                    write( makeMessage( SMT_ON_ERROR, "not in game" ) );
+                    break;
+                }
+                
+                auto index = m_game->playerIndex( *this );
+                int winnerIndex;
+                if ( tokens[1] == "win" )        winnerIndex = index;
+                else if ( tokens[1] == "loss" )  winnerIndex = 1-index;
+                else if ( tokens[1] == "draw" )  winnerIndex = -1;
+                else
+                {
+                    LOG_ERR( "TcpClientSession bad request (7): " << request );
+                    return;
+                }
+                
+                switch ( m_game->reportResult( *this, winnerIndex ) )
+                {
+                    case TicTacGame::rr_pending:
+                        break;
+                    case TicTacGame::rr_conflict:
+                        write( makeMessage( SMT_ON_ERROR, "result conflict" ) );
+                        break;
+                    case TicTacGame::rr_agreed:
+                    {
+                        TimerWheel::disarm( m_moveTimer );
+                        auto game = std::move(m_game);
+                        game->finish( *this, winnerIndex );
+                        m_ticTacServer.onGameResult( *game, winnerIndex );
+                        m_ticTacServer.onGameClosed( *game );
+                        break;
+                    }
+                }
+                break;
+            }
+            case mt_get_leaderboard:
             {
-                LOG( "Invite error: " << outErrorText );
-                std::string response = (SMT_INVITITAION_REJECTED) + "," + otherPlayerName + ";";
-                write( response );
+                m_ticTacServer.sendLeaderboard( *this );
+                break;
             }
+            case mt_close_game:
+            {
+                if ( tokens.size() < 2 )
+                {
+                    LOG_ERR( "TcpClientSession bad request (4): " << request );
+                    return;
+                }
+                
+                auto otherPlayerName = tokens[1];
+                LOG_DBG( "otherPlayerName: " << otherPlayerName );
+                
+                TimerWheel::disarm( m_moveTimer );
+                if ( auto game = std::move(m_game); game )
+                {
+                    if ( ! game->close( *this ) )
+                    {
+                        write( makeMessage( SMT_PLAYER_OFFLINED, otherPlayerName ) );
+                    }
+                    m_ticTacServer.onGameClosed( *game );
+                }
+                else if ( ! m_ticTacServer.sendCloseGame( m_playerName, otherPlayerName ) )
+                {
+                    write( makeMessage( SMT_PLAYER_OFFLINED, otherPlayerName ) );
+                }
+                break;
+            }
+            default:
+            {
+                LOG_ERR( "Unnkown message type: " << messageType );
+            }
+        }
+    }
+};
+
+inline TicTacGame::TicTacGame( const std::shared_ptr<TicTacClientSession>& player0, const std::shared_ptr<TicTacClientSession>& player1 )
+  : m_players{ player0, player1 },
+    m_playerPtrs{ player0.get(), player1.get() },
+    m_playerNames{ player0->playerName(), player1->playerName() }
+{
+    for( int i=0; i<2; i++ )
+    {
+        m_onStepPrefix[i] = std::make_shared<const std::string>( std::string(SMT_ON_STEP) + "," + m_playerNames[i] + "," );
+    }
+}
+
+inline int TicTacGame::partnerIndex( const TicTacClientSession& sender ) const
+{
+    return ( m_playerPtrs[0] == &sender ) ? 1 : 0;
+}
+
+inline bool TicTacGame::sendStep( const TicTacClientSession& sender, std::string_view x_0, std::string_view x, std::string_view y )
+{
+    auto index = partnerIndex( sender );
+    auto partner = m_players[index].lock();
+    if ( ! partner )
+    {
+        return false;
+    }
+
+    // "x_0,x,y;" fits into std::string small buffer (no allocation)
+    std::string tail;
+    tail.reserve( x_0.size() + x.size() + y.size() + 3 );
+    tail += x_0;
+    tail += ',';
+    tail += x;
+    tail += ',';
+    tail += y;
+    tail += ';';
+
+    m_stepNumber++;
+
+    std::lock_guard<std::mutex> lock(m_spectatorMutex);
+    if ( m_spectators.empty() )
+    {
+        partner->write( m_onStepPrefix[index], std::move(tail) );
+        return true;
+    }
+
+    auto message = std::make_shared<std::string>();
+    message->reserve( m_onStepPrefix[index]->size() + tail.size() );
+    *message += *m_onStepPrefix[index];
+    *message += tail;
+
+    std::shared_ptr<const std::string> sharedMessage = std::move(message);
+    partner->write( sharedMessage );
+    sendToSpectators( sharedMessage );
+    return true;
+}
+
+inline bool TicTacGame::close( const TicTacClientSession& sender )
+{
+    auto index = partnerIndex( sender );
+    endForSpectators( "closed", m_playerNames[1-index] );
+
+    auto partner = m_players[index].lock();
+    if ( ! partner )
+    {
+        return false;
+    }
+
+    partner->write( makeMessage( SMT_GAME_CLOSED, m_playerNames[1-index] ) );
+    unbind( index );
+    return true;
+}
+
+inline void TicTacGame::playerDisconnected( const TicTacClientSession& sender )
+{
+    auto index = partnerIndex( sender );
+    endForSpectators( "offline", m_playerNames[1-index] );
+
+    if ( auto partner = m_players[index].lock(); partner )
+    {
+        partner->write( makeMessage( SMT_PLAYER_OFFLINED, m_playerNames[1-index] ) );
+        unbind( index );
+    }
+}
+
+inline void TicTacGame::moveTimedOut( const TicTacClientSession& sender )
+{
+    gameOver( sender, makeMessage( SMT_GAME_IS_OVER, "timeout", m_playerNames[partnerIndex( sender )] ) );
+}
+
+inline TicTacGame::ResultReport TicTacGame::reportResult( const TicTacClientSession& sender, int winnerIndex )
+{
+    std::lock_guard<std::mutex> lock(m_resultMutex);
+
+    auto index = playerIndex( sender );
+    m_reportedWinners[index] = winnerIndex;
+
+    if ( m_reportedWinners[1-index] == NOT_REPORTED )
+    {
+        return rr_pending;
+    }
+    if ( m_reportedWinners[1-index] != winnerIndex )
+    {
+        m_reportedWinners[0] = m_reportedWinners[1] = NOT_REPORTED;
+        return rr_conflict;
+    }
+    return rr_agreed;
+}
+
+inline void TicTacGame::finish( const TicTacClientSession& sender, int winnerIndex )
+{
+    gameOver( sender, ( winnerIndex < 0 ) ? makeMessage( SMT_GAME_IS_OVER, "draw", "" )
+                                          : makeMessage( SMT_GAME_IS_OVER, "won", m_playerNames[winnerIndex] ) );
+}
+
+inline void TicTacGame::gameOver( const TicTacClientSession& sender, std::string&& gameOverMessage )
+{
+    auto index = partnerIndex( sender );
+    auto message = std::make_shared<const std::string>( std::move(gameOverMessage) );
+
+    if ( auto partner = m_players[index].lock(); partner )
+    {
+        partner->write( message );
+        unbind( index );
+    }
+    if ( auto player = m_players[1-index].lock(); player )
+    {
+        player->write( message );
+    }
+
+    std::lock_guard<std::mutex> lock(m_spectatorMutex);
+    sendToSpectators( message );
+    m_spectators.clear();
+}
+
+inline int TicTacGame::reportedWinner( int index )
+{
+    std::lock_guard<std::mutex> lock(m_resultMutex);
+    return m_reportedWinners[index];
+}
+
+inline void TicTacGame::restoreProgress( uint64_t stepNumber, int reportedWinner0, int reportedWinner1 )
+{
+    m_stepNumber = stepNumber;
+
+    std::lock_guard<std::mutex> lock(m_resultMutex);
+    m_reportedWinners[0] = reportedWinner0;
+    m_reportedWinners[1] = reportedWinner1;
+}
+
+inline void TicTacGame::addSpectator( const std::shared_ptr<TicTacClientSession>& spectator )
+{
+    std::lock_guard<std::mutex> lock(m_spectatorMutex);
+    m_spectators.push_back( spectator );
+}
+
+inline void TicTacGame::removeSpectator( const TicTacClientSession& spectator )
+{
+    std::lock_guard<std::mutex> lock(m_spectatorMutex);
+    auto end = std::remove_if( m_spectators.begin(), m_spectators.end(), [&spectator] ( const auto& weakSpectator )
+    {
+        auto session = weakSpectator.lock();
+        return ! session || session.get() == &spectator;
+    });
+    m_spectators.erase( end, m_spectators.end() );
+}
+
+inline void TicTacGame::sendToSpectators( const std::shared_ptr<const std::string>& message )
+{
+    // disconnected spectators are dropped on the way
+    auto end = std::remove_if( m_spectators.begin(), m_spectators.end(), [&message] ( const auto& weakSpectator )
+    {
+        if ( auto spectator = weakSpectator.lock(); spectator )
+        {
+            spectator->write( message );
+            return false;
         }
-        else if ( messageType == CMT_ACCEPT_INVITITAION || messageType == CMT_REJECT_INVITITAION )
+        return true;
+    });
+    m_spectators.erase( end, m_spectators.end() );
+}
+
+inline void TicTacGame::endForSpectators( std::string_view reason, std::string_view playerName )
+{
+    std::lock_guard<std::mutex> lock(m_spectatorMutex);
+    if ( ! m_spectators.empty() )
+    {
+        sendToSpectators( std::make_shared<const std::string>( makeMessage( SMT_GAME_IS_OVER, reason, playerName ) ) );
+        m_spectators.clear();
+    }
+}
+
+inline void TicTacGame::unbind( int index )
+{
+    if ( auto player = m_players[index].lock(); player )
+    {
+        player->runInSessionThread( [player,game=shared_from_this()]
         {
-            if ( tokens.size() < 2 )
+            if ( player->game() == game )
             {
-                LOG_ERR( "TcpClientSession bad request (4): " << request );
-                return;
+                player->setGame( nullptr );
             }
-            
-            auto& otherPlayerName = tokens[1];
-            LOG( "otherPlayerName: " << otherPlayerName );
-            
-            std::string outErrorText;
-            
-            if ( ! m_ticTacServer.sendInvitaionAccepted( (messageType == CMT_ACCEPT_INVITITAION), m_playerName, otherPlayerName, outErrorText ) )
+        });
+    }
+}
+
+// Server - derived from TCP server
+// It provides 2 methods:
+//    createSession() for base class
+//    addClient() for session
+//
+// Plus it contains map of sessioons
+// (sessions live on different io threads, so the map is guarded by 'm_clientMapMutex')
+//
+// Lobby: new player receives [PlayerList] snapshot, all others receive only
+// numbered changes ([PlayerJoined], [PlayerLeft], [PlayerBusy]).
+// Snapshot is serialized once into shared buffer and reused until the next change.
+// Players registered by "[PlayerName],<name>,0" receive no lobby changes (they use [FindGame]).
+//
+// Cluster mode (see startCluster()): the lobby also lists the players of the other nodes.
+//
+class TicTacServer: public TcpServer, public ITicTacServer, public cluster::INodeHandler
+{
+    struct PlayerInfo
+    {
+        std::weak_ptr<TicTacClientSession> m_session;
+        bool                               m_isBusy = false;
+        bool                               m_isLobbySubscriber = true;
+        std::weak_ptr<TicTacGame>          m_game;         // running game (for [Watch])
+        uint32_t                           m_nodeId = 0;   // 0 -> player of this node, otherwise of a peer (no session)
+
+        PlayerInfo() = default;
+
+        // player of this node
+        PlayerInfo( std::weak_ptr<TicTacClientSession> session, bool isBusy, bool isLobbySubscriber )
+          : m_session( std::move(session) ), m_isBusy( isBusy ), m_isLobbySubscriber( isLobbySubscriber ) {}
+
+        // player of another node
+        explicit PlayerInfo( uint32_t nodeId ) : m_isLobbySubscriber( false ), m_nodeId( nodeId ) {}
+    };
+
+    std::mutex                                   m_clientMapMutex;
+    std::map<ClientName,PlayerInfo,std::less<>>  m_clientMap;
+
+    // guarded by 'm_clientMapMutex'
+    uint64_t                                     m_lobbySequence = 0;
+    std::shared_ptr<const std::string>           m_playerListSnapshot;
+
+    // matchmaking queue (guarded by 'm_clientMapMutex'):
+    // a game needs 2 players, so at most one player is waiting - the next one is paired with it
+    std::weak_ptr<TicTacClientSession>           m_waitingPlayer;
+
+    std::chrono::milliseconds                    m_moveTimeout{0};
+
+    std::unique_ptr<Leaderboard>                 m_leaderboard;
+    std::mutex                                   m_leaderboardMutex;
+    std::shared_ptr<const std::string>           m_leaderboardSnapshot;   // [Leaderboard] until the next result
+    
+    // sessions of lost connections waiting for [Resume] (by token)
+    std::chrono::milliseconds                    m_resumeGracePeriod{0};
+    std::mutex                                   m_detachedSessionMutex;
+    std::unordered_map<std::string,std::shared_ptr<TicTacClientSession>> m_detachedSessions;
+    
+    // cluster mode (links and endpoint run on the acceptor thread; 'm_nodeLinks' is not changed after 'startCluster()')
+    std::vector<std::unique_ptr<cluster::NodeLink>> m_nodeLinks;
+    std::optional<cluster::ClusterEndpoint>      m_clusterEndpoint;
+
+    // games between nodes (under 'm_clientMapMutex'): player -> its partner on another node, both directions
+    // (the local partner is told [PlayerOfflined] when the remote one leaves or its node is lost)
+    std::unordered_map<std::string,std::string>  m_crossNodePartners;
+    
+public:
+    TicTacServer( const std::string& addr, const std::string& port, size_t ioThreadNumber = 0, int listenSocket = -1,
+                  const SocketOptions& socketOptions = {} )
+      : TcpServer( addr, port, ioThreadNumber, listenSocket, socketOptions ) {}
+    
+    virtual std::shared_ptr<TcpClientSession> createSession( boost::asio::ip::tcp::socket&& socket ) override
+    {
+        auto ptr = std::make_shared<TicTacClientSession>( *this, std::move(socket) );
+        return ptr->shared_from_this();
+    }
+    
+    // a player that does not answer the partner's step in 'timeout' loses (0 -> unlimited, the default);
+    // must be called before 'run()'
+    void setMoveTimeout( std::chrono::milliseconds timeout ) { m_moveTimeout = timeout; }
+    
+    std::chrono::milliseconds moveTimeout() const override { return m_moveTimeout; }
+    
+    // sessions of lost connections are kept for 'period' (0 -> not kept); must be called before 'run()'
+    void setResumeGracePeriod( std::chrono::milliseconds period ) { m_resumeGracePeriod = period; }
+    
+    std::chrono::milliseconds resumeGracePeriod() const override { return m_resumeGracePeriod; }
+    
+    virtual void addDetachedSession( const std::shared_ptr<TicTacClientSession>& session ) override
+    {
+        std::lock_guard<std::mutex> lock(m_detachedSessionMutex);
+        m_detachedSessions[std::string( session->resumeToken() )] = session;
+    }
+    
+    // number of sessions waiting for [Resume]
+    size_t detachedSessionNumber()
+    {
+        std::lock_guard<std::mutex> lock(m_detachedSessionMutex);
+        return m_detachedSessions.size();
+    }
+    
+    // hot restart: the lobby (the states of the sessions are saved by TicTacClientSession::saveState())
+    std::string saveServerState() override
+    {
+        // no result is recorded since (all sessions are paused)
+        if ( m_leaderboard )
+        {
+            m_leaderboard->flush();
+        }
+        
+        std::lock_guard<std::mutex> lock(m_clientMapMutex);
+        
+        hot_restart::StateWriter writer;
+        writer.put( m_lobbySequence );
+        auto waitingPlayer = m_waitingPlayer.lock();
+        writer.put( waitingPlayer ? std::string_view( waitingPlayer->playerName() ) : std::string_view() );
+        // (players of other nodes are announced again by the links of the successor)
+        auto playerNumber = std::count_if( m_clientMap.begin(), m_clientMap.end(), [] ( const auto& item ) { return item.second.m_nodeId == 0; } );
+        writer.put( uint64_t( playerNumber ) );
+        for( const auto& [name,playerInfo] : m_clientMap )
+        {
+            if ( playerInfo.m_nodeId != 0 )
             {
-                LOG( "Invite error: " << outErrorText );
-                std::string response = (SMT_PLAYER_OFFLINED) + "," + otherPlayerName + ";";
-                write( response );
+                continue;
             }
+            writer.put( name );
+            writer.put( uint64_t( playerInfo.m_isBusy ) );
+            writer.put( uint64_t( playerInfo.m_isLobbySubscriber ) );
         }
-        else if ( messageType == CMT_STEP )
+        return std::move( writer.data() );
+    }
+    
+    // hot restart: the lobby, the games and the spectators are rebuilt (sessions do not run yet);
+    // a game whose partner is not handed over is lost ([PlayerOfflined])
+    void restoreState( std::string_view serverState, std::vector<RestoredSession>& sessions ) override
+    {
+        std::vector<TicTacClientSession::SavedState> states( sessions.size() );
+        std::map<std::string,std::shared_ptr<TicTacClientSession>,std::less<>> sessionByName;
+        std::map<std::string,size_t,std::less<>> stateIndexByName;
+        
+        std::lock_guard<std::mutex> lock(m_clientMapMutex);
+        
+        for( size_t i=0; i<sessions.size(); i++ )
         {
-            if ( tokens.size() != 5 )
+            auto session = std::static_pointer_cast<TicTacClientSession>( sessions[i].m_session );
+            if ( ! TicTacClientSession::parseState( sessions[i].m_state, states[i] ) )
             {
-                LOG_ERR( "TcpClientSession bad request (4): " << request );
-                return;
+                LOG_ERR( "TicTacServer hot restart: bad session state" );
+                states[i] = {};
             }
-
-            if ( ! m_ticTacServer.sendStep( tokens[1], tokens[2], tokens[3], tokens[4] ) )
+            session->restoreRegistration( states[i] );
+            if ( ! states[i].m_playerName.empty() )
             {
-                std::string response = (SMT_PLAYER_OFFLINED) + "," + tokens[1] + ";";
-                write( response );
+                sessionByName[states[i].m_playerName] = session;
+                stateIndexByName[states[i].m_playerName] = i;
             }
         }
-        else if ( messageType == CMT_CLOSE_GAME )
+        
+        hot_restart::StateReader reader( serverState );
+        m_lobbySequence = reader.getNumber();
+        std::string waitingPlayerName( reader.getString() );
+        for( auto playerNumber = reader.getNumber(); playerNumber > 0 && reader.isOk(); playerNumber-- )
         {
-            if ( tokens.size() < 2 )
+            std::string name( reader.getString() );
+            bool isBusy = reader.getNumber() != 0;
+            bool isLobbySubscriber = reader.getNumber() != 0;
+            if ( auto it = sessionByName.find( name ); it != sessionByName.end() )
             {
-                LOG_ERR( "TcpClientSession bad request (4): " << request );
-                return;
+                m_clientMap[name] = PlayerInfo( it->second, isBusy, isLobbySubscriber );
+            }
+        }
+        if ( auto it = sessionByName.find( waitingPlayerName ); it != sessionByName.end() )
+        {
+            m_waitingPlayer = it->second;
+        }
+        
+        // games (by their first player)
+        for( const auto& [name,session] : sessionByName )
+        {
+            const auto& state = states[ stateIndexByName[name] ];
+            if ( state.m_partnerName.empty() || state.m_playerIndex != 0 )
+            {
+                continue;
             }
             
-            auto& otherPlayerName = tokens[1];
-            LOG( "otherPlayerName: " << otherPlayerName );
-            
-            std::string outErrorText;
+            auto partnerIt = sessionByName.find( state.m_partnerName );
+            if ( partnerIt == sessionByName.end() )
+            {
+                continue;
+            }
+            const auto& partnerState = states[ stateIndexByName[state.m_partnerName] ];
+            if ( partnerState.m_partnerName != name || partnerState.m_playerIndex != 1 )
+            {
+                continue;
+            }
             
-            if ( m_ticTacServer.sendCloseGame( m_playerName, otherPlayerName ) )
+            auto game = std::make_shared<TicTacGame>( session, partnerIt->second );
+            game->restoreProgress( state.m_stepNumber, state.m_reportedWinner, partnerState.m_reportedWinner );
+            session->restoreGame( game, state.m_awaitedStepNumber );
+            partnerIt->second->restoreGame( game, partnerState.m_awaitedStepNumber );
+            m_clientMap[name].m_game = game;
+            m_clientMap[state.m_partnerName].m_game = game;
+        }
+        
+        for( const auto& [name,session] : sessionByName )
+        {
+            const auto& state = states[ stateIndexByName[name] ];
+            if ( ! state.m_partnerName.empty() && ! session->game() )
             {
-                LOG( "Invite error: " << outErrorText );
-                std::string response = (SMT_PLAYER_OFFLINED) + "," + otherPlayerName + ";";
-                write( response );
+                session->write( makeMessage( SMT_PLAYER_OFFLINED, state.m_partnerName ) );
+                if ( auto it = m_clientMap.find( name ); it != m_clientMap.end() )
+                {
+                    setPlayerBusy( it, false );
+                }
             }
         }
-        else if ( messageType == "PlayerStep" )
+        
+        for( size_t i=0; i<sessions.size(); i++ )
+        {
+            auto session = std::static_pointer_cast<TicTacClientSession>( sessions[i].m_session );
+            if ( auto it = m_clientMap.find( states[i].m_watchedPlayerName ); it != m_clientMap.end() )
+            {
+                if ( auto game = it->second.m_game.lock(); game )
+                {
+                    session->restoreWatching( game );
+                }
+            }
+            if ( sessions[i].m_isDetached && ! states[i].m_resumeToken.empty() )
+            {
+                session->detachForResume();
+            }
+        }
+        
+        m_playerListSnapshot.reset();
+        LOG( "TicTacServer hot restart: restored players: " << m_clientMap.size() );
+    }
+    
+    virtual std::shared_ptr<TicTacClientSession> takeDetachedSession( const std::string& token ) override
+    {
+        std::lock_guard<std::mutex> lock(m_detachedSessionMutex);
+        auto it = m_detachedSessions.find( token );
+        if ( it == m_detachedSessions.end() )
         {
+            return nullptr;
         }
-        else
+        auto session = std::move( it->second );
+        m_detachedSessions.erase( it );
+        return session;
+    }
+    
+    // cluster mode: this node ('nodeId' > 0) accepts the links of the 'peers' on 'addr:port' and connects to them
+    // (see Cluster.h); must be called before 'run()'
+    //
+    // Each node announces its own players to the peers and lists theirs in its lobby.
+    // [Invite], [AcceptInvitation], [RejectInvitation], [Step] and [CloseGame] for a player of another node
+    // are forwarded to that node. A game between nodes is relayed by name: it has no move timeout,
+    // spectators or leaderboard result; [FindGame] pairs players of one node.
+    // When a player leaves or its node is lost, its partner on this node receives [PlayerOfflined]
+    // (also on a hot restart of that node: its games with players of other nodes end).
+    // (A name registered on two nodes within the link delay stays with the local player on each of them.)
+    void startCluster( uint32_t nodeId, const std::string& addr, const std::string& port, const std::vector<cluster::NodeAddress>& peers )
+    {
+        m_clusterEndpoint.emplace( acceptorContext(), addr, port, peers, *this );
+        for( const auto& peer : peers )
         {
-            LOG_ERR( "Unnkown message type: " << messageType );
+            if ( peer.m_nodeId != nodeId )
+            {
+                m_nodeLinks.push_back( std::make_unique<cluster::NodeLink>( acceptorContext(), nodeId, peer, *this ) );
+                m_nodeLinks.back()->start();
+            }
         }
-        
-        read();
     }
-};
-
-// Server - derived from TCP server
-// It provides 2 methods:
-//    createSession() for base class
-//    addClient() for session
-//
-// Plus it contains map of sessioons
-//
-class TicTacServer: public TcpServer, public ITicTacServer
-{
-    std::map<ClientName,std::weak_ptr<TicTacClientSession>> m_clientMap;
-    
-public:
-    TicTacServer( const std::string& addr, const std::string& port ) : TcpServer( addr, port ) {}
     
-    virtual std::shared_ptr<TcpClientSession> createSession( boost::asio::ip::tcp::socket&& socket ) override
+    // game results are recorded in 'path' (see Leaderboard.h); must be called before 'run()'
+    bool openLeaderboard( const std::string& path )
     {
-        auto ptr = std::make_shared<TicTacClientSession>( *this, std::move(socket) );
-        return ptr->shared_from_this();
+        m_leaderboard = std::make_unique<Leaderboard>( path );
+        return m_leaderboard->isOpen();
     }
     
-    virtual bool addClient( ClientName& clientName, const std::weak_ptr<TicTacClientSession>& session, std::string& errorText ) override
+    std::string_view messageTypeName( size_t type ) const override
+    {
+        for( const auto& tag : MESSAGE_TYPE_TAGS )
+        {
+            if ( tag.m_type == type )
+            {
+                return tag.m_tag;
+            }
+        }
+        return "unknown";
+    }
+
+    virtual bool addClient( ClientName& clientName, const std::weak_ptr<TicTacClientSession>& session, bool isLobbySubscriber, std::string& errorText ) override
     {
-        LOG( "TicTacServer::addClient: " << clientName );
+        LOG_DBG( "TicTacServer::addClient: " << clientName );
+
+        std::lock_guard<std::mutex> lock(m_clientMapMutex);
         if ( auto it = m_clientMap.find( clientName ); it != m_clientMap.end() )
         {
             errorText = "client with same name already exists";
             return false;
         }
         
-        m_clientMap[clientName] = session;
+        m_clientMap[clientName] = PlayerInfo( session, false, isLobbySubscriber );
+
+        auto sequence = nextLobbySequence();
+        sendLobbyEventToAll( makeMessage( SMT_PLAYER_JOINED, sequence, clientName ), session.lock().get() );
+        sendToNodes( makeMessage( NMT_PLAYER_JOINED, clientName, "0" ) );
         return true;
     }
     
-    virtual void removeClient( const TicTacClientSession& session )
+    virtual void removeClient( const TicTacClientSession& session ) override
     {
-        m_clientMap.erase( session.playerName() );
-    }
-    
-    virtual void sendPlayerListToAll() override
-    {
-        auto playerList = getPlayerListResponse();
-        
-        for( auto [clientName,sessionPtr] : m_clientMap )
+        std::lock_guard<std::mutex> lock(m_clientMapMutex);
+
+        // do not remove another session with the same name (if 'addClient' was failed)
+        if ( auto it = m_clientMap.find( session.playerName() ); it != m_clientMap.end() && it->second.m_nodeId == 0 )
         {
-            if ( auto session = sessionPtr.lock(); session )
+            if ( auto sessionPtr = it->second.m_session.lock(); !sessionPtr || sessionPtr.get() == &session )
             {
-                session->write( playerList );
+                m_clientMap.erase( it );
+                cancelWaiting( session );
+                unbindCrossNodePartners( session.playerName() );
+
+                auto sequence = nextLobbySequence();
+                sendLobbyEventToAll( makeMessage( SMT_PLAYER_LEFT, sequence, session.playerName() ) );
+                sendToNodes( makeMessage( NMT_PLAYER_LEFT, session.playerName() ) );
             }
         }
     }
     
-    virtual std::string getPlayerListResponse() override
+    virtual void sendPlayerList( TicTacClientSession& session ) override
     {
-        std::string response = SMT_PLAYER_LIST;
-        
-        for( const auto& [key,session] : m_clientMap )
+        std::lock_guard<std::mutex> lock(m_clientMapMutex);
+
+        if ( ! m_playerListSnapshot )
         {
-            response += "," + key + ","; // + isBuzy;
+            m_playerListSnapshot = std::make_shared<const std::string>( playerListResponse() );
         }
-        response += ";";
-        return response;
+        session.writeLobbyUpdate( m_playerListSnapshot, m_lobbySequence, true );
     }
     
-    virtual bool sendInvitaion( std::string senderPlayerName, std::string playerName, std::string& outErrorText ) override
+    virtual bool sendInvitaion( std::string_view senderPlayerName, std::string_view playerName, std::string& outErrorText ) override
     {
+        std::lock_guard<std::mutex> lock(m_clientMapMutex);
+
         auto it = m_clientMap.find(playerName);
         if ( it == m_clientMap.end() )
         {
-            outErrorText = "no player with name: " + playerName;
+            outErrorText = "no player with name: " + std::string(playerName);
             return false;
         }
         
-        if ( auto session = it->second.lock(); session )
+        if ( it->second.m_nodeId != 0 )
+        {
+            forward( it, makeMessage( SMT_INVITITAION, senderPlayerName ) );
+            return true;
+        }
+        
+        if ( auto session = it->second.m_session.lock(); session )
         {
-            std:: string message = SMT_INVITITAION + "," + senderPlayerName + ";";
-            session->write( message );
+            session->write( makeMessage( SMT_INVITITAION, senderPlayerName ) );
             return true;
         }
         
-        outErrorText = "player is off line: " + playerName;
+        outErrorText = "player is off line: " + std::string(playerName);
         return false;
     }
     
-    virtual bool sendInvitaionAccepted( bool isAccepted, std::string senderPlayerName, std::string playerName, std::string& outErrorText ) override
+    virtual bool sendInvitaionAccepted( bool isAccepted, std::string_view senderPlayerName, std::string_view playerName, std::string& outErrorText ) override
     {
+        std::lock_guard<std::mutex> lock(m_clientMapMutex);
+
         auto it = m_clientMap.find(playerName);
         if ( it == m_clientMap.end() )
         {
-            outErrorText = "no player with name: " + playerName;
+            outErrorText = "no player with name: " + std::string(playerName);
             return false;
         }
         
-        if ( auto session = it->second.lock(); session )
+        if ( it->second.m_nodeId != 0 )
+        {
+            // (the node of the inviter marks it busy, see 'deliverForwarded()')
+            if ( auto senderIt = m_clientMap.find(senderPlayerName); isAccepted && senderIt != m_clientMap.end() )
+            {
+                setPlayerBusy( senderIt, true );
+                bindCrossNodePartners( senderPlayerName, playerName );
+            }
+            forward( it, makeMessage( isAccepted ? SMT_INVITITAION_ACCEPTED : SMT_INVITITAION_REJECTED, senderPlayerName ) );
+            return true;
+        }
+        
+        if ( auto session = it->second.m_session.lock(); session )
         {
-            std::string message;
             if ( isAccepted )
             {
-                message = (SMT_INVITITAION_ACCEPTED) + "," + senderPlayerName + ";";
+                setPlayerBusy( it, true );
+                if ( auto senderIt = m_clientMap.find(senderPlayerName); senderIt != m_clientMap.end() )
+                {
+                    setPlayerBusy( senderIt, true );
+
+                    // we are on the sender's io thread (it handles [AcceptInvitation]);
+                    // the inviter is bound before it receives [InvitationAccepted]
+                    if ( auto senderSession = senderIt->second.m_session.lock(); senderSession )
+                    {
+                        auto game = std::make_shared<TicTacGame>( session, senderSession );
+                        it->second.m_game = game;
+                        senderIt->second.m_game = game;
+                        senderSession->setGame( game );
+                        session->runInSessionThread( [session,game] { session->setGame( game ); } );
+                        
+                        // the steps are relayed on one io thread
+                        coLocateSession( senderSession, *session );
+                    }
+                }
+
+                session->write( makeMessage( SMT_INVITITAION_ACCEPTED, senderPlayerName ) );
             }
             else
             {
-                message = (SMT_INVITITAION_REJECTED) + "," + senderPlayerName + ";";
+                session->write( makeMessage( SMT_INVITITAION_REJECTED, senderPlayerName ) );
             }
-            session->write( message );
             return true;
         }
         
-        outErrorText = "player is off line: " + playerName;
+        outErrorText = "player is off line: " + std::string(playerName);
         return false;
     }
 
-    virtual bool sendStep( std::string rcvPlayerName, std::string x_0, std::string x, std::string y ) override
+    virtual bool sendStep( std::string_view rcvPlayerName, std::string_view x_0, std::string_view x, std::string_view y ) override
     {
+        std::lock_guard<std::mutex> lock(m_clientMapMutex);
+
         auto it = m_clientMap.find(rcvPlayerName);
         if ( it == m_clientMap.end() )
         {
-            LOG( "No client with name: " << rcvPlayerName );
+            LOG_DBG( "No client with name: " << rcvPlayerName );
             return false;
         }
         
-        if ( auto session = it->second.lock(); session )
+        if ( it->second.m_nodeId != 0 )
+        {
+            forward( it, makeMessage( SMT_ON_STEP, rcvPlayerName, x_0, x, y ) );
+            return true;
+        }
+        
+        if ( auto session = it->second.m_session.lock(); session )
         {
-            std::string message;
-            message = (SMT_ON_STEP) + "," + rcvPlayerName + "," + x_0 + "," + x + "," + y + ";";
-            session->write( message );
+            session->write( makeMessage( SMT_ON_STEP, rcvPlayerName, x_0, x, y ) );
             return true;
         }
         
         return false;
     }
     
-    virtual bool sendCloseGame( std::string playerName, std::string otherPlayerName ) override
+    // called on the session's io thread
+    virtual bool findGame( TicTacClientSession& session, std::string& outErrorText ) override
     {
-        auto it = m_clientMap.find(playerName);
-        if ( it != m_clientMap.end() )
+        std::lock_guard<std::mutex> lock(m_clientMapMutex);
+
+        auto it = m_clientMap.find( session.playerName() );
+        if ( it == m_clientMap.end() || it->second.m_session.lock().get() != &session )
+        {
+            outErrorText = "player is not registered";
+            return false;
+        }
+
+        auto waitingPlayer = m_waitingPlayer.lock();
+        if ( waitingPlayer.get() == &session )
+        {
+            return true;
+        }
+
+        // waiting player could be disconnected or invited meanwhile
+        auto waitingIt = waitingPlayer ? m_clientMap.find( waitingPlayer->playerName() ) : m_clientMap.end();
+        if ( waitingIt == m_clientMap.end() || waitingIt->second.m_isBusy || waitingIt->second.m_session.lock() != waitingPlayer )
+        {
+            m_waitingPlayer = std::dynamic_pointer_cast<TicTacClientSession>( session.shared_from_this() );
+            return true;
+        }
+
+        m_waitingPlayer.reset();
+        setPlayerBusy( waitingIt, true );
+        setPlayerBusy( it, true );
+
+        // as for [AcceptInvitation]: the waiting player is bound before it receives [GameFound]
+        auto sessionPtr = std::dynamic_pointer_cast<TicTacClientSession>( session.shared_from_this() );
+        auto game = std::make_shared<TicTacGame>( waitingPlayer, sessionPtr );
+        waitingIt->second.m_game = game;
+        it->second.m_game = game;
+        session.setGame( game );
+        waitingPlayer->runInSessionThread( [waitingPlayer,game] { waitingPlayer->setGame( game ); } );
+        coLocateSession( sessionPtr, *waitingPlayer );
+
+        waitingPlayer->write( makeMessage( SMT_GAME_FOUND, session.playerName(), "X" ) );
+        session.write( makeMessage( SMT_GAME_FOUND, waitingPlayer->playerName(), "0" ) );
+        return true;
+    }
+
+    virtual void cancelFindGame( const TicTacClientSession& session ) override
+    {
+        std::lock_guard<std::mutex> lock(m_clientMapMutex);
+        cancelWaiting( session );
+    }
+
+    virtual bool sendCloseGame( std::string_view playerName, std::string_view otherPlayerName ) override
+    {
+        std::lock_guard<std::mutex> lock(m_clientMapMutex);
+
+        if ( auto it = m_clientMap.find(playerName); it != m_clientMap.end() )
+        {
+            setPlayerBusy( it, false );
+        }
+
+        auto it = m_clientMap.find(otherPlayerName);
+        if ( it == m_clientMap.end() )
         {
             return false;
         }
         
-        if ( auto session = it->second.lock(); session )
+        if ( it->second.m_nodeId != 0 )
+        {
+            unbindCrossNodePartners( playerName );
+            forward( it, makeMessage( SMT_GAME_CLOSED, playerName ) );
+            return true;
+        }
+        
+        setPlayerBusy( it, false );
+
+        if ( auto session = it->second.m_session.lock(); session )
         {
-            std::string message;
-            message = (SMT_GAME_CLOSED) + "," + otherPlayerName + ";";
-            session->write( message );
+            session->write( makeMessage( SMT_GAME_CLOSED, playerName ) );
             return true;
         }
         
         return false;
     }
+
+    virtual std::shared_ptr<TicTacGame> findRunningGame( std::string_view playerName, std::string& outErrorText ) override
+    {
+        std::lock_guard<std::mutex> lock(m_clientMapMutex);
+
+        auto it = m_clientMap.find( playerName );
+        if ( it == m_clientMap.end() )
+        {
+            outErrorText = "no player with name: " + std::string(playerName);
+            return nullptr;
+        }
+
+        auto game = it->second.m_game.lock();
+        if ( ! game )
+        {
+            outErrorText = "player is not in game: " + std::string(playerName);
+        }
+        return game;
+    }
+
+    virtual void onGameResult( const TicTacGame& game, int winnerIndex ) override
+    {
+        if ( ! m_leaderboard )
+        {
+            return;
+        }
+
+        m_leaderboard->addGameResult( game.playerName(0), game.playerName(1), winnerIndex );
+
+        std::lock_guard<std::mutex> lock(m_leaderboardMutex);
+        m_leaderboardSnapshot.reset();
+    }
+
+    virtual void sendLeaderboard( TicTacClientSession& session ) override
+    {
+        std::lock_guard<std::mutex> lock(m_leaderboardMutex);
+
+        if ( ! m_leaderboardSnapshot )
+        {
+            std::string response( SMT_LEADERBOARD );
+            if ( m_leaderboard )
+            {
+                for( const auto& entry : m_leaderboard->top() )
+                {
+                    response += "," + entry.m_name + "," + std::to_string( entry.m_rating ) + "," + std::to_string( entry.m_wins )
+                              + "," + std::to_string( entry.m_losses ) + "," + std::to_string( entry.m_draws );
+                }
+            }
+            response += ";";
+            m_leaderboardSnapshot = std::make_shared<const std::string>( std::move(response) );
+        }
+        session.write( m_leaderboardSnapshot );
+    }
+
+    virtual void onGameClosed( const TicTacGame& game ) override
+    {
+        std::lock_guard<std::mutex> lock(m_clientMapMutex);
+
+        for( int i=0; i<2; i++ )
+        {
+            if ( auto it = m_clientMap.find( game.playerName(i) ); it != m_clientMap.end() )
+            {
+                setPlayerBusy( it, false );
+            }
+        }
+    }
+
+private:
+    // must be called under 'm_clientMapMutex'
+    std::string playerListResponse() const
+    {
+        std::string response( SMT_PLAYER_LIST );
+        response += "," + std::to_string( m_lobbySequence );
+        
+        for( const auto& [key,playerInfo] : m_clientMap )
+        {
+            response += "," + key + ",";
+            if ( playerInfo.m_isBusy )
+            {
+                response += "1";
+            }
+        }
+        response += ";";
+        return response;
+    }
+
+    // must be called under 'm_clientMapMutex'
+    void cancelWaiting( const TicTacClientSession& session )
+    {
+        if ( m_waitingPlayer.lock().get() == &session )
+        {
+            m_waitingPlayer.reset();
+        }
+    }
+
+    // must be called under 'm_clientMapMutex'
+    std::string nextLobbySequence()
+    {
+        m_playerListSnapshot.reset();
+        return std::to_string( ++m_lobbySequence );
+    }
+
+    // must be called under 'm_clientMapMutex', the message has the current 'm_lobbySequence'
+    // (so all sessions receive lobby events in the order of their sequence numbers)
+    void sendLobbyEventToAll( std::string&& message, const TicTacClientSession* exceptSession = nullptr )
+    {
+        auto sharedMessage = std::make_shared<const std::string>( std::move(message) );
+
+        for( const auto& [clientName,playerInfo] : m_clientMap )
+        {
+            if ( ! playerInfo.m_isLobbySubscriber )
+            {
+                continue;
+            }
+
+            if ( auto session = playerInfo.m_session.lock(); session && session.get() != exceptSession )
+            {
+                session->writeLobbyUpdate( sharedMessage, m_lobbySequence );
+            }
+        }
+    }
+
+    // must be called under 'm_clientMapMutex'
+    template<class IteratorT>
+    void setPlayerBusy( IteratorT it, bool isBusy )
+    {
+        if ( ! isBusy )
+        {
+            it->second.m_game.reset();
+        }
+
+        if ( it->second.m_isBusy == isBusy )
+        {
+            return;
+        }
+
+        it->second.m_isBusy = isBusy;
+
+        auto sequence = nextLobbySequence();
+        sendLobbyEventToAll( makeMessage( SMT_PLAYER_BUSY, sequence, it->first, isBusy ? "1" : "0" ) );
+        if ( it->second.m_nodeId == 0 )
+        {
+            sendToNodes( makeMessage( NMT_PLAYER_BUSY, it->first, isBusy ? "1" : "0" ) );
+        }
+    }
+
+    // must be called under 'm_clientMapMutex'
+    void sendToNodes( const std::string& message )
+    {
+        for( auto& link : m_nodeLinks )
+        {
+            link->send( message );
+        }
+    }
+
+    // must be called under 'm_clientMapMutex': 'message' for the player of another node
+    template<class IteratorT>
+    void forward( IteratorT it, std::string_view message )
+    {
+        for( auto& link : m_nodeLinks )
+        {
+            if ( link->nodeId() == it->second.m_nodeId )
+            {
+                std::string frame;
+                frame.reserve( NMT_FORWARD.size() + it->first.size() + message.size() + 2 );
+                frame += NMT_FORWARD;
+                frame += ',';
+                frame += it->first;
+                frame += ',';
+                frame += message;
+                link->send( std::move(frame) );
+                metrics::count( metrics::c_forwarded_messages );
+                return;
+            }
+        }
+    }
+
+    // must be called under 'm_clientMapMutex': forwarded 'message' (without ';') for the player of this node;
+    // the player becomes busy or free by the forwarded answer of its partner
+    void deliverForwarded( std::string_view receiverName, std::string_view message )
+    {
+        auto it = m_clientMap.find( receiverName );
+        if ( it == m_clientMap.end() || it->second.m_nodeId != 0 )
+        {
+            LOG_DBG( "TicTacServer cluster: no player for forwarded message: " << receiverName );
+            return;
+        }
+
+        // <type>,<sender>
+        MessageTokens<2> tokens( message );
+        switch ( messageTypeOf( tokens[0] ) )
+        {
+            case mt_invitation_accepted:
+                setPlayerBusy( it, true );
+                bindCrossNodePartners( receiverName, tokens[1] );
+                break;
+            case mt_game_closed:
+                setPlayerBusy( it, false );
+                unbindCrossNodePartners( receiverName );
+                break;
+            default:
+                break;
+        }
+
+        if ( auto session = it->second.m_session.lock(); session )
+        {
+            std::string frame;
+            frame.reserve( message.size() + 1 );
+            frame += message;
+            frame += ';';
+            session->write( std::move(frame) );
+        }
+    }
+
+    // must be called under 'm_clientMapMutex'
+    void bindCrossNodePartners( std::string_view localName, std::string_view remoteName )
+    {
+        unbindCrossNodePartners( localName );
+        unbindCrossNodePartners( remoteName );
+        m_crossNodePartners[std::string(localName)] = remoteName;
+        m_crossNodePartners[std::string(remoteName)] = localName;
+    }
+
+    // must be called under 'm_clientMapMutex'
+    void unbindCrossNodePartners( std::string_view name )
+    {
+        if ( auto it = m_crossNodePartners.find( std::string(name) ); it != m_crossNodePartners.end() )
+        {
+            m_crossNodePartners.erase( it->second );
+            m_crossNodePartners.erase( it );
+        }
+    }
+
+    // must be called under 'm_clientMapMutex'
+    template<class IteratorT>
+    void removeRemotePlayer( IteratorT it )
+    {
+        std::string name = it->first;
+        m_clientMap.erase( it );
+
+        // its partner on this node is offlined (as by TicTacGame::playerDisconnected())
+        if ( auto partnerIt = m_crossNodePartners.find( name ); partnerIt != m_crossNodePartners.end() )
+        {
+            auto localIt = m_clientMap.find( partnerIt->second );
+            unbindCrossNodePartners( name );
+            if ( localIt != m_clientMap.end() && localIt->second.m_nodeId == 0 )
+            {
+                setPlayerBusy( localIt, false );
+                if ( auto session = localIt->second.m_session.lock(); session )
+                {
+                    session->write( makeMessage( SMT_PLAYER_OFFLINED, name ) );
+                }
+            }
+        }
+
+        auto sequence = nextLobbySequence();
+        sendLobbyEventToAll( makeMessage( SMT_PLAYER_LEFT, sequence, name ) );
+    }
+
+    // cluster (acceptor thread): the players of this node are announced to the peer
+    void onNodeLinkConnected( cluster::NodeLink& link ) override
+    {
+        std::lock_guard<std::mutex> lock(m_clientMapMutex);
+
+        std::string players;
+        for( const auto& [name,playerInfo] : m_clientMap )
+        {
+            if ( playerInfo.m_nodeId == 0 )
+            {
+                appendMessage( players, NMT_PLAYER_JOINED, name, playerInfo.m_isBusy ? "1" : "0" );
+            }
+        }
+        if ( ! players.empty() )
+        {
+            link.send( std::move(players) );
+        }
+    }
+
+    void onNodeMessage( uint32_t nodeId, std::string_view frame ) override
+    {
+        // <type>,<player name>,<the rest>
+        MessageTokens<2> tokens( frame );
+
+        std::lock_guard<std::mutex> lock(m_clientMapMutex);
+
+        auto it = m_clientMap.find( tokens[1] );
+        auto type = tokens[0];
+        if ( type == NMT_PLAYER_JOINED )
+        {
+            if ( it == m_clientMap.end() )
+            {
+                it = m_clientMap.emplace( std::string( tokens[1] ), PlayerInfo( nodeId ) ).first;
+
+                auto sequence = nextLobbySequence();
+                sendLobbyEventToAll( makeMessage( SMT_PLAYER_JOINED, sequence, it->first ) );
+            }
+            else if ( it->second.m_nodeId != nodeId )
+            {
+                LOG_ERR( "TicTacServer cluster: name conflict: " << tokens[1] << " (node " << nodeId << ")" );
+                return;
+            }
+            setPlayerBusy( it, tokens.tail() == "1" );
+        }
+        else if ( type == NMT_PLAYER_LEFT )
+        {
+            if ( it != m_clientMap.end() && it->second.m_nodeId == nodeId )
+            {
+                removeRemotePlayer( it );
+            }
+        }
+        else if ( type == NMT_PLAYER_BUSY )
+        {
+            if ( it != m_clientMap.end() && it->second.m_nodeId == nodeId )
+            {
+                setPlayerBusy( it, tokens.tail() == "1" );
+            }
+        }
+        else if ( type == NMT_FORWARD )
+        {
+            deliverForwarded( tokens[1], tokens.tail() );
+        }
+        else
+        {
+            LOG_ERR( "TicTacServer cluster: unknown message: " << frame );
+        }
+    }
+
+    // the players of the node leave the lobby (the node announces them again when it connects)
+    void onNodeLost( uint32_t nodeId ) override
+    {
+        std::lock_guard<std::mutex> lock(m_clientMapMutex);
+
+        for( auto it = m_clientMap.begin(); it != m_clientMap.end(); )
+        {
+            auto next = std::next( it );
+            if ( it->second.m_nodeId == nodeId )
+            {
+                removeRemotePlayer( it );
+            }
+            it = next;
+        }
+    }
 };
 
 } // namespace tic_tac {
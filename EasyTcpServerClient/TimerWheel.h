@@ -0,0 +1,221 @@
+#pragma once
+
+#include <boost/asio.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <vector>
+
+class ITimerOwner;
+
+// TimerWheel - hashed timer wheel of one io thread
+//
+// Many timers share one 'steady_timer' that ticks (every 'tickDuration') only while some timer is armed.
+// An armed timer costs one small wheel entry instead of an asio timer with its handler.
+//
+// Deadlines are lazy: re-arming a timer to a later deadline (e.g. idle timeout on every message)
+// only updates 'Timer::m_deadlineTick'; when the old entry expires it is moved to the new deadline.
+//
+// Not thread safe: all calls must be done on the thread of the wheel's io_context.
+// An owner can move to the wheel of another thread (see 'release()'): the entries left behind are skipped.
+//
+class TimerWheel
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // embedded into the owner (one per timer kind)
+    struct Timer
+    {
+        uint64_t m_deadlineTick  = 0;   // 0 -> not armed
+        uint64_t m_scheduledTick = 0;   // tick of the valid wheel entry; 0 -> no entry
+
+        // wheel of the last 'arm()' (read by the wheel the owner has left)
+        std::atomic<const TimerWheel*> m_wheel{ nullptr };
+    };
+
+private:
+    struct Entry
+    {
+        std::weak_ptr<ITimerOwner>  m_owner;
+        uint64_t                    m_tick;
+        uint8_t                     m_kind;
+    };
+
+    boost::asio::steady_timer       m_timer;
+    const Clock::duration           m_tickDuration;
+    const Clock::time_point         m_startTime;
+
+    std::vector<std::vector<Entry>> m_slots;
+    std::vector<Entry>              m_expiredEntries;
+    uint64_t                        m_currentTick = 0;  // all ticks up to it are processed
+    size_t                          m_entryNumber = 0;
+    bool                            m_isTicking = false;
+
+public:
+    TimerWheel( boost::asio::io_context& context, Clock::duration tickDuration = std::chrono::milliseconds(100), size_t slotNumber = 512 )
+      : m_timer( context ),
+        m_tickDuration( tickDuration ),
+        m_startTime( Clock::now() ),
+        m_slots( slotNumber )
+    {
+    }
+
+    // (re)arms 'timer' of 'owner' to expire after 'delay';
+    // 'OwnerT' is derived from ITimerOwner and std::enable_shared_from_this
+    template<class OwnerT>
+    void arm( Timer& timer, OwnerT& owner, uint8_t kind, Clock::duration delay )
+    {
+        timer.m_deadlineTick = std::max( m_currentTick+1, tickOf( Clock::now() + delay + m_tickDuration - Clock::duration(1) ) );
+        timer.m_wheel.store( this, std::memory_order_relaxed );
+
+        if ( timer.m_scheduledTick == 0 || timer.m_deadlineTick < timer.m_scheduledTick )
+        {
+            insert( owner.weak_from_this(), kind, timer.m_deadlineTick );
+            timer.m_scheduledTick = timer.m_deadlineTick;
+        }
+    }
+
+    // the entry (if any) is dropped when it expires
+    static void disarm( Timer& timer ) { timer.m_deadlineTick = 0; }
+
+    // the owner moves to another wheel: the timer is disarmed here (to be armed there for the returned remaining time);
+    // std::nullopt -> the timer is not armed
+    std::optional<Clock::duration> release( Timer& timer )
+    {
+        std::optional<Clock::duration> remaining;
+        if ( timer.m_deadlineTick != 0 && timer.m_wheel.load( std::memory_order_relaxed ) == this )
+        {
+            auto nowTick = tickOf( Clock::now() );
+            remaining = ( timer.m_deadlineTick > nowTick ) ? m_tickDuration * int64_t( timer.m_deadlineTick - nowTick ) : Clock::duration(0);
+        }
+
+        timer.m_deadlineTick = 0;
+        timer.m_scheduledTick = 0;
+        timer.m_wheel.store( nullptr, std::memory_order_relaxed );
+        return remaining;
+    }
+
+    size_t entryNumber() const { return m_entryNumber; }
+
+private:
+    uint64_t tickOf( Clock::time_point time ) const { return uint64_t( ( time - m_startTime ) / m_tickDuration ); }
+
+    void insert( std::weak_ptr<ITimerOwner>&& owner, uint8_t kind, uint64_t tick )
+    {
+        if ( m_entryNumber++ == 0 && ! m_isTicking )
+        {
+            // the wheel was idle: skip the ticks passed since
+            m_currentTick = std::max( m_currentTick, tickOf( Clock::now() ) );
+        }
+
+        m_slots[ tick % m_slots.size() ].push_back( Entry{ std::move(owner), tick, kind } );
+
+        if ( ! m_isTicking )
+        {
+            startTicking();
+        }
+    }
+
+    void startTicking()
+    {
+        m_isTicking = true;
+        m_timer.expires_at( m_startTime + m_tickDuration * ( m_currentTick+1 ) );
+        m_timer.async_wait( [this] ( auto error )
+        {
+            if ( error == boost::asio::error::operation_aborted )
+            {
+                return;
+            }
+
+            auto nowTick = tickOf( Clock::now() );
+            while ( m_currentTick < nowTick )
+            {
+                expire( ++m_currentTick );
+            }
+
+            m_isTicking = false;
+            if ( m_entryNumber > 0 )
+            {
+                startTicking();
+            }
+        });
+    }
+
+    void expire( uint64_t tick );
+};
+
+// ITimerOwner - object with timers on a TimerWheel
+//
+class ITimerOwner
+{
+public:
+    virtual ~ITimerOwner() = default;
+
+    virtual TimerWheel::Timer& timer( uint8_t kind ) = 0;
+    virtual void onTimer( uint8_t kind ) = 0;
+};
+
+inline void TimerWheel::expire( uint64_t tick )
+{
+    // entries of the later wheel rounds stay in the slot
+    auto& slot = m_slots[ tick % m_slots.size() ];
+    std::vector<Entry> expiredEntries;
+    expiredEntries.swap( m_expiredEntries );
+    for( size_t i=0; i<slot.size(); )
+    {
+        if ( slot[i].m_tick <= tick )
+        {
+            expiredEntries.push_back( std::move( slot[i] ) );
+            slot[i] = std::move( slot.back() );
+            slot.pop_back();
+            continue;
+        }
+        i++;
+    }
+    m_entryNumber -= expiredEntries.size();
+
+    for( auto& entry : expiredEntries )
+    {
+        auto owner = entry.m_owner.lock();
+        if ( ! owner )
+        {
+            continue;
+        }
+
+        auto& timer = owner->timer( entry.m_kind );
+        if ( timer.m_wheel.load( std::memory_order_relaxed ) != this )
+        {
+            // the owner has moved to another wheel (see 'release()')
+            continue;
+        }
+        if ( timer.m_scheduledTick != entry.m_tick )
+        {
+            // superseded by an earlier entry
+            continue;
+        }
+        timer.m_scheduledTick = 0;
+
+        if ( timer.m_deadlineTick == 0 )
+        {
+            continue;
+        }
+
+        if ( timer.m_deadlineTick > tick )
+        {
+            // lazily re-armed
+            insert( std::move( entry.m_owner ), entry.m_kind, timer.m_deadlineTick );
+            timer.m_scheduledTick = timer.m_deadlineTick;
+            continue;
+        }
+
+        timer.m_deadlineTick = 0;
+        owner->onTimer( entry.m_kind );
+    }
+
+    expiredEntries.clear();
+    m_expiredEntries.swap( expiredEntries );
+}
@@ -1,13 +1,185 @@
 #include "TicTacTcpServer.h"
 #include "DbgTicTacClient.h"
 
+#include <charconv>
+
 // lvalue = rvalue (movable)
 // rvalue = std::move(lvalue)
 
-int main()
+#ifndef SIMULATED_PLAYER_NUMBER
+    #define SIMULATED_PLAYER_NUMBER 2
+#endif
+
+// LOG_LEVEL_DEBUG -> also LOG_DBG records (compiled only with DEBUG; they log every message)
+#ifndef RUNTIME_LOG_LEVEL
+    #define RUNTIME_LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+// metrics endpoint (plain text, local only)
+#ifndef METRICS_PORT
+    #define METRICS_PORT "15002"
+#endif
+
+// -DCAPTURE_FILE=\"path\" -> inbound traffic is captured (see Capture.h, TicTacReplay)
+
+// game results (see Leaderboard.h)
+#ifndef LEADERBOARD_FILE
+    #define LEADERBOARD_FILE "TicTacLeaderboard.bin"
+#endif
+
+// sessions of lost connections are kept for [Resume] (0 -> not kept)
+#ifndef RESUME_GRACE_PERIOD_MS
+    #define RESUME_GRACE_PERIOD_MS 30000
+#endif
+
+// a connection without requests is closed, a player that does not answer a step loses (0 -> off;
+// the bundled clients send no keepalive, so an idle timeout drops idle lobby players)
+#ifndef IDLE_TIMEOUT_MS
+    #define IDLE_TIMEOUT_MS 0
+#endif
+#ifndef MOVE_TIMEOUT_MS
+    #define MOVE_TIMEOUT_MS 0
+#endif
+
+// hot restart: a new process takes the listening socket and the sessions over from the running one
+// (see HotRestart.h); "" -> no hot restart
+#ifndef HOT_RESTART_PATH
+    #define HOT_RESTART_PATH "/tmp/TicTacServer.hot-restart"
+#endif
+
+// op_drop_lobby_updates or op_disconnect (see OutboundLimits)
+#ifndef OUTBOUND_OVERFLOW_POLICY
+    #define OUTBOUND_OVERFLOW_POLICY op_drop_lobby_updates
+#endif
+
+// socket options of the listener and the accepted connections (see SOCKET_OPTIONS_PROFILES in TcpServer.h);
+// overridden by "--socket-options <profile>"
+#ifndef SOCKET_OPTIONS_PROFILE
+    #define SOCKET_OPTIONS_PROFILE "nodelay"
+#endif
+
+// cluster mode (see Cluster.h): several processes share one lobby
+//
+//   DbgServerClient [--socket-options <profile>] [<node id> <port> <cluster port> <peer id>:<host>:<cluster port>...]
+//
+// (the metrics endpoint is started by node 1 only; the leaderboard file and the hot restart path
+// are suffixed by the node id; the cluster port must be reachable only by the nodes, see Cluster.h)
+//
+// false -> not a number > 0
+static bool parseNodeId( std::string_view text, uint32_t& outNodeId )
 {
+    outNodeId = 0;
+    auto [end,error] = std::from_chars( text.data(), text.data()+text.size(), outNodeId );
+    return error == std::errc() && end == text.data()+text.size() && outNodeId != 0;
+}
+
+static bool parsePeer( std::string_view text, cluster::NodeAddress& outPeer )
+{
+    auto hostPos = text.find( ':' );
+    auto portPos = text.rfind( ':' );
+    if ( hostPos == std::string_view::npos || portPos == hostPos )
+    {
+        return false;
+    }
+    outPeer.m_host = text.substr( hostPos+1, portPos-hostPos-1 );
+    outPeer.m_port = text.substr( portPos+1 );
+    return parseNodeId( text.substr( 0, hostPos ), outPeer.m_nodeId );
+}
+
+int main( int argc, char* argv[] )
+{
+    logs::setLogLevel( RUNTIME_LOG_LEVEL );
+
 #ifndef STANDALONE_TEST
-    tic_tac::TicTacServer server( "0.0.0.0", "15001" );
+    std::string socketProfile = SOCKET_OPTIONS_PROFILE;
+    if ( argc > 2 && std::string_view( argv[1] ) == "--socket-options" )
+    {
+        socketProfile = argv[2];
+        argv += 2;
+        argc -= 2;
+    }
+
+    SocketOptions socketOptions;
+    if ( ! socketOptionsProfile( socketProfile, socketOptions ) )
+    {
+        std::cerr << "unknown socket options: " << socketProfile << std::endl;
+        return 1;
+    }
+
+    uint32_t nodeId = 0;
+    std::string port = "15001";
+    std::string clusterPort;
+    std::vector<cluster::NodeAddress> peers;
+    if ( argc > 1 )
+    {
+        if ( argc < 4 )
+        {
+            std::cerr << "usage: " << argv[0] << " [--socket-options <profile>] [<node id> <port> <cluster port> <peer id>:<host>:<cluster port>...]" << std::endl;
+            return 1;
+        }
+        if ( ! parseNodeId( argv[1], nodeId ) )
+        {
+            std::cerr << "bad node id: " << argv[1] << std::endl;
+            return 1;
+        }
+        port = argv[2];
+        clusterPort = argv[3];
+        for( int i=4; i<argc; i++ )
+        {
+            cluster::NodeAddress peer;
+            if ( ! parsePeer( argv[i], peer ) )
+            {
+                std::cerr << "bad peer: " << argv[i] << std::endl;
+                return 1;
+            }
+            peers.push_back( std::move(peer) );
+        }
+    }
+    std::string nodeSuffix = ( nodeId == 0 ) ? "" : "." + std::to_string( nodeId );
+
+    std::string hotRestartPath = HOT_RESTART_PATH;
+    if ( ! hotRestartPath.empty() )
+    {
+        hotRestartPath += nodeSuffix;
+    }
+
+    hot_restart::Inheritance inheritance;
+    if ( ! hotRestartPath.empty() )
+    {
+        inheritance.receive( hotRestartPath );
+    }
+
+    tic_tac::TicTacServer server( "0.0.0.0", port, 0, inheritance.takeListenSocket(), socketOptions );
+
+    OutboundLimits limits;
+    limits.m_overflowPolicy = OUTBOUND_OVERFLOW_POLICY;
+    server.setOutboundLimits( limits );
+    server.setIdleTimeout( std::chrono::milliseconds( IDLE_TIMEOUT_MS ) );
+    server.setMoveTimeout( std::chrono::milliseconds( MOVE_TIMEOUT_MS ) );
+
+    if ( nodeId <= 1 )
+    {
+        server.startMetricsEndpoint( "127.0.0.1", METRICS_PORT );
+    }
+
+#ifdef CAPTURE_FILE
+    server.startCapture( CAPTURE_FILE );
+#endif
+
+    server.openLeaderboard( LEADERBOARD_FILE + nodeSuffix );
+    server.setResumeGracePeriod( std::chrono::milliseconds( RESUME_GRACE_PERIOD_MS ) );
+
+    if ( ! hotRestartPath.empty() )
+    {
+        server.restoreSessions( inheritance );
+        server.listenHotRestart( hotRestartPath );
+    }
+
+    if ( nodeId != 0 )
+    {
+        server.startCluster( nodeId, "0.0.0.0", clusterPort, peers );
+    }
+
     server.run();
 #else
     tic_tac::TicTacServer server( "127.0.0.1", "15001" );
@@ -15,18 +187,17 @@ int main()
     
     usleep(1000);
 
-    std::thread( []
-    {
-        tic_tac::DbgTicTacClient client( "Player0" );
-        client.run( "127.0.0.1", "15001" );
-    }).detach();
-    
-    //usleep(1000);
+    // all simulated players share one io thread
+    boost::asio::io_context clientContext;
 
-    tic_tac::DbgTicTacClient client( "Player1" );
-    client.run( "127.0.0.1", "15001" );
+    std::vector<std::unique_ptr<tic_tac::DbgTicTacClient>> clients;
+    for( int i=0; i<SIMULATED_PLAYER_NUMBER; i++ )
+    {
+        clients.push_back( std::make_unique<tic_tac::DbgTicTacClient>( clientContext, "Player" + std::to_string(i) ) );
+        clients.back()->start( "127.0.0.1", "15001" );
+    }
     
-    sleep(1000);
+    clientContext.run();
     
     return 10;
 #endif
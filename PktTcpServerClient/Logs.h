@@ -1,22 +1,302 @@
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <streambuf>
+#include <thread>
+#include <vector>
 
-inline std::mutex gLogMutex;
+// Asynchronous logger
+//
+// LOG_DBG( expr ), LOG( expr ), LOG_ERR( expr ) - 'expr' is written by 'operator<<'
+//
+//   - levels below LOG_COMPILE_LEVEL compile to nothing
+//     (by default LOG_DBG is compiled only if DEBUG is defined)
+//   - levels below runtime level are skipped (see logs::setLogLevel()); the default runtime level is
+//     LOG_LEVEL_INFO, so a compiled LOG_DBG costs one relaxed load until 'setLogLevel( LOG_LEVEL_DEBUG )'
+//   - each thread formats records into its own lock-free ring buffer,
+//     a background thread drains all rings in batches to stdout/stderr;
+//     when a ring is full, records are dropped (and counted), the caller never waits
+//
 
-#ifndef LOG
-    #define LOG( expr ) \
-    {\
-        std::lock_guard<std::mutex> lock(gLogMutex);\
-        std::cout << expr << std::endl; \
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO  1
+#define LOG_LEVEL_ERROR 2
+#define LOG_LEVEL_NONE  3
+
+#ifndef LOG_COMPILE_LEVEL
+    #ifdef DEBUG
+        #define LOG_COMPILE_LEVEL LOG_LEVEL_DEBUG
+    #else
+        #define LOG_COMPILE_LEVEL LOG_LEVEL_INFO
+    #endif
+#endif
+
+namespace logs {
+
+constexpr size_t LOG_RECORD_SIZE = 256;     // longer records are truncated
+constexpr size_t LOG_RING_SIZE   = 1024;    // records per thread
+
+struct LogRecord
+{
+    uint8_t  m_level;
+    uint16_t m_size;
+    char     m_text[LOG_RECORD_SIZE];
+};
+
+// single producer (owner thread) / single consumer (writer thread)
+class LogRing
+{
+    std::array<LogRecord,LOG_RING_SIZE> m_records;
+    std::atomic<size_t>                 m_head{0};      // next record to write
+    std::atomic<size_t>                 m_tail{0};      // next record to drain
+
+public:
+    std::atomic<size_t>                 m_droppedNumber{0};
+
+    LogRecord* beginRecord()
+    {
+        auto head = m_head.load( std::memory_order_relaxed );
+        if ( head - m_tail.load( std::memory_order_acquire ) == LOG_RING_SIZE )
+        {
+            m_droppedNumber.fetch_add( 1, std::memory_order_relaxed );
+            return nullptr;
+        }
+        return &m_records[ head % LOG_RING_SIZE ];
+    }
+
+    void commitRecord()
+    {
+        m_head.store( m_head.load( std::memory_order_relaxed ) + 1, std::memory_order_release );
     }
+
+    template<class FuncT>
+    size_t drain( FuncT&& func )
+    {
+        auto tail = m_tail.load( std::memory_order_relaxed );
+        auto head = m_head.load( std::memory_order_acquire );
+        for( auto i = tail; i != head; i++ )
+        {
+            func( m_records[ i % LOG_RING_SIZE ] );
+        }
+        m_tail.store( head, std::memory_order_release );
+        return head - tail;
+    }
+
+    bool isEmpty() const { return m_head.load( std::memory_order_acquire ) == m_tail.load( std::memory_order_relaxed ); }
+};
+
+class LogWriter
+{
+    std::mutex                             m_ringsMutex;   // only for registration of threads
+    std::vector<std::shared_ptr<LogRing>>  m_rings;
+
+    std::atomic<bool>                      m_isStopped{false};
+    std::thread                            m_thread;
+
+    std::vector<char>                      m_outBuffer;
+    std::vector<char>                      m_errBuffer;
+
+public:
+    LogWriter() : m_thread( [this] { run(); } ) {}
+
+    // never destroyed: detached threads can log during exit;
+    // at exit the rings are drained and the writer thread is stopped
+    static LogWriter& instance()
+    {
+        static LogWriter* writer = []
+        {
+            auto* writer = new LogWriter;
+            std::atexit( [] { instance().stop(); } );
+            return writer;
+        }();
+        return *writer;
+    }
+
+    void stop()
+    {
+        if ( ! m_isStopped.exchange(true) )
+        {
+            m_thread.join();
+        }
+    }
+
+    std::shared_ptr<LogRing> registerThread()
+    {
+        auto ring = std::make_shared<LogRing>();
+        std::lock_guard<std::mutex> lock(m_ringsMutex);
+        m_rings.push_back( ring );
+        return ring;
+    }
+
+private:
+    void run()
+    {
+        auto pause = std::chrono::microseconds(100);
+        for(;;)
+        {
+            bool isStopped = m_isStopped.load();
+            if ( drainAll() > 0 )
+            {
+                pause = std::chrono::microseconds(100);
+            }
+            else if ( isStopped )
+            {
+                return;
+            }
+            else
+            {
+                std::this_thread::sleep_for( pause );
+                pause = std::min( pause*2, std::chrono::microseconds(10000) );
+            }
+        }
+    }
+
+    size_t drainAll()
+    {
+        std::vector<std::shared_ptr<LogRing>> rings;
+        {
+            std::lock_guard<std::mutex> lock(m_ringsMutex);
+
+            // forget rings of finished threads
+            for( size_t i=0; i<m_rings.size(); )
+            {
+                if ( m_rings[i].use_count() == 1 && m_rings[i]->isEmpty() )
+                {
+                    m_rings[i] = std::move( m_rings.back() );
+                    m_rings.pop_back();
+                    continue;
+                }
+                i++;
+            }
+            rings = m_rings;
+        }
+
+        size_t recordNumber = 0;
+        for( auto& ring : rings )
+        {
+            recordNumber += ring->drain( [this] ( const LogRecord& record )
+            {
+                auto& buffer = ( record.m_level >= LOG_LEVEL_ERROR ) ? m_errBuffer : m_outBuffer;
+                buffer.insert( buffer.end(), record.m_text, record.m_text + record.m_size );
+                buffer.push_back( '\n' );
+            });
+
+            if ( auto droppedNumber = ring->m_droppedNumber.exchange(0); droppedNumber > 0 )
+            {
+                auto text = "... " + std::to_string( droppedNumber ) + " log records dropped\n";
+                m_errBuffer.insert( m_errBuffer.end(), text.begin(), text.end() );
+            }
+        }
+
+        flush( m_outBuffer, stdout );
+        flush( m_errBuffer, stderr );
+        return recordNumber;
+    }
+
+    static void flush( std::vector<char>& buffer, FILE* file )
+    {
+        if ( ! buffer.empty() )
+        {
+            fwrite( buffer.data(), 1, buffer.size(), file );
+            fflush( file );
+            buffer.clear();
+        }
+    }
+};
+
+// formats directly into the ring record
+class RecordStreamBuf: public std::streambuf
+{
+public:
+    void reset( char* begin, size_t size ) { setp( begin, begin+size ); }
+    size_t size() const { return pptr() - pbase(); }
+
+protected:
+    int_type overflow( int_type ) override { return traits_type::eof(); } // truncate
+};
+
+class ThreadLog
+{
+    std::shared_ptr<LogRing>    m_ring;
+    RecordStreamBuf             m_streamBuf;
+    std::ostream                m_stream;
+    LogRecord*                  m_record = nullptr;
+
+public:
+    ThreadLog() : m_ring( LogWriter::instance().registerThread() ), m_stream( &m_streamBuf ) {}
+
+    std::ostream* beginRecord( int level )
+    {
+        m_record = m_ring->beginRecord();
+        if ( m_record == nullptr )
+        {
+            return nullptr;
+        }
+        m_record->m_level = uint8_t(level);
+        m_streamBuf.reset( m_record->m_text, LOG_RECORD_SIZE );
+        m_stream.clear();
+        return &m_stream;
+    }
+
+    void commitRecord()
+    {
+        m_record->m_size = uint16_t( m_streamBuf.size() );
+        m_ring->commitRecord();
+    }
+};
+
+inline ThreadLog& threadLog()
+{
+    thread_local ThreadLog log;
+    return log;
+}
+
+// (debug records are on the per-message paths: they are enabled only on request)
+inline std::atomic<int> gLogLevel{ ( LOG_COMPILE_LEVEL > LOG_LEVEL_INFO ) ? LOG_COMPILE_LEVEL : LOG_LEVEL_INFO };
+
+inline void setLogLevel( int level ) { gLogLevel.store( level, std::memory_order_relaxed ); }
+
+} // namespace logs
+
+#define LOG_WITH_LEVEL( level, expr ) \
+    { \
+        if ( (level) >= logs::gLogLevel.load( std::memory_order_relaxed ) ) \
+        { \
+            auto& threadLog = logs::threadLog(); \
+            if ( auto* logStream = threadLog.beginRecord( level ); logStream != nullptr ) \
+            { \
+                *logStream << expr; \
+                threadLog.commitRecord(); \
+            } \
+        } \
+    }
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_DEBUG
+    #define LOG_DBG( expr ) LOG_WITH_LEVEL( LOG_LEVEL_DEBUG, expr )
+#else
+    #define LOG_DBG( expr ) {}
+#endif
+
+#ifndef LOG
+    #if LOG_COMPILE_LEVEL <= LOG_LEVEL_INFO
+        #define LOG( expr ) LOG_WITH_LEVEL( LOG_LEVEL_INFO, expr )
+    #else
+        #define LOG( expr ) {}
+    #endif
 #endif
 
 #ifndef LOG_ERR
-    #define LOG_ERR( expr ) \
-    {\
-        std::lock_guard<std::mutex> lock(gLogMutex);\
-        std::cerr << __FILE__ << ": " << __LINE__ << std::endl; \
-        std::cerr << expr << std::endl; \
-    }
+    #if LOG_COMPILE_LEVEL <= LOG_LEVEL_ERROR
+        #define LOG_ERR( expr ) LOG_WITH_LEVEL( LOG_LEVEL_ERROR, __FILE__ << ": " << __LINE__ << "\n" << expr )
+    #else
+        #define LOG_ERR( expr ) {}
+    #endif
 #endif
@@ -47,7 +47,7 @@ public:
         {
             delete [] message;
             if (!ec) {
-                LOG( "@" << self->m_playerName << ": Client sent message: " << length << " bytes" );
+                LOG_DBG( "@" << self->m_playerName << ": Client sent message: " << length << " bytes" );
             }
         });
     }
@@ -93,7 +93,7 @@ private:
         // tail lenght is packet_len-2
         m_dataLength -= sizeof(uint16_t);
         
-        LOG( "@" << T::m_playerName << ": TcpClient received packet size: " << m_dataLength );
+        LOG_DBG( "@" << T::m_playerName << ": TcpClient received packet size: " << m_dataLength );
         
         if ( m_dataLength == 0 || m_dataLength > 1024*1024 )
         {
@@ -7,6 +7,7 @@
 #include <boost/algorithm/string.hpp>
 
 #include "Logs.h"
+#include "Metrics.h"
 
 #pragma once
 
@@ -20,6 +21,8 @@ protected:
 
     uint16_t                     m_dataLength;
     std::vector<uint8_t>         m_packetData;
+
+    size_t                       m_pendingWriteNumber = 0;
     
 public:
     TcpClientSession( boost::asio::ip::tcp::socket&& socket, AppliedServerT& server )
@@ -28,18 +31,37 @@ public:
     {
     }
 
+    ~TcpClientSession()
+    {
+        metrics::count( metrics::c_closed_connections );
+    }
+
+    // 'response' is a whole TCP packet (envelope with its size)
     void write( const uint8_t* response, size_t dataSize )
     {
-        LOG( "#TcpClientSession write: " << dataSize );
+        LOG_DBG( "#TcpClientSession write: " << dataSize );
+
+        if ( dataSize > sizeof(uint16_t) )
+        {
+            metrics::messageOut( AppliedSessionT::messageTypeIndex( response+sizeof(uint16_t), dataSize-sizeof(uint16_t) ), dataSize );
+        }
+        metrics::changeQueuedBytes( int64_t(dataSize) );
+        metrics::record( metrics::h_queue_depth, ++m_pendingWriteNumber );
         
         m_socket.async_send( boost::asio::buffer( response, dataSize ),
-            [self=this->shared_from_this(),response] ( auto error, auto sentSize )
+            [self=this->shared_from_this(),response,dataSize] ( auto error, auto sentSize )
         {
-            LOG( "#TcpClientSession sentSize: " << sentSize );
+            LOG_DBG( "#TcpClientSession sentSize: " << sentSize );
             delete response;
+
+            auto* ptr = static_cast<TcpClientSession<AppliedServerT,AppliedSessionT>*> ( self.get() );
+            ptr->m_pendingWriteNumber--;
+            metrics::changeQueuedBytes( -int64_t(dataSize) );
+
             if (error)
             {
                 LOG_ERR( "#TcpClientSession async_send error: " << error.message() );
+                metrics::count( metrics::c_write_errors );
             }
         });
     }
@@ -60,6 +82,10 @@ public:
         if ( error )
         {
             LOG_ERR( "#TcpClientSession read error: " << error.message() );
+            if ( error != boost::asio::error::eof )
+            {
+                metrics::count( metrics::c_read_errors );
+            }
             //connectionLost( error );
             return;
         }
@@ -70,7 +96,7 @@ public:
             return;
         }
         
-        LOG( "#TcpClientSession received: " << m_dataLength );
+        LOG_DBG( "#TcpClientSession received: " << m_dataLength );
 
         m_packetData.resize( m_dataLength );
         boost::asio::async_read( m_socket, boost::asio::buffer(m_packetData.data(), m_dataLength-2 ),
@@ -86,6 +112,7 @@ public:
         if ( error )
         {
             LOG_ERR( "#TcpClientSession read error: " << error.message() );
+            metrics::count( metrics::c_read_errors );
             //connectionLost( error );
             return;
         }
@@ -98,7 +125,11 @@ public:
         
         //LOG( "received: " << std::string( m_packetData.data(), m_packetData.size() ) );
         
-        AppliedSessionT::onPacketReceived( m_packetData );
+        metrics::messageIn( AppliedSessionT::messageTypeIndex( m_packetData.data(), bytes_transferred ), m_dataLength );
+        {
+            metrics::HandlerTimer timer;
+            AppliedSessionT::onPacketReceived( m_packetData );
+        }
 
         // Read next packet
         readPacketHeader();
@@ -114,6 +145,8 @@ class TcpServer: public AppliedServerT
 
     boost::asio::ip::tcp::socket     m_socket;
 
+    std::optional<metrics::MetricsEndpoint>         m_metricsEndpoint;
+
 public:
     TcpServer( const std::string& addr, const std::string& port )
       :
@@ -144,6 +177,15 @@ public:
     {
         m_context.stop();
     }
+
+    // metrics are served (as plain text) by the server thread; must be called before 'run()'
+    void startMetricsEndpoint( const std::string& addr, const std::string& port )
+    {
+        m_metricsEndpoint.emplace( m_context, addr, port, [] ( std::ostream& out )
+        {
+            metrics::render( out, [] ( size_t type ) { return AppliedSessionT::messageTypeName( type ); } );
+        });
+    }
     
     void asyncAccept()
     {
@@ -157,6 +199,8 @@ public:
             {
                 boost::asio::socket_base::keep_alive option(true);
                 m_socket.set_option(option);
+
+                metrics::count( metrics::c_accepted_connections );
                 
                 auto session = createSession( std::move(m_socket) );
                 session->readPacketHeader();
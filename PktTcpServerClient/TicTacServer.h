@@ -72,6 +72,36 @@ public:
     {
     }
     
+    // packet type of envelope data (after TCP packet size): <player name><packet type>...
+    static size_t messageTypeIndex( const uint8_t* data, size_t dataSize )
+    {
+        if ( dataSize < sizeof(uint16_t) )
+        {
+            return cpt_undefined;
+        }
+        size_t nameLength = data[0] | (data[1] << 8);
+        if ( 2*sizeof(uint16_t) + nameLength > dataSize )
+        {
+            return cpt_undefined;
+        }
+        return data[2+nameLength] | (data[3+nameLength] << 8);
+    }
+
+    static std::string_view messageTypeName( size_t type )
+    {
+        switch( type )
+        {
+            case cpt_hi:                    return "hi";
+            case cpt_invite:                return "invite";
+            case cpt_invitation_responce:   return "invitation_responce";
+            case cpt_step:                  return "step";
+            case cpt_status:                return "status";
+            case spt_already_exists:        return "already_exists";
+            case spt_player_list:           return "player_list";
+        }
+        return "undefined";
+    }
+
     void sendEnvelopFrom( uint8_t* envelop, size_t envelopSize )
     {
         static_cast< TcpClientSession<Server,Session>* >(this)->write( envelop, envelopSize );
@@ -15,6 +15,7 @@ int main()
     std::thread( []
     {
         TcpServer< tic_tac::Server, tic_tac::Session > server("0.0.0.0", "15001" );
+        server.startMetricsEndpoint( "127.0.0.1", "15002" );
         server.run();
     }).detach();
     